@@ -32,6 +32,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OSL/oslversion.h>
 
 #include <vector>
+#include <string>
+#include <memory>
 
 #ifdef LLVM_NAMESPACE
 namespace llvm = LLVM_NAMESPACE;
@@ -43,6 +45,7 @@ namespace llvm {
   class ExecutionEngine;
   class Function;
   class FunctionType;
+  class GlobalVariable;
   class JITMemoryManager;
   class Linker;
   class LLVMContext;
@@ -105,6 +108,18 @@ public:
                                        const std::string &name=std::string(),
                                        std::string *err=NULL);
 
+    /// Like module_from_bitcode, but the bitcode is only parsed the first
+    /// time this thread sees it, into a template module that is kept
+    /// around; each call returns a fresh clone of the template, which is
+    /// much cheaper than parsing again.  If parse_time is not NULL, it
+    /// receives the time it took to parse the template, i.e., roughly
+    /// what each call would cost without the template.
+    llvm::Module *module_from_bitcode_template (const char *bitcode,
+                                       size_t size,
+                                       const std::string &name=std::string(),
+                                       std::string *err=NULL,
+                                       double *parse_time=NULL);
+
     /// Create a new function (that will later be populated with
     /// instructions) with up to 4 args.
     llvm::Function *make_function (const std::string &name, bool fastcall,
@@ -170,9 +185,23 @@ public:
                                        const std::vector<std::string> &exceptions,
                                        const std::vector<std::string> &moreexceptions);
 
-    /// Setup LLVM optimization passes.
+    /// Setup LLVM optimization passes.  An optlevel < 0 requests only
+    /// the few cheapest passes, for code that must be ready quickly.
     void setup_optimization_passes (int optlevel);
 
+    /// Should engines made subsequently by make_jit_execengine() favor
+    /// code generation speed over the quality of the code (no codegen
+    /// optimization, fast instruction selection)?
+    void fast_codegen (bool fast) { m_fast_codegen = fast; }
+    bool fast_codegen () const { return m_fast_codegen; }
+
+    /// Which CPU should engines made subsequently by make_jit_execengine()
+    /// generate code for?  "baseline" (or empty) means the minimal CPU of
+    /// the target triple, "host" means the CPU we're running on, and
+    /// anything else is taken as an LLVM CPU name (e.g. "haswell").
+    void target_isa (const std::string &isa) { m_target_isa = isa; }
+    const std::string &target_isa () const { return m_target_isa; }
+
     /// Run the optimization passes.
     void do_optimize (std::string *err = NULL);
 
@@ -181,6 +210,60 @@ public:
     /// you have already called do_optimize() if you want optimization.
     void *getPointerToFunction (llvm::Function *func);
 
+    /// Retrieve a callable pointer to the named function, which may have
+    /// come from object code added with add_object_code() rather than
+    /// from IR in the current module.  Return NULL if it can't be found.
+    void *getPointerToFunction (const std::string &name);
+
+    /// Ask the current ExecutionEngine to save a copy of the relocatable
+    /// object code it generates for the module, which may be retrieved
+    /// with object_code() after the JIT has happened, and start a fresh
+    /// list of relocatable_symbols().  Return false if this is not
+    /// supported by the JIT in use.
+    bool save_object_code ();
+
+    /// Return the object code saved since save_object_code() was called
+    /// (or an empty string if none was generated).
+    const std::string &object_code () const;
+
+    /// Load relocatable object code (as previously retrieved with
+    /// object_code(), possibly by another process) into the current
+    /// ExecutionEngine.  Any relocatable symbols it refers to must first
+    /// be declared with add_symbol_mapping().  Return true on success,
+    /// otherwise return false and put an error message in err (if not
+    /// NULL).
+    bool add_object_code (const std::string &obj, std::string *err=NULL);
+
+    /// Should pointer constants that would otherwise be baked into the
+    /// generated code as absolute addresses instead be expressed as the
+    /// addresses of named external symbols?  This is necessary for any
+    /// code whose object code will be saved and later relinked in a
+    /// different process, where those addresses will differ.
+    void relocatable_pointers (bool r) { m_relocatable_pointers = r; }
+    bool relocatable_pointers () const { return m_relocatable_pointers; }
+
+    /// Return the names of the external symbols that were generated to
+    /// stand in for pointer constants (since the last call to
+    /// save_object_code()) and that the code in the module still refers
+    /// to, i.e., that must be bound when its object code is relinked.
+    std::vector<std::string> relocatable_symbols ();
+
+    /// Declare the external symbol 'name' in the current module (if not
+    /// already declared) and map it to addr in the current
+    /// ExecutionEngine.
+    void add_symbol_mapping (const std::string &name, void *addr);
+
+    /// Return a string that describes the JIT target (LLVM version,
+    /// target triple, and the CPU that the given target_isa() stands
+    /// for), suitable as part of the key for any cache of generated
+    /// object code.
+    static std::string jit_target (const std::string &isa);
+
+    /// Encode arbitrary characters as a string that may safely be used
+    /// as part of a symbol name, and decode it again.
+    static std::string symbol_encode (OIIO::string_view s);
+    static std::string symbol_decode (OIIO::string_view s);
+
     /// Wrap ExecutionEngine::InstallLazyFunctionCreator.
     void InstallLazyFunctionCreator (void* (*P)(const std::string &));
 
@@ -294,6 +377,13 @@ public:
     /// If the type specified is NULL, it will make a 'void *'.
     llvm::Value *constant_ptr (void *p, llvm::PointerType *type=NULL);
 
+    /// Return an llvm::Value holding the given pointer constant.  If
+    /// relocatable_pointers() is on (and p is not NULL), the pointer is
+    /// expressed as the address of the external symbol 'name', which is
+    /// mapped to p in the current ExecutionEngine.
+    llvm::Value *constant_ptr (void *p, const std::string &name,
+                               llvm::PointerType *type=NULL);
+
     /// Return an llvm::Value holding the given string constant.
     llvm::Value *constant (OIIO::ustring s);
     llvm::Value *constant (OIIO::string_view s) {
@@ -304,6 +394,12 @@ public:
     /// representation of a TypeDesc.
     llvm::Value *constant (const OIIO::TypeDesc &type);
 
+    /// Return a void pointer to a copy, private to the module, of the
+    /// given data: type.numelements()*type.aggregate values of its
+    /// basetype (FLOAT, INT, STRING, or UINT64).  Unlike constant_ptr,
+    /// the code doesn't depend on where the data lives in this process.
+    llvm::Value *constant_data (const OIIO::TypeDesc &type, const void *data);
+
     /// Return an llvm::Value for a void* variable with value NULL.
     llvm::Value *void_ptr_null ();
 
@@ -413,6 +509,11 @@ public:
     /// Dereference a pointer:  return *ptr
     llvm::Value *op_load (llvm::Value *ptr);
 
+    /// Dereference a pointer-sized value with acquire ordering, to pair
+    /// with a release store by another thread (such as a std::atomic
+    /// store with memory_order_release).
+    llvm::Value *op_load_acquire (llvm::Value *ptr);
+
     /// Store to a dereferenced pointer:   *ptr = val
     void op_store (llvm::Value *val, llvm::Value *ptr);
 
@@ -486,14 +587,38 @@ public:
 
     std::string func_name (llvm::Function *f);
 
+    /// Opaque owner of the memory holding JITed code and data.
+    class JITMemory;
+    typedef std::shared_ptr<JITMemory> JITMemoryRef;
+
+    /// Return a reference to the memory that holds the code JITed by the
+    /// current ExecutionEngine.  Functions retrieved from the engine
+    /// remain valid after the engine is destroyed, for as long as a
+    /// reference to this memory is held, and no longer.  If nobody holds
+    /// a reference by the time the engine is replaced or the LLVM_Util is
+    /// destroyed, the memory is retained for the life of the process.
+    /// (For the old JIT, all code lives in a per-thread arena that is
+    /// never freed, and this returns an empty reference.)
+    JITMemoryRef jit_memory () const { return m_jit_memory; }
+
+    /// Return the total amount of JIT memory currently live.
     static size_t total_jit_memory_held ();
 
+    /// Return the total amount of JIT memory that has been freed.
+    static size_t total_jit_memory_freed ();
+
 private:
     class MemoryManager;
     class IRBuilder;
+    class ObjectCache;
 
     void SetupLLVM ();
+    void release_jit_memory ();
     IRBuilder& builder();
+    llvm::GlobalVariable *external_symbol (const std::string &name, void *addr,
+                                           size_t size = 0);
+    llvm::Constant *ustring_constant (OIIO::ustring s);
+    static std::string target_cpu (const std::string &isa);
 
     int m_debug;
     PerThreadInfo *m_thread;
@@ -505,6 +630,12 @@ private:
     llvm::legacy::PassManager *m_llvm_module_passes;
     llvm::legacy::FunctionPassManager *m_llvm_func_passes;
     llvm::ExecutionEngine *m_llvm_exec;
+    JITMemoryRef m_jit_memory;
+    ObjectCache *m_object_cache;
+    bool m_relocatable_pointers;
+    bool m_fast_codegen;
+    std::string m_target_isa;
+    std::vector<std::string> m_relocatable_symbols;
     std::vector<llvm::BasicBlock *> m_return_block;     // stack for func call
     std::vector<llvm::BasicBlock *> m_loop_after_block; // stack for break
     std::vector<llvm::BasicBlock *> m_loop_step_block;  // stack for continue
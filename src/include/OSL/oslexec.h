@@ -29,6 +29,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
 #include <memory>
+#include <functional>
 
 #include <OSL/oslconfig.h>
 #include <OSL/shaderglobals.h>
@@ -37,6 +38,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OpenImageIO/refcnt.h>
 #include <OpenImageIO/ustring.h>
 #include <OpenImageIO/array_view.h>
+#include <OpenImageIO/paramlist.h>
 
 OSL_NAMESPACE_ENTER
 
@@ -94,7 +96,21 @@ public:
     ///    int buffer_printf      Buffer printf output from shaders and
     ///                              output atomically, to prevent threads
     ///                              from interleaving lines. (1)
-    ///    int profile            Perform some rudimentary profiling (0)
+    ///    int error_thread       Pass shader errors, warnings, and printf
+    ///                              output to the ErrorHandler from a
+    ///                              thread of the ShadingSystem's own,
+    ///                              rather than from the shading thread;
+    ///                              see flush_errors(). (0)
+    ///    int suppress_repeat_errors  If nonzero, the number of errors
+    ///                              and warnings per second each shading
+    ///                              context reports from any one place in
+    ///                              a shader; it drops the rest. (0)
+    ///    int profile            Perform some rudimentary profiling (0).
+    ///                              At 2, also time each layer and the
+    ///                              texture, getattribute, trace, and
+    ///                              pointcloud callbacks, for getstats()
+    ///                              at level 2 and up, and as JSON from
+    ///                              exec_profile_json().
     ///    int no_noise           Replace noise with constant value. (0)
     ///    int no_pointcloud      Skip pointcloud lookups. (0)
     ///    int exec_repeat        How many times to run each group (1).
@@ -123,6 +139,11 @@ public:
     ///                              isconnected()? (0)
     ///    int greedyjit          Optimize and compile all shaders up front,
     ///                              versus only as needed (0).
+    ///    int async_jit          If nonzero, optimize and compile shader
+    ///                              groups in this many background threads
+    ///                              (<0 means one per core), and don't
+    ///                              block execute() on an uncompiled group
+    ///                              -- see group_ready(). (0)
     ///    int lockgeom           Default 'lockgeom' value for shader params
     ///                              that don't specify it (1).  Lockgeom
     ///                              means a param CANNOT be overridden by
@@ -130,6 +151,51 @@ public:
     ///    int countlayerexecs    Add extra code to count total layers run.
     ///    string archive_groupname  Name of a group to pickle and archive.
     ///    string archive_filename   Name of file to save the group archive.
+    ///    string llvm_cache_dir  Directory in which to save the JIT-compiled
+    ///                              object code of shader groups, to be
+    ///                              reused (skipping LLVM IR generation,
+    ///                              optimization, and code generation) for
+    ///                              identical groups in later runs. ("")
+    ///    string llvm_target_isa  The CPU to generate code for: "baseline"
+    ///                              (the generic CPU of the target
+    ///                              architecture, so that saved object
+    ///                              code runs on any machine), "host" (the
+    ///                              CPU we're running on), or an LLVM CPU
+    ///                              name. ("baseline")
+    ///    int llvm_tier_executions  If nonzero, first compile each group
+    ///                              quickly with minimal optimization, and
+    ///                              once it has executed this many times,
+    ///                              recompile it in the background with
+    ///                              full optimization ("llvm_optimize"),
+    ///                              swapping in the new code when done. (0)
+    ///    float llvm_tier_time   Like llvm_tier_executions, but promote a
+    ///                              group once it has accumulated this many
+    ///                              seconds of shading time (requires
+    ///                              "profile"). (0)
+    ///    int llvm_split_layers  If nonzero, JIT any group with more than
+    ///                              this many layers in chunks of about
+    ///                              this many layers, concurrently.  Layer
+    ///                              calls between chunks are indirect and
+    ///                              can't be inlined. (0)
+    ///    int llvm_lazy_entry_layers  If nonzero, don't JIT the entry layers
+    ///                              of a group with several of them until
+    ///                              each is first executed. (0)
+    ///    int allow_respecialize  If nonzero, groups keep a copy of their
+    ///                              unoptimized layers so that lockgeom=0
+    ///                              params changed with ReParameter can
+    ///                              later be folded in as constants by
+    ///                              respecialize_group().  Their layers
+    ///                              are JITed as separate functions, as
+    ///                              with llvm_split_layers. (0)
+    ///    int evict_master_code   If nonzero, free a loaded shader's code
+    ///                              once every instance using it has
+    ///                              copied it for optimization, and re-read
+    ///                              the .oso if a later instance needs it.
+    ///                              Saves memory in scenes with many
+    ///                              distinct shaders.  If the .oso has
+    ///                              changed in the meantime, a group that
+    ///                              needs it reports an error and does
+    ///                              nothing. (0)
     /// 3. Attributes that that are intended for developers debugging
     /// liboslexec itself:
     /// These attributes may be helpful for liboslexec developers or
@@ -146,6 +212,19 @@ public:
     ///         opt_fold_getattribute, opt_middleman, opt_texture_handle
     ///         opt_seed_bblock_aliases
     ///    int opt_passes         Number of optimization passes per layer (10)
+    ///    int opt_adaptive_passes  If nonzero, stop optimizing a layer after
+    ///                              one pass that confirms the previous one
+    ///                              changed nothing, instead of after
+    ///                              several. (0)
+    ///    int opt_profile        If nonzero, time each optimizer pass and
+    ///                              constant folder, for getstats() at
+    ///                              level 2 and up, and as JSON from
+    ///                              opt_profile_json(). (0)
+    ///    int opt_specialization_cache  Max number of optimized instances to
+    ///                              remember, so that an instance with the
+    ///                              same master, parameter values, and
+    ///                              connections in another group needn't
+    ///                              be optimized again; 0 turns it off. (4096)
     ///    int llvm_optimize      Which of several LLVM optimize strategies (0)
     ///    int llvm_debug         Set LLVM extra debug level (0)
     ///    int llvm_debug_layers  Extra printfs upon entering and leaving
@@ -404,6 +483,43 @@ public:
     bool ConnectShaders (string_view srclayer, string_view srcparam,
                          string_view dstlayer, string_view dstparam);
 
+    // The calls above build one group at a time, through state kept in
+    // the ShadingSystem. The variants below instead keep the pending
+    // state in the group being built, so any number of threads may each
+    // build their own groups at once:
+    // ShaderGroupRef group = ss->ShaderGroupCreate (groupname);
+    //    ss->Parameter (*group, "texturename", TypeDesc::TypeString, &mapname);
+    //    ss->Shader (*group, "surface", "texmap", "texturelayer");
+    //    ss->Parameter (*group, "roughness", TypeDesc::TypeFloat, &roughness);
+    //    ss->Shader (*group, "surface", "plastic", "illumlayer");
+    //    ss->ConnectShaders (*group, "texturelayer", "Cout", "illumlayer", "Cs");
+    // ss->ShaderGroupEnd (*group);
+    // Only ShaderGroupEnd, which registers the finished group with the
+    // ShadingSystem, takes a lock. A group must be built by one thread.
+    // Once a group is ended, Parameter, Shader and ConnectShaders on it
+    // fail with an error; use ReParameter to change it after that.
+
+    /// Create a new, empty shader group without making it the current
+    /// group.
+    ShaderGroupRef ShaderGroupCreate (string_view groupname = string_view());
+
+    /// Set a parameter of the next shader added to the group.
+    bool Parameter (ShaderGroup &group, string_view name, TypeDesc t,
+                    const void *val, bool lockgeom = true);
+
+    /// Append a new shader instance to the group.
+    bool Shader (ShaderGroup &group, string_view shaderusage,
+                 string_view shadername, string_view layername = string_view());
+
+    /// Connect two shaders within the group.
+    bool ConnectShaders (ShaderGroup &group,
+                         string_view srclayer, string_view srcparam,
+                         string_view dstlayer, string_view dstparam);
+
+    /// Signal the end of the group's construction.  It's an error to
+    /// end a group more than once.
+    bool ShaderGroupEnd (ShaderGroup &group);
+
     /// Replace a parameter value in a previously-declared shader group.
     /// This is meant to called after the ShaderGroupBegin/End, but will
     /// fail if the shader has already been irrevocably optimized/compiled,
@@ -411,10 +527,50 @@ public:
     /// indicates that it's a parameter that may be overridden by the
     /// geometric primitive).  This call gives you a way of changing the
     /// instance value, even if it's not a geometric override.
+    ///
+    /// If the group was optimized with the "allow_respecialize" option
+    /// set, the new value is also remembered, to be folded into the code
+    /// as a constant by the next call to respecialize_group().
     bool ReParameter (ShaderGroup &group,
                       string_view layername, string_view paramname,
                       TypeDesc type, const void *val);
 
+    /// Re-optimize and re-JIT a group whose lockgeom=0 params have been
+    /// changed with ReParameter since it was optimized, treating all such
+    /// params as constants.  Only the layers whose params changed, and
+    /// those downstream of them, are optimized and JITed again; the rest
+    /// keep their code, unless the changes would move the data it uses
+    /// (in which case unconnected layers whose params didn't change
+    /// still reuse their previous optimization, if the
+    /// "opt_specialization_cache" option is on).  The group must have
+    /// been optimized with the "allow_respecialize" option set, and must
+    /// not be executing on any thread during the call.  Return true if
+    /// the group is up to date.
+    bool respecialize_group (ShaderGroup &group);
+
+    /// Return a variant of the group that is specialized for a
+    /// particular object: getattribute() calls that don't name an object
+    /// (and so refer to the object being shaded) are folded to constants
+    /// if they ask for one of the given attributes, with the same name
+    /// and type, along with any code that depends on them.  Variants are
+    /// cached, so objects asking for the same attribute values share one.
+    /// The variant must only be used to shade objects that really have
+    /// those attribute values.  The group must not have been optimized
+    /// yet, unless it was optimized with the "allow_respecialize" option
+    /// set.  Return an empty reference upon failure.
+    ShaderGroupRef object_variant (ShaderGroup *group,
+                                   const OIIO::ParamValueList &attributes);
+
+    /// Return a variant of the group specialized for the object that
+    /// the renderer identifies with the given ShaderGlobals::objdata.
+    /// Every attribute that the group's object-less getattribute() calls
+    /// ask for by a constant name is looked up right away with
+    /// RendererServices::get_object_attribute(), and the variant is the
+    /// one for the attribute values found, as if they had been passed to
+    /// the call above; objdata isn't kept.  The renderer decides which
+    /// attributes are constant over the object and may be folded.
+    ShaderGroupRef object_variant (ShaderGroup *group, void *objdata);
+
     /// Optional: create the per-thread data needed for shader
     /// execution.  Doing this and passing it to get_context speeds is a
     /// bit faster than get_context having to do a thread-specific
@@ -446,9 +602,11 @@ public:
     /// and then return it when it's done.  This is just a wrapper around
     /// execute_init, execute_layer of the last (presumably group entry)
     /// layer, and execute_cleanup. If run==false, just do the binding and
-    /// setup, don't actually run the shader.
+    /// setup, don't actually run the shader.  If not_ready is non-NULL,
+    /// it's set as by execute_init.
     bool execute (ShadingContext *ctx, ShaderGroup &group,
-                  ShaderGlobals &globals, bool run=true);
+                  ShaderGlobals &globals, bool run=true,
+                  bool *not_ready=NULL);
     OSL_DEPRECATED("Deprecated since 1.6, pass context pointer, not reference.")
     bool execute (ShadingContext &ctx, ShaderGroup &group,
                   ShaderGlobals &globals, bool run=true);
@@ -460,9 +618,14 @@ public:
     /// execute any part of the shader, so do all the usual binding
     /// preparation, but don't actually run the shader.  Return true if the
     /// shader executed, false if it did not (including if the shader itself
-    /// was empty).
+    /// was empty, or if the "async_jit" option is set and the group has
+    /// been queued for compilation but is not yet ready).  If not_ready
+    /// is non-NULL, it's set to true in that last case, and to false
+    /// otherwise, so a renderer can tell a point it should shade again
+    /// later from one whose shader does nothing.
     bool execute_init (ShadingContext &ctx, ShaderGroup &group,
-                       ShaderGlobals &globals, bool run=true);
+                       ShaderGlobals &globals, bool run=true,
+                       bool *not_ready=NULL);
 
     /// Execute the layer whose index is specified, in this context. It is
     /// presumed that execute_init() has already been called, with
@@ -541,6 +704,25 @@ public:
     ///
     std::string getstats (int level=1) const;
 
+    /// Return the optimizer profile (see the "opt_profile" option) as a
+    /// JSON object.
+    std::string opt_profile_json () const;
+
+    /// Return the execution profile (see the "profile" option) as a JSON
+    /// object, with one entry per shader group, keyed by the group's id.
+    /// Each group's profile is kept with the group, so the groups that
+    /// have been destroyed no longer appear.
+    std::string exec_profile_json () const;
+
+    /// With the "error_thread" option, shader errors, warnings, and
+    /// printf output are passed to the ErrorHandler by a thread of the
+    /// ShadingSystem's own, so shading threads don't wait on each other
+    /// to report them.  Wait until everything reported so far has been
+    /// passed on, for example before printing anything that should
+    /// follow it.  Without that option, there's never anything to wait
+    /// for.
+    void flush_errors ();
+
     void register_closure (string_view name, int id, const ClosureParam *params,
                            PrepareClosureFunc prepare, SetupClosureFunc setup);
 
@@ -576,8 +758,46 @@ public:
     /// If option "greedyjit" was set, this call will trigger all
     /// shader groups that have not yet been compiled to do so with the
     /// specified number of threads (0 means use all available HW cores).
+    /// The most expensive groups are started first, and threads take the
+    /// next group as soon as they finish one.
     void optimize_all_groups (int nthreads=0);
 
+    /// A function that calls task(i) for each i in [0,ntasks), ideally
+    /// concurrently, and returns when all of them are done.
+    typedef std::function<void(int ntasks, const std::function<void(int)> &task)> ParallelForFunc;
+
+    /// Supply a ParallelForFunc that optimize_all_groups() and the JIT of
+    /// split groups (see the "llvm_split_layers" option) will use to run
+    /// their work on the renderer's own thread pool.  It may be called
+    /// from within one of its own tasks, and from several threads at
+    /// once.  If none is given (or an empty function is passed), the
+    /// ShadingSystem uses a pool of threads of its own, which persist
+    /// between calls.
+    void set_parallel_for (ParallelForFunc func);
+
+    /// Return true if the group has been optimized and JITed and is ready
+    /// to execute.  When the "async_jit" option is set, execute() returns
+    /// false for a group that is still waiting to be compiled in the
+    /// background; this lets the renderer tell that apart from a group
+    /// that does nothing, and defer those shading points.
+    bool group_ready (const ShaderGroup *group) const;
+
+    /// Block until the group is optimized and JITed and ready to
+    /// execute.  With the "async_jit" option, that means queueing it for
+    /// the background JIT threads if it isn't already, and waiting for
+    /// them to finish it; otherwise the group is simply compiled on the
+    /// calling thread.  Return true if the group is ready, false only if
+    /// the ShadingSystem is shutting down.
+    bool wait_for_group (ShaderGroup *group);
+
+    /// If the group was compiled at the fast tier (see the
+    /// "llvm_tier_executions" and "llvm_tier_time" options) and has been
+    /// queued to be recompiled with full optimization, block until that
+    /// is done.  Return true if the group is now running fully optimized
+    /// code, false if it's still at the fast tier (because it hasn't run
+    /// enough yet to be queued, or the ShadingSystem is shutting down).
+    bool wait_for_promotion (ShaderGroup *group);
+
     /// Return a pointer to the TextureSystem being used.
     TextureSystem * texturesys () const;
 
@@ -588,6 +808,25 @@ public:
     /// later.
     bool archive_shadergroup (ShaderGroup *group, string_view filename);
 
+    /// Optimize and compile the group (which must not already have been
+    /// optimized), and save its native code to the named file, from which
+    /// load_group_object() can later retrieve it -- typically in another
+    /// process, for example for a batch render, to avoid spending any
+    /// time on LLVM at render time.  Return true upon success.
+    bool compile_group_object (ShaderGroup *group, string_view filename);
+
+    /// Have the group use the native code previously saved to the named
+    /// file by compile_group_object(), rather than JITing it.  The group
+    /// must be identical to the one that was compiled (for example, both
+    /// reconstituted from the same serialized group), and the shading
+    /// system must have the same options (including "llvm_target_isa")
+    /// and OSL and LLVM versions.  When the group is first needed, it's
+    /// set up from the file without being optimized or JITed; if the file
+    /// turns out not to match, a warning is issued and the group is
+    /// optimized and JITed as usual.  Return false if the group is
+    /// already optimized.
+    bool load_group_object (ShaderGroup *group, string_view filename);
+
     /// Helper function -- copy or convert a source value (described by
     /// srctype) to destination (described by dsttype).  The function
     /// returns true upon success, or false if the types differ in a way
@@ -418,6 +418,18 @@ public:
     /// Return a pointer to the texture system (if available).
     virtual TextureSystem *texturesys () const;
 
+    /// Get the named attribute of the object that the renderer knows by
+    /// 'objdata' (see ShadingSystem::object_variant), to be folded into
+    /// the shaders as a constant, and write it into 'val'.  It's only
+    /// called from within object_variant().  Only return
+    /// true for attributes whose value is the same everywhere on the
+    /// object, never for ones that vary from point to point.  If index
+    /// is >= 0, get that element of an array attribute.  The default
+    /// implementation knows no object attributes.
+    virtual bool get_object_attribute (void *objdata, TypeDesc type,
+                                       ustring name, int index, void *val)
+        { return false; }
+
     /// Options we use for noise calls.
     struct NoiseOpt {
         int anisotropic;
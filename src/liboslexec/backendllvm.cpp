@@ -90,8 +90,10 @@ BackendLLVM::BackendLLVM (ShadingSystemImpl &shadingsys,
       ll(llvm_debug()),
       m_stat_total_llvm_time(0), m_stat_llvm_setup_time(0),
       m_stat_llvm_irgen_time(0), m_stat_llvm_opt_time(0),
-      m_stat_llvm_jit_time(0)
+      m_stat_llvm_jit_time(0), m_stat_llvm_setup_saved(0),
+      m_cacheable(false), m_fast_tier(shadingsys.llvm_tiered())
 {
+    ll.target_isa (shadingsys.llvm_target_isa().string());
 #ifdef OSL_SPI
     // Temporary (I hope) check to diagnose an intermittent failure of
     // getcwd inside LLVM. Oy.
@@ -337,7 +339,7 @@ BackendLLVM::llvm_get_pointer (const Symbol& sym, int deriv,
     llvm::Value *result = NULL;
     if (sym.symtype() == SymTypeConst) {
         // For constants, start with *OUR* pointer to the constant values.
-        result = ll.ptr_cast (ll.constant_ptr (sym.data()),
+        result = ll.ptr_cast (llvm_symbol_address_constant (sym),
                               ll.type_ptr (llvm_type(sym.typespec().elementtype())));
 
     } else {
@@ -364,6 +366,56 @@ BackendLLVM::llvm_get_pointer (const Symbol& sym, int deriv,
 
 
 
+llvm::Value *
+BackendLLVM::llvm_symbol_address_constant (const Symbol &sym, bool typedesc)
+{
+    void *p = typedesc ? (void *)&sym.typespec().simpletype() : sym.data();
+    if (! ll.relocatable_pointers() || ! p)
+        return ll.constant_ptr (p);
+
+    // Constant data goes into the module itself.
+    if (typedesc) {
+        static_assert (sizeof(TypeDesc) == sizeof(uint64_t),
+                       "TypeDesc expected to be packed in 64 bits");
+        return ll.constant_data (TypeDesc::UINT64, p);
+    }
+    TypeDesc t = sym.typespec().simpletype();
+    if (sym.symtype() == SymTypeConst &&
+          (t.basetype == TypeDesc::FLOAT || t.basetype == TypeDesc::INT ||
+           t.basetype == TypeDesc::STRING))
+        return ll.constant_data (t, p);
+
+    // A param's value may change (see ReParameter), so refer to the
+    // param itself, by its layer and name.  Those are the same before
+    // and after optimization.
+    int param = layer() >= 0 ? inst()->findparam (sym.name()) : -1;
+    if (param >= 0 && inst()->symbol (param) == &sym) {
+        std::string name = Strutil::format ("oslreloc_param_%d_%s", layer(),
+                                            LLVM_Util::symbol_encode (sym.name()));
+        return ll.constant_ptr (p, name);
+    }
+
+    // We have no way to find it again in another process, so this group
+    // can't go into the object cache.
+    m_cacheable = false;
+    return ll.constant_ptr (p);
+}
+
+
+
+llvm::Value *
+BackendLLVM::llvm_texture_handle_constant (RendererServices::TextureHandle *handle,
+                                           const Symbol &filename)
+{
+    if (! handle || ! ll.relocatable_pointers())
+        return ll.constant_ptr (handle);
+    ustring name = *(ustring *)filename.data();
+    return ll.constant_ptr (handle, "oslreloc_texture_" +
+                                    LLVM_Util::symbol_encode (name.string()));
+}
+
+
+
 llvm::Value *
 BackendLLVM::llvm_load_value (const Symbol& sym, int deriv,
                                    llvm::Value *arrayindex, int component,
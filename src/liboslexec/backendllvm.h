@@ -61,10 +61,24 @@ public:
     /// and store the llvm::Function* handle to it with the ShaderGroup.
     virtual void run ();
 
+    /// If the group is to be loaded from or saved to precompiled code
+    /// (see ShadingSystem::load_group_object and compile_group_object),
+    /// note its source_hash() before it's optimized.  If it's to be
+    /// loaded, and the file matches, set the group up from that instead
+    /// of optimizing and JITing it, and return true.  Otherwise (warning
+    /// if the file didn't match) return false, and the caller should
+    /// optimize the group and run() as usual.
+    bool load_precompiled ();
+
 
     /// What LLVM debug level are we at?
     int llvm_debug() const;
 
+    /// Should we generate code as quickly as possible, at the expense of
+    /// its speed (the first tier of tiered compilation)?
+    bool fast_tier () const { return m_fast_tier; }
+    void fast_tier (bool fast) { m_fast_tier = fast; }
+
     /// Set up a bunch of static things we'll need for the whole group.
     ///
     void initialize_llvm_group ();
@@ -396,6 +410,21 @@ public:
 
     llvm::Function *layer_func () const { return ll.current_function(); }
 
+    /// Return an llvm::Value holding the address of sym's data (or of
+    /// its TypeDesc, if typedesc is true) as a pointer constant.  When
+    /// generating relocatable code for the JIT object cache, constant
+    /// data is copied into the module, and a param's address is named by
+    /// its layer and name, so that it can be bound to the same param of
+    /// an identical group in another process -- even one that hasn't
+    /// been optimized.
+    llvm::Value *llvm_symbol_address_constant (const Symbol &sym,
+                                               bool typedesc=false);
+
+    /// Return an llvm::Value holding the texture handle (which may be
+    /// NULL) for the constant texture filename held by sym.
+    llvm::Value *llvm_texture_handle_constant (RendererServices::TextureHandle *handle,
+                                               const Symbol &filename);
+
     /// Call this when JITing a texture-like call, to track how many.
     void generated_texture_call (bool handle) {
         shadingsys().m_stat_tex_calls_codegened += 1;
@@ -406,15 +435,111 @@ public:
     LLVM_Util ll;
 
 private:
+    /// Return a hash of everything that influences the code we would
+    /// generate for this group.  If structural is true, leave out the
+    /// things that only identify the group (its name and instance IDs);
+    /// the structural hash names the JIT object cache file holding the
+    /// group's code.
+    std::string group_hash (bool structural);
+
+    /// Write what group_hash() and source_hash() have in common: the
+    /// versions, JIT target, and options that influence code generation.
+    void hash_config (std::ostream &out);
+
+    /// Return a hash of everything that determines the optimized group
+    /// -- and thus its code -- computed before it's optimized: the
+    /// code of the masters, the instance params and connections, and
+    /// the options.  Precompiled code is matched to groups by it.
+    std::string source_hash ();
+
+    /// The contents of an object file written by save_cached_object.
+    struct SavedObject;
+
+    /// Read the object file.  Return false if it isn't there or can't be
+    /// parsed.
+    bool read_object_file (const std::string &filename, SavedObject &saved);
+
+    /// Relink the saved object code, and set up the group's entry points
+    /// from it.  Unless the groupdata layout has already been restored
+    /// from the file (for precompiled code), it's laid out anew from the
+    /// optimized group.  Return true upon success.
+    bool link_object (const std::string &filename, const SavedObject &saved,
+                      bool precompiled);
+
+    /// Try to set up the group's entry points from the object code in
+    /// the cache file.  Return true upon success, false if the file
+    /// isn't there, wasn't saved for a group with the given group_hash(),
+    /// or can't be used (in which case the caller should proceed to
+    /// generate the code as usual).
+    bool load_cached_object (const std::string &filename,
+                             const std::string &hash);
+
+    /// Save the object code that was just JITed for the group (along with
+    /// what we'll need to relink it, and what the optimizer worked out
+    /// about the group) to the cache (or precompiled object) file.
+    void save_cached_object (const std::string &filename,
+                             const std::string &hash,
+                             llvm::Function *init_func,
+                             const std::vector<llvm::Function*> &funcs);
+
+    /// Return the address in this process that a relocatable symbol
+    /// (generated while ll.relocatable_pointers() was on) stands for, or
+    /// NULL if it can't be determined.
+    void *resolve_relocatable_symbol (const std::string &name);
+
+    /// Set up a fresh module (with the shadeops library) and an
+    /// ExecutionEngine to JIT it.  Return false if that failed.
+    bool setup_module_and_engine ();
+
+    /// The JITed functions from compiling one chunk of a split group.
+    struct ChunkResult {
+        RunLLVMGroupFunc init;
+        std::vector<std::pair<int,RunLLVMGroupFunc> > layers;
+        LLVM_Util::JITMemoryRef jit_memory;
+        ChunkResult () : init(NULL) { }
+    };
+
+    /// Generate, optimize, and JIT the given layers of the group (plus
+    /// the group init function, if with_init is true) in a module of
+    /// their own.  Calls to layers in other chunks go through the group's
+    /// layer table.
+    void build_chunk (const std::vector<int> &layers, bool with_init,
+                      ChunkResult &result);
+
+    /// Split the used layers of the group into chunks of about
+    /// chunksize layers, and compile the chunks concurrently.  Entry
+    /// layers in lazy_layers are left out, and get stubs that JIT them
+    /// when first called (see compile_lazy_layer).
+    void run_split (int chunksize, const std::vector<int> &lazy_layers);
+
+    /// Set up m_layer_remap and m_num_used_layers for the group.
+    void find_used_layers ();
+
+    /// Which of the group's entry layers, if any, should be JITed only
+    /// when first called?
+    std::vector<int> find_lazy_layers ();
+
+public:
+    /// JIT lazy layer number n of the group, if no other thread has done
+    /// it yet, and patch it into the group's tables in place of its
+    /// stub.  Return the layer's function.
+    static RunLLVMGroupFunc compile_lazy_layer (ShadingContext *ctx, int n);
+private:
+    /// The lock that guards the JIT of lazy layer number n of the group.
+    static mutex &lazy_layer_mutex (ShaderGroup &group, int n);
+
     std::vector<int> m_layer_remap;     ///< Remapping of layer ordering
     std::set<int> m_layers_already_run; ///< List of layers run
     int m_num_used_layers;              ///< Number of layers actually used
+    std::vector<bool> m_chunk_layers;   ///< Layers we're building code for
+                                        ///<   (empty means all of them)
 
     double m_stat_total_llvm_time;        ///<   total time spent on LLVM
     double m_stat_llvm_setup_time;        ///<     llvm setup time
     double m_stat_llvm_irgen_time;        ///<     llvm IR generation time
     double m_stat_llvm_opt_time;          ///<     llvm IR optimization time
     double m_stat_llvm_jit_time;          ///<     llvm JIT time
+    double m_stat_llvm_setup_saved;       ///<     setup time saved by cloning
 
     // LLVM stuff
     AllocationMap m_named_values;
@@ -428,6 +553,9 @@ private:
     llvm::PointerType *m_llvm_type_prepare_closure_func;
     llvm::PointerType *m_llvm_type_setup_closure_func;
     int m_llvm_local_mem;             // Amount of memory we use for locals
+    bool m_cacheable;                 // May the object code be cached?
+    std::string m_source_hash;        // source_hash() before optimizing
+    bool m_fast_tier;                 // Compile fast rather than well?
 
     friend class ShadingSystemImpl;
 };
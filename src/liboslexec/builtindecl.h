@@ -148,6 +148,8 @@ DECL (osl_error, "xXs*")
 DECL (osl_warning, "xXs*")
 DECL (osl_split, "isXsii")
 DECL (osl_incr_layers_executed, "xX")
+DECL (osl_profile_layer_enter, "xXi")
+DECL (osl_profile_layer_exit, "xX")
 
 NOISE_IMPL(cellnoise)
 //NOISE_DERIV_IMPL(cellnoise)
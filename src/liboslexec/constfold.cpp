@@ -2279,20 +2279,28 @@ DECLFOLDER(constfold_getattribute)
         // If the object name is not supplied, it implies that we are
         // supposed to search the shaded object first, then if that fails,
         // the scene-wide namespace.  We can't do that yet, have to wait
-        // until shade time.
+        // until shade time -- unless the group is a variant specialized
+        // for the object.
         ustring obj_name;
         if (object_lookup)
             obj_name = *(const ustring *)ObjectName.data();
-        if (! obj_name)
-            return 0;
-
-        found = array_lookup
-            ? rop.renderer()->get_array_attribute (NULL, false,
-                                                   obj_name, attr_type, attr_name,
-                                                   *(const int *)Index.data(), buf)
-            : rop.renderer()->get_attribute (NULL, false,
-                                             obj_name, attr_type, attr_name,
-                                             buf);
+        if (obj_name) {
+            found = array_lookup
+                ? rop.renderer()->get_array_attribute (NULL, false,
+                                                       obj_name, attr_type, attr_name,
+                                                       *(const int *)Index.data(), buf)
+                : rop.renderer()->get_attribute (NULL, false,
+                                                 obj_name, attr_type, attr_name,
+                                                 buf);
+        } else {
+            const ShaderGroup &group (rop.group());
+            if (! group.object_variant())
+                return 0;
+            // Only the attributes the variant was made for may be
+            // folded; anything else could vary from point to point.
+            int index = array_lookup ? *(const int *)Index.data() : -1;
+            found = group.object_attribute (attr_name, attr_type, index, buf);
+        }
     }
 
     if (found) {
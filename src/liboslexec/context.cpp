@@ -29,6 +29,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <string>
 #include <cstdio>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
 
 #include <OpenImageIO/dassert.h>
 #include <OpenImageIO/sysutil.h>
@@ -39,15 +42,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 OSL_NAMESPACE_ENTER
 
-static mutex buffered_errors_mutex;
-
-
-
 ShadingContext::ShadingContext (ShadingSystemImpl &shadingsys,
                                 PerThreadInfo *threadinfo)
     : m_shadingsys(shadingsys), m_renderer(m_shadingsys.renderer()),
-      m_group(NULL), m_max_warnings(shadingsys.max_warnings_per_thread()), m_dictionary(NULL), m_next_failed_attrib(0)
+      m_group(NULL), m_max_warnings(shadingsys.max_warnings_per_thread()), m_profile_layers(false), m_layer_mark(0), m_dictionary(NULL), m_next_failed_attrib(0), m_next_error_site(0)
 {
+    for (auto&& e : m_error_sites)
+        e.site = NULL;
     m_shadingsys.m_stat_contexts += 1;
     m_threadinfo = threadinfo ? threadinfo : shadingsys.get_perthread_info ();
     m_texture_thread_info = NULL;
@@ -65,23 +66,42 @@ ShadingContext::~ShadingContext ()
 
 
 bool
-ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
+ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg,
+                              bool run, bool *not_ready)
 {
+    if (not_ready)
+        *not_ready = false;
     if (m_group)
         execute_cleanup ();
     m_group = &sgroup;
     m_ticks = 0;
+    m_init_ticks = 0;
+    m_profile_layers = false;
 
     // Optimize if we haven't already
     if (sgroup.nlayers()) {
         sgroup.start_running ();
-        if (! sgroup.optimized()) {
+        if (shadingsys().m_async_jit) {
+            // Never stall this thread: if the group isn't ready, hand it
+            // to the background JIT threads and report that it didn't run.
+            // (With greedyjit, all groups were queued when they were
+            // ended, or when the option was set.)
+            if (! shadingsys().group_ready (sgroup)) {
+                shadingsys().async_optimize_group (sgroup);
+                shadingsys().m_stat_async_jit_not_ready += 1;
+                if (not_ready)
+                    *not_ready = true;
+                return false;
+            }
+        } else if (! sgroup.optimized()) {
             shadingsys().optimize_group (sgroup);
             if (shadingsys().m_greedyjit && shadingsys().m_groups_to_compile_count) {
                 // If we are greedily JITing, optimize/JIT everything now
                 shadingsys().optimize_all_groups ();
             }
         }
+        if (sgroup.llvm_promotable())
+            shadingsys().maybe_promote_group (sgroup);
         if (sgroup.does_nothing())
             return false;
     } else {
@@ -89,6 +109,16 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
        return false;
     }
 
+    // Charge time to the individual layers (see profile_layer_enter)
+    m_profile_layers = (shadingsys().m_profile >= 2);
+    if (m_profile_layers) {
+        m_exec_profile.clear (sgroup.nlayers());
+        m_layer_stack.clear ();
+        m_layer_timer.reset ();
+        m_layer_timer.start ();
+        m_layer_mark = 0;
+    }
+
     int profile = shadingsys().m_profile;
     OIIO::Timer timer (profile ? OIIO::Timer::StartNow : OIIO::Timer::DontStartNow);
 
@@ -120,10 +150,8 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
         ssg.context = this;
         ssg.renderer = renderer();
         ssg.Ci = NULL;
-        RunLLVMGroupFunc run_func = sgroup.llvm_compiled_init();
-        DASSERT (run_func);
         DASSERT (sgroup.llvm_groupdata_size() <= m_heap.size());
-        run_func (&ssg, &m_heap[0]);
+        init_groupdata (sgroup, ssg, &m_heap[0]);
     }
 
     if (profile)
@@ -133,6 +161,32 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
 
 
 
+void
+ShadingContext::init_groupdata (ShaderGroup &sgroup, ShaderGlobals &ssg,
+                                char *groupdata)
+{
+    int profile = shadingsys().m_profile;
+    OIIO::Timer timer (profile ? OIIO::Timer::StartNow : OIIO::Timer::DontStartNow);
+
+    const GroupdataSpans &reset (sgroup.llvm_groupdata_reset());
+    if (reset.size()) {
+        // All the init function would do is zero these; if the whole heap
+        // was just cleared, there's nothing left to do.
+        if (! shadingsys().m_clearmemory)
+            for (auto&& span : reset)
+                memset (groupdata + span.first, 0, span.second);
+    } else {
+        RunLLVMGroupFunc run_func = sgroup.llvm_compiled_init();
+        DASSERT (run_func);
+        run_func (&ssg, groupdata);
+    }
+
+    if (profile)
+        m_init_ticks += timer.ticks();
+}
+
+
+
 bool
 ShadingContext::execute_layer (ShaderGlobals &ssg, int layernumber)
 {
@@ -170,7 +224,14 @@ ShadingContext::execute_cleanup ()
     if (shadingsys().m_profile) {
         record_runtime_stats ();   // Transfer runtime stats to the shadingsys
         shadingsys().m_stat_total_shading_time_ticks += m_ticks;
+        shadingsys().m_stat_groupdata_init_ticks += m_init_ticks;
         group()->m_stat_total_shading_time_ticks += m_ticks;
+        if (m_profile_layers) {
+            spin_lock lock (group()->m_exec_profile_mutex);
+            group()->m_exec_profile.merge (m_exec_profile);
+        }
+        if (group()->llvm_promotable())
+            shadingsys().maybe_promote_group (*group());
     }
 
     return true;
@@ -179,7 +240,8 @@ ShadingContext::execute_cleanup ()
 
 
 bool
-ShadingContext::execute (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
+ShadingContext::execute (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run,
+                         bool *not_ready)
 {
     int n = sgroup.m_exec_repeat;
     Vec3 Psave, Nsave;   // for repeats
@@ -195,7 +257,7 @@ ShadingContext::execute (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
 
     bool result = true;
     while (1) {
-        if (! execute_init (sgroup, ssg, run))
+        if (! execute_init (sgroup, ssg, run, not_ready))
             return false;
         if (run && n)
             execute_layer (ssg, group()->nlayers()-1);
@@ -215,10 +277,70 @@ ShadingContext::execute (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
 
 
 
+void
+ShadingContext::profile_layer_enter (int layer)
+{
+    // The layer that ran this one stops accumulating time until we exit.
+    long long now = m_layer_timer.ticks();
+    if (m_layer_stack.size())
+        m_exec_profile.layers[m_layer_stack.back()].ticks += now - m_layer_mark;
+    if (layer >= (int)m_exec_profile.layers.size())
+        m_exec_profile.layers.resize (layer+1);
+    m_exec_profile.layers[layer].calls += 1;
+    m_layer_stack.push_back (layer);
+    m_layer_mark = now;
+}
+
+
+
+void
+ShadingContext::profile_layer_exit ()
+{
+    DASSERT (m_layer_stack.size());
+    long long now = m_layer_timer.ticks();
+    m_exec_profile.layers[m_layer_stack.back()].ticks += now - m_layer_mark;
+    m_layer_stack.pop_back ();
+    m_layer_mark = now;
+}
+
+
+
 void
 ShadingContext::record_error (ErrorHandler::ErrCode code,
-                              const std::string &text) const
+                              const std::string &text, const void *site) const
 {
+    int limit = shadingsys().m_suppress_repeat_errors;
+    if (limit > 0 && site &&
+        (code == ErrorHandler::EH_WARNING || code == ErrorHandler::EH_ERROR ||
+         code == ErrorHandler::EH_SEVERE)) {
+        // A shader that errs once per shade tends to do so from the same
+        // place every time, usually with different values (P, u, v...)
+        // in the text.  Pass on only the first few from each site in any
+        // one second.
+        long long second = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        ErrorSite *e = NULL;
+        for (auto&& s : m_error_sites) {
+            if (s.site == site) {
+                e = &s;
+                break;
+            }
+        }
+        if (! e) {
+            e = &m_error_sites[m_next_error_site];
+            m_next_error_site = (m_next_error_site + 1) % ERROR_SITES;
+            e->site = site;
+            e->second = second;
+            e->count = 0;
+        } else if (e->second != second) {
+            e->second = second;
+            e->count = 0;
+        }
+        if (++e->count > limit) {
+            shadingsys().m_stat_errors_suppressed += 1;
+            return;
+        }
+    }
     m_buffered_errors.emplace_back(code,text);
     // If we aren't buffering, just process immediately
     if (! shadingsys().m_buffer_printf)
@@ -230,35 +352,12 @@ ShadingContext::record_error (ErrorHandler::ErrCode code,
 void
 ShadingContext::process_errors () const
 {
-    size_t nerrors = m_buffered_errors.size();
-    if (! nerrors)
+    if (m_buffered_errors.empty())
         return;
 
-    // Use a mutex to make sure output from different threads stays
-    // together, at least for one shader invocation, rather than being
-    // interleaved with other threads.
-    lock_guard lock (buffered_errors_mutex);
-
-    for (size_t i = 0;  i < nerrors;  ++i) {
-        switch (m_buffered_errors[i].first) {
-        case ErrorHandler::EH_MESSAGE :
-        case ErrorHandler::EH_DEBUG :
-           shadingsys().message (m_buffered_errors[i].second);
-            break;
-        case ErrorHandler::EH_INFO :
-            shadingsys().info (m_buffered_errors[i].second);
-            break;
-        case ErrorHandler::EH_WARNING :
-            shadingsys().warning (m_buffered_errors[i].second);
-            break;
-        case ErrorHandler::EH_ERROR :
-        case ErrorHandler::EH_SEVERE :
-            shadingsys().error (m_buffered_errors[i].second);
-            break;
-        default:
-            break;
-        }
-    }
+    // Output from one shader invocation is passed on as a unit, so it
+    // stays together rather than being interleaved with other threads.
+    shadingsys().queue_errors (m_buffered_errors);
     m_buffered_errors.clear();
 }
 
@@ -322,6 +421,7 @@ ShadingContext::osl_get_attribute (ShaderGlobals *sg, void *objdata,
     // Change the #if's below if you want to
     OIIO::Timer timer;
 #endif
+    ExecProfileTimer prof (this, ExecProfile::Getattribute);
     bool ok;
 
     for (auto& f : m_failed_attribs) {
@@ -379,4 +479,164 @@ osl_incr_layers_executed (ShaderGlobals *sg)
 }
 
 
+
+OSL_SHADEOP void
+osl_profile_layer_enter (ShaderGlobals *sg, int layer)
+{
+    ShadingContext *ctx = (ShadingContext *)sg->context;
+    ctx->profile_layer_enter (layer);
+}
+
+
+
+OSL_SHADEOP void
+osl_profile_layer_exit (ShaderGlobals *sg)
+{
+    ShadingContext *ctx = (ShadingContext *)sg->context;
+    ctx->profile_layer_exit ();
+}
+
+
+
+namespace pvt {
+
+const char *
+ExecProfile::callback_name (int callback)
+{
+    static const char *names[NumCallbacks] = {
+        "texture", "getattribute", "trace", "pointcloud"
+    };
+    return callback >= 0 && callback < NumCallbacks ? names[callback] : "";
+}
+
+
+
+void
+ExecProfile::clear (int nlayers)
+{
+    layers.assign (nlayers, Entry());
+    layernames.clear ();
+    for (int c = 0;  c < NumCallbacks;  ++c)
+        callbacks[c] = Entry();
+}
+
+
+
+void
+ExecProfile::merge (const ExecProfile &p)
+{
+    if (p.layers.size() > layers.size())
+        layers.resize (p.layers.size());
+    for (size_t i = 0;  i < p.layers.size();  ++i) {
+        layers[i].ticks += p.layers[i].ticks;
+        layers[i].calls += p.layers[i].calls;
+    }
+    if (p.layernames.size() > layernames.size())
+        layernames = p.layernames;
+    if (! p.groupname.empty())
+        groupname = p.groupname;
+    for (int c = 0;  c < NumCallbacks;  ++c) {
+        callbacks[c].ticks += p.callbacks[c].ticks;
+        callbacks[c].calls += p.callbacks[c].calls;
+    }
+}
+
+
+
+long long
+ExecProfile::total_ticks () const
+{
+    long long total = 0;
+    for (auto&& e : layers)
+        total += e.ticks;
+    return total;
+}
+
+
+
+static std::string
+exec_profile_layername (const ExecProfile &p, int layer)
+{
+    if (layer < (int)p.layernames.size() && p.layernames[layer].size())
+        return p.layernames[layer].string();
+    return Strutil::format ("<layer %d>", layer);
+}
+
+
+
+void
+ExecProfile::print (std::ostream &out, int level) const
+{
+    long long total = total_ticks();
+    if (! total)
+        return;
+    out << Strutil::format ("      %s: %s\n",
+                            groupname.size() ? groupname.c_str() : "<unnamed group>",
+                            Strutil::timeintervalformat (OIIO::Timer::seconds(total), 2));
+
+    // Layers, most expensive first
+    std::vector<std::pair<long long,int> > sorted;
+    for (size_t i = 0;  i < layers.size();  ++i)
+        if (layers[i].calls)
+            sorted.emplace_back (layers[i].ticks, (int)i);
+    std::sort (sorted.begin(), sorted.end(),
+               [](const std::pair<long long,int> &a,
+                  const std::pair<long long,int> &b) {
+                   return a.first > b.first;
+               });
+    if (level < 3 && sorted.size() > 10)
+        sorted.resize (10);
+    for (auto&& l : sorted) {
+        const Entry &e (layers[l.second]);
+        out << Strutil::format ("        %-26s %10s %5.1f%%  %10lld runs\n",
+                                exec_profile_layername (*this, l.second),
+                                Strutil::timeintervalformat (OIIO::Timer::seconds(e.ticks), 2),
+                                (100.0 * e.ticks) / total, e.calls);
+    }
+
+    // Renderer callbacks (their time is part of the layers' time, too)
+    for (int c = 0;  c < NumCallbacks;  ++c) {
+        const Entry &e (callbacks[c]);
+        if (! e.calls)
+            continue;
+        out << Strutil::format ("        %-26s %10s %5.1f%%  %10lld calls\n",
+                                Strutil::format ("(%s)", callback_name(c)),
+                                Strutil::timeintervalformat (OIIO::Timer::seconds(e.ticks), 2),
+                                (100.0 * e.ticks) / total, e.calls);
+    }
+}
+
+
+
+std::string
+ExecProfile::json () const
+{
+    std::ostringstream out;
+    out << "{\"name\": \"" << Strutil::escape_chars (groupname.string())
+        << "\", \"layers\": [";
+    bool first = true;
+    for (size_t i = 0;  i < layers.size();  ++i) {
+        const Entry &e (layers[i]);
+        out << Strutil::format ("%s{\"name\": \"%s\", \"time\": %.6f, \"calls\": %lld}",
+                                first ? "" : ", ",
+                                Strutil::escape_chars (exec_profile_layername (*this, (int)i)),
+                                OIIO::Timer::seconds(e.ticks), e.calls);
+        first = false;
+    }
+    out << "], \"callbacks\": {";
+    first = true;
+    for (int c = 0;  c < NumCallbacks;  ++c) {
+        const Entry &e (callbacks[c]);
+        out << Strutil::format ("%s\"%s\": {\"time\": %.6f, \"calls\": %lld}",
+                                first ? "" : ", ", callback_name(c),
+                                OIIO::Timer::seconds(e.ticks), e.calls);
+        first = false;
+    }
+    out << "}}";
+    return out.str();
+}
+
+}; // namespace pvt
+
+
 OSL_NAMESPACE_EXIT
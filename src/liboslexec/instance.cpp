@@ -59,13 +59,13 @@ ShaderInstance::ShaderInstance (ShaderMaster::ref master,
       m_writes_globals(false),
       m_outgoing_connections(false),
       m_renderer_outputs(false), m_merged_unused(false),
-      m_last_layer(false), m_entry_layer(false),
+      m_last_layer(false), m_entry_layer(false), m_needs_master_code(true),
       m_firstparam(m_master->m_firstparam), m_lastparam(m_master->m_lastparam),
       m_maincodebegin(m_master->m_maincodebegin),
       m_maincodeend(m_master->m_maincodeend)
 {
     m_id = ++(*(atomic_int *)&next_id);
-    shadingsys().m_stat_instances += 1;
+    m_master->retain_code ();
 
     // We don't copy the symbol table yet, it stays with the master, but
     // we'll keep track of local override information in m_instoverrides.
@@ -81,6 +81,7 @@ ShaderInstance::ShaderInstance (ShaderMaster::ref master,
     off_t totalmem = (parammem + sizeof(ShaderInstance));
     {
         spin_lock lock (ss.m_stat_mutex);
+        ss.m_stat_instances += 1;
         ss.m_stat_mem_inst_paramvals += parammem;
         ss.m_stat_mem_inst += totalmem;
         ss.m_stat_memory += totalmem;
@@ -91,7 +92,8 @@ ShaderInstance::ShaderInstance (ShaderMaster::ref master,
 
 ShaderInstance::~ShaderInstance ()
 {
-    shadingsys().m_stat_instances -= 1;
+    if (m_needs_master_code)
+        m_master->release_code ();
 
     ASSERT (m_instops.size() == 0 && m_instargs.size() == 0);
     ShadingSystemImpl &ss (shadingsys());
@@ -103,6 +105,9 @@ ShaderInstance::~ShaderInstance ()
                        sizeof(ShaderInstance));
     {
         spin_lock lock (ss.m_stat_mutex);
+        ss.m_stat_instances -= 1;
+        if (m_shared_params)
+            ss.m_stat_mem_inst_paramvals_saved -= m_shared_params->fullmemsize();
         ss.m_stat_mem_inst_syms -= symmem;
         ss.m_stat_mem_inst_paramvals -= parammem;
         ss.m_stat_mem_inst_connections -= connectionmem;
@@ -149,8 +154,35 @@ ShaderInstance::findparam (ustring name) const
 
 void *
 ShaderInstance::param_storage (int index)
+{
+    unshare_params ();
+    return const_cast<void *>(const_cast<const ShaderInstance*>(this)->param_storage(index));
+}
+
+
+
+const void *
+ShaderInstance::param_storage (int index) const
 {
     const Symbol *sym = m_instsymbols.size() ? symbol(index) : mastersymbol(index);
+    TypeDesc t = sym->typespec().simpletype();
+
+    // If the values are shared, only the ones that differ from the
+    // master's defaults are stored.
+    if (m_shared_params) {
+        const InstanceParams::Override *o = m_shared_params->find (index);
+        if (! o)
+            return m_master->param_default_storage (index);
+        if (t.basetype == TypeDesc::INT) {
+            return &m_shared_params->iparams[o->offset];
+        } else if (t.basetype == TypeDesc::FLOAT) {
+            return &m_shared_params->fparams[o->offset];
+        } else if (t.basetype == TypeDesc::STRING) {
+            return &m_shared_params->sparams[o->offset];
+        } else {
+            return NULL;
+        }
+    }
 
     // Get the data offset. If there are instance overrides for symbols,
     // check whether we are overriding the array size, otherwise just read
@@ -165,7 +197,6 @@ ShaderInstance::param_storage (int index)
     else
         offset = sym->dataoffset();
 
-    TypeDesc t = sym->typespec().simpletype();
     if (t.basetype == TypeDesc::INT) {
         return &m_iparams[offset];
     } else if (t.basetype == TypeDesc::FLOAT) {
@@ -179,12 +210,158 @@ ShaderInstance::param_storage (int index)
 
 
 
-const void *
-ShaderInstance::param_storage (int index) const
+void
+ShaderInstance::share_params ()
+{
+    if (m_shared_params)
+        return;
+
+    // Collect the values that differ from the master's defaults.  Values
+    // of indefinite-length arrays are stored past the end of the defaults
+    // (see parameters()), so they always count as overrides.
+    InstanceParams diff;
+    diff.nfull_i = (int) m_iparams.size();
+    diff.nfull_f = (int) m_fparams.size();
+    diff.nfull_s = (int) m_sparams.size();
+    for (int i = firstparam(); i < lastparam(); ++i) {
+        const Symbol *sym = mastersymbol (i);
+        const SymOverrideInfo *so = instoverride (i);
+        TypeDesc t = sym->typespec().simpletype();
+        if (sym->typespec().is_closure_based() || sym->typespec().is_structure() ||
+            (t.arraylen < 0 && ! so->arraylen()))
+            continue;
+        InstanceParams::Override o;
+        o.param = i;
+        o.fulloffset = so->arraylen() ? so->dataoffset() : sym->dataoffset();
+        o.nvalues = (so->arraylen() ? so->arraylen() : (int)t.numelements()) * t.aggregate;
+        const void *defaultdata = m_master->param_default_storage (i);
+        if (t.basetype == TypeDesc::INT) {
+            const int *vals = &m_iparams[o.fulloffset];
+            if (! so->arraylen() && ! memcmp (vals, defaultdata, o.nvalues*sizeof(int)))
+                continue;
+            o.offset = (int) diff.iparams.size();
+            diff.iparams.insert (diff.iparams.end(), vals, vals+o.nvalues);
+        } else if (t.basetype == TypeDesc::FLOAT) {
+            // Floats are compared bitwise, so the stored values are
+            // exactly the ones the instance was given.
+            const float *vals = &m_fparams[o.fulloffset];
+            if (! so->arraylen() && ! memcmp (vals, defaultdata, o.nvalues*sizeof(float)))
+                continue;
+            o.offset = (int) diff.fparams.size();
+            diff.fparams.insert (diff.fparams.end(), vals, vals+o.nvalues);
+        } else if (t.basetype == TypeDesc::STRING) {
+            const ustring *vals = &m_sparams[o.fulloffset];
+            if (! so->arraylen() && ! memcmp (vals, defaultdata, o.nvalues*sizeof(ustring)))
+                continue;
+            o.offset = (int) diff.sparams.size();
+            diff.sparams.insert (diff.sparams.end(), vals, vals+o.nvalues);
+        } else {
+            continue;
+        }
+        diff.overrides.push_back (o);
+    }
+
+    ShadingSystemImpl &ss (shadingsys());
+    off_t parammem = vectorbytes (m_iparams)
+        + vectorbytes (m_fparams) + vectorbytes (m_sparams);
+    m_shared_params = ss.intern_params (diff);
+    std::vector<int>().swap (m_iparams);
+    std::vector<float>().swap (m_fparams);
+    std::vector<ustring>().swap (m_sparams);
+
+    spin_lock lock (ss.m_stat_mutex);
+    ss.m_stat_mem_inst_paramvals -= parammem;
+    ss.m_stat_mem_inst -= parammem;
+    ss.m_stat_memory -= parammem;
+    ss.m_stat_mem_inst_paramvals_saved += m_shared_params->fullmemsize();
+}
+
+
+
+void
+ShaderInstance::unshare_params ()
 {
-    // Rather than repeating code here, just use const_cast and call the
-    // non-const version of this method.
-    return (const_cast<ShaderInstance*>(this))->param_storage(index);
+    if (! m_shared_params)
+        return;
+    ASSERT (m_iparams.empty() && m_fparams.empty() && m_sparams.empty());
+
+    // The symbols of an instance being optimized point right at the
+    // shared values (see copy_code_from_master).
+    std::vector<const void *> olddata;
+    if (m_instsymbols.size())
+        for (int i = firstparam(); i < lastparam(); ++i)
+            olddata.push_back (param_symbol_data (i));
+
+    // Start from the master's defaults, and put the overrides in place.
+    const InstanceParams &shared (*m_shared_params);
+    m_iparams = m_master->m_idefaults;
+    m_fparams = m_master->m_fdefaults;
+    m_sparams = m_master->m_sdefaults;
+    m_iparams.resize (shared.nfull_i);
+    m_fparams.resize (shared.nfull_f);
+    m_sparams.resize (shared.nfull_s);
+    for (auto&& o : shared.overrides) {
+        TypeDesc t = mastersymbol(o.param)->typespec().simpletype();
+        if (t.basetype == TypeDesc::INT)
+            std::copy_n (&shared.iparams[o.offset], o.nvalues, &m_iparams[o.fulloffset]);
+        else if (t.basetype == TypeDesc::FLOAT)
+            std::copy_n (&shared.fparams[o.offset], o.nvalues, &m_fparams[o.fulloffset]);
+        else if (t.basetype == TypeDesc::STRING)
+            std::copy_n (&shared.sparams[o.offset], o.nvalues, &m_sparams[o.fulloffset]);
+    }
+    off_t fullmem = shared.fullmemsize();
+    m_shared_params.reset ();
+    for (size_t i = 0; i < olddata.size(); ++i) {
+        Symbol *s = symbol (firstparam() + int(i));
+        if (s->data() == olddata[i])
+            s->data (param_symbol_data (firstparam() + int(i)));
+    }
+
+    ShadingSystemImpl &ss (shadingsys());
+    off_t parammem = vectorbytes (m_iparams)
+        + vectorbytes (m_fparams) + vectorbytes (m_sparams);
+    spin_lock lock (ss.m_stat_mutex);
+    ss.m_stat_mem_inst_paramvals += parammem;
+    ss.m_stat_mem_inst += parammem;
+    ss.m_stat_memory += parammem;
+    ss.m_stat_mem_inst_paramvals_saved -= fullmem;
+}
+
+
+
+InstanceParams::~InstanceParams ()
+{
+    if (! shadingsys)
+        return;    // never interned, so never counted
+    off_t mem = memsize();
+    spin_lock lock (shadingsys->m_stat_mutex);
+    shadingsys->m_stat_mem_inst_paramvals -= mem;
+    shadingsys->m_stat_mem_inst -= mem;
+    shadingsys->m_stat_memory -= mem;
+    shadingsys->m_stat_mem_inst_paramvals_saved += mem;
+}
+
+
+
+const InstanceParams::Override *
+InstanceParams::find (int param) const
+{
+    auto o = std::lower_bound (overrides.begin(), overrides.end(), param,
+                               [](const Override &o, int p){ return o.param < p; });
+    return (o != overrides.end() && o->param == param) ? &(*o) : NULL;
+}
+
+
+
+bool
+InstanceParams::equal (const InstanceParams &b) const
+{
+    return nfull_i == b.nfull_i && nfull_f == b.nfull_f &&
+           nfull_s == b.nfull_s && overrides == b.overrides &&
+           iparams == b.iparams && sparams == b.sparams &&
+           fparams.size() == b.fparams.size() &&
+           (fparams.empty() ||
+            ! memcmp (fparams.data(), b.fparams.data(), fparams.size()*sizeof(float)));
 }
 
 
@@ -204,6 +381,7 @@ void
 ShaderInstance::parameters (const ParamValueList &params)
 {
     // Seed the params with the master's defaults
+    unshare_params ();
     m_iparams = m_master->m_idefaults;
     m_fparams = m_master->m_fdefaults;
     m_sparams = m_master->m_sdefaults;
@@ -338,6 +516,51 @@ ShaderInstance::parameters (const ParamValueList &params)
         ss.m_stat_mem_inst += (symmem+parammem);
         ss.m_stat_memory += (symmem+parammem);
     }
+
+    // Most instances override only a few of their master's parameters,
+    // if any, so just those values are kept (and shared with any other
+    // instances that have the same overrides) until something needs to
+    // change them.
+    share_params ();
+}
+
+
+
+ShaderInstanceRef
+ShaderInstance::clone_unoptimized () const
+{
+    // Only the state set up before optimization is copied -- the
+    // instance must not have its own symbols or code yet.
+    ASSERT (m_instsymbols.empty() && m_instops.empty());
+    ShaderInstanceRef inst (new ShaderInstance (m_master, m_layername));
+    inst->m_instoverrides = m_instoverrides;
+    inst->m_iparams = m_iparams;
+    inst->m_fparams = m_fparams;
+    inst->m_sparams = m_sparams;
+    inst->m_shared_params = m_shared_params;
+    inst->m_connections = m_connections;
+    inst->m_writes_globals = m_writes_globals;
+    inst->m_userdata_params = m_userdata_params;
+    inst->m_renderer_outputs = m_renderer_outputs;
+    inst->m_merged_unused = m_merged_unused;
+    inst->m_last_layer = m_last_layer;
+    inst->m_entry_layer = m_entry_layer;
+
+    // Adjust the stats
+    ShadingSystemImpl &ss (shadingsys());
+    size_t symmem = vectorbytes(m_instoverrides);
+    size_t parammem = (vectorbytes(m_iparams) + vectorbytes(m_fparams) +
+                       vectorbytes(m_sparams));
+    size_t connectionmem = vectorbytes(m_connections);
+    spin_lock lock (ss.m_stat_mutex);
+    if (m_shared_params)
+        ss.m_stat_mem_inst_paramvals_saved += m_shared_params->fullmemsize();
+    ss.m_stat_mem_inst_syms += symmem;
+    ss.m_stat_mem_inst_paramvals += parammem;
+    ss.m_stat_mem_inst_connections += connectionmem;
+    ss.m_stat_mem_inst += (symmem+parammem+connectionmem);
+    ss.m_stat_memory += (symmem+parammem+connectionmem);
+    return inst;
 }
 
 
@@ -371,6 +594,7 @@ ShaderInstance::add_connection (int srclayer, const ConnectedParam &srccon,
 {
     // specialize symbol in case of dstcon is an unsized array
     if (dstcon.type.is_unsized_array()) {
+        unshare_params ();
         SymOverrideInfo *so = &m_instoverrides[dstcon.param];
         so->arraylen(srccon.type.arraylength());
 
@@ -442,15 +666,29 @@ ShaderInstance::evaluate_writes_globals_and_userdata_params ()
 
 
 
-void
+bool
 ShaderInstance::copy_code_from_master (ShaderGroup &group)
 {
     ASSERT (m_instops.empty() && m_instargs.empty());
-    // reserve with enough room for a few insertions
-    m_instops.reserve (master()->m_ops.size()+10);
-    m_instargs.reserve (master()->m_args.size()+10);
-    m_instops = master()->m_ops;
-    m_instargs = master()->m_args;
+    bool ok = true;
+    {
+        lock_guard lock (m_master->m_code_mutex);
+        if (m_master->m_code_evicted)
+            ok = m_master->reload_code ();
+        if (ok) {
+            // reserve with enough room for a few insertions
+            m_instops.reserve (master()->m_ops.size()+10);
+            m_instargs.reserve (master()->m_args.size()+10);
+            m_instops = master()->m_ops;
+            m_instargs = master()->m_args;
+        }
+    }
+    if (m_needs_master_code) {
+        m_needs_master_code = false;
+        m_master->release_code ();
+    }
+    if (! ok)
+        return false;   // reload_code already said why
 
     // Copy the symbols from the master
     ASSERT (m_instsymbols.size() == 0 &&
@@ -476,7 +714,9 @@ ShaderInstance::copy_code_from_master (ShaderGroup &group)
                 si->connected_down (m_instoverrides[i].connected_down());
                 si->lockgeom (m_instoverrides[i].lockgeom());
                 si->dataoffset (m_instoverrides[i].dataoffset());
-                si->data (param_storage(i));
+                // Shared values stay shared unless the optimizer
+                // changes one (see RuntimeOptimizer::replace_param_value).
+                si->data (param_symbol_data(i));
             }
             if (shadingsys().is_renderer_output (layername(), si->name(), &group)) {
                 si->renderer_output (true);
@@ -495,6 +735,7 @@ ShaderInstance::copy_code_from_master (ShaderGroup &group)
         shadingsys().m_stat_mem_inst += symmem;
         shadingsys().m_stat_memory += symmem;
     }
+    return true;
 }
 
 
@@ -671,6 +912,140 @@ ShaderInstance::mergeable (const ShaderInstance &b, const ShaderGroup &g) const
 }
 
 
+
+// FNV-1a, folding more data into the hash value h.
+inline size_t
+hash_bytes (size_t h, const void *data, size_t size)
+{
+    const unsigned char *c = (const unsigned char *)data;
+    for (size_t i = 0;  i < size;  ++i)
+        h = (h ^ c[i]) * size_t(1099511628211ULL);
+    return h;
+}
+
+template<typename T>
+inline size_t
+hash_value (size_t h, const T &val)
+{
+    return hash_bytes (h, &val, sizeof(val));
+}
+
+
+
+size_t
+InstanceParams::hash () const
+{
+    size_t h = size_t(14695981039346656037ULL);
+    h = hash_value (h, nfull_i);
+    h = hash_value (h, nfull_f);
+    h = hash_value (h, nfull_s);
+    h = hash_value (h, overrides.size());
+    h = hash_bytes (h, overrides.data(), overrides.size()*sizeof(Override));
+    h = hash_bytes (h, iparams.data(), iparams.size()*sizeof(int));
+    h = hash_bytes (h, fparams.data(), fparams.size()*sizeof(float));
+    // ustrings are unique, so their pointers may stand in for the chars
+    h = hash_bytes (h, sparams.data(), sparams.size()*sizeof(ustring));
+    return h;
+}
+
+
+
+InstanceParamsRef
+ShadingSystemImpl::intern_params (InstanceParams &params)
+{
+    size_t h = params.hash ();
+    spin_lock lock (m_interned_params_mutex);
+    auto range = m_interned_params.equal_range (h);
+    for (auto i = range.first;  i != range.second;  ) {
+        InstanceParamsRef p = i->second.lock();
+        if (! p) {
+            // Nobody uses those overrides any more
+            i = m_interned_params.erase (i);
+            continue;
+        }
+        if (p->equal (params))
+            return p;
+        ++i;
+    }
+    if (m_interned_params.size() >= m_interned_params_sweep) {
+        // Now and then, forget overrides that no instance uses any more.
+        for (auto i = m_interned_params.begin();  i != m_interned_params.end();  ) {
+            if (i->second.expired())
+                i = m_interned_params.erase (i);
+            else
+                ++i;
+        }
+        m_interned_params_sweep = std::max (size_t(1024),
+                                            2*m_interned_params.size());
+    }
+    std::shared_ptr<InstanceParams> p (new InstanceParams);
+    p->overrides.swap (params.overrides);
+    p->iparams.swap (params.iparams);
+    p->fparams.swap (params.fparams);
+    p->sparams.swap (params.sparams);
+    p->nfull_i = params.nfull_i;
+    p->nfull_f = params.nfull_f;
+    p->nfull_s = params.nfull_s;
+    p->hashval = h;
+    p->shadingsys = this;
+    off_t mem = p->memsize();
+    {
+        spin_lock stat_lock (m_stat_mutex);
+        m_stat_mem_inst_paramvals += mem;
+        m_stat_mem_inst += mem;
+        m_stat_memory += mem;
+        m_stat_mem_inst_paramvals_saved -= mem;
+    }
+    m_interned_params.emplace (h, p);
+    return p;
+}
+
+
+
+size_t
+ShaderInstance::merge_signature () const
+{
+    // Only hash what mergeable() requires to match exactly, in the same
+    // way it compares it, so that mergeable instances are sure to have
+    // the same signature.
+    size_t h = size_t(14695981039346656037ULL);
+    h = hash_value (h, master());
+    h = hash_value (h, run_lazily());
+    for (auto&& c : m_connections) {
+        h = hash_value (h, c.srclayer);
+        h = hash_value (h, c.src.param);
+        h = hash_value (h, c.dst.param);
+        h = hash_value (h, int(c.src.arrayindex));
+        h = hash_value (h, int(c.dst.arrayindex));
+        h = hash_value (h, int(c.src.channel));
+        h = hash_value (h, int(c.dst.channel));
+    }
+
+    bool optimized = (m_instsymbols.size() != 0 || m_instops.size() != 0);
+    if (! optimized) {
+        // Before optimization, the params that matter are judged by the
+        // master's symbols, which are the same for any two candidates.
+        for (int i = firstparam();  i < lastparam();  ++i) {
+            const Symbol *sym = mastersymbol(i);
+            if (! sym->everused_in_group() || sym->typespec().is_closure())
+                continue;
+            if (sym->valuesource() == Symbol::InstanceVal ||
+                sym->valuesource() == Symbol::DefaultVal)
+                h = hash_bytes (h, param_storage(i),
+                                sym->typespec().simpletype().size());
+        }
+    } else {
+        // After optimization, the code itself must match.
+        h = hash_value (h, m_instsymbols.size());
+        for (auto&& op : m_instops)
+            h = hash_value (h, op.opname());
+        if (m_instargs.size())
+            h = hash_bytes (h, &m_instargs[0], m_instargs.size()*sizeof(int));
+    }
+    return h;
+}
+
+
 }; // namespace pvt
 
 
@@ -679,10 +1054,16 @@ ShaderGroup::ShaderGroup (string_view name)
   : m_optimized(0), m_does_nothing(false),
     m_llvm_groupdata_size(0), m_num_entry_layers(0),
     m_llvm_compiled_version(NULL),
-    m_name(name), m_exec_repeat(1), m_raytype_queries(-1), m_raytypes_on(0), m_raytypes_off(0)
+    m_respecialize_pending(false),
+    m_name(name), m_exec_repeat(1), m_raytype_queries(-1), m_raytypes_on(0), m_raytypes_off(0),
+    m_group_use(pvt::ShadUseUnknown)
 {
     m_executions = 0;
     m_stat_total_shading_time_ticks = 0;
+    m_ended = false;
+    m_async_jit_queued = false;
+    m_llvm_promotable = false;
+    m_llvm_promotion_queued = false;
     m_id = ++(*(atomic_int *)&next_id);
 }
 
@@ -693,10 +1074,16 @@ ShaderGroup::ShaderGroup (const ShaderGroup &g, string_view name)
     m_llvm_groupdata_size(0), m_num_entry_layers(g.m_num_entry_layers),
     m_llvm_compiled_version(NULL),
     m_layers(g.m_layers),
-    m_name(name), m_exec_repeat(1), m_raytype_queries(-1), m_raytypes_on(0), m_raytypes_off(0)
+    m_respecialize_pending(false),
+    m_name(name), m_exec_repeat(1), m_raytype_queries(-1), m_raytypes_on(0), m_raytypes_off(0),
+    m_group_use(pvt::ShadUseUnknown)
 {
     m_executions = 0;
     m_stat_total_shading_time_ticks = 0;
+    m_ended = false;
+    m_async_jit_queued = false;
+    m_llvm_promotable = false;
+    m_llvm_promotion_queued = false;
     m_id = ++(*(atomic_int *)&next_id);
 }
 
@@ -704,6 +1091,16 @@ ShaderGroup::ShaderGroup (const ShaderGroup &g, string_view name)
 
 ShaderGroup::~ShaderGroup ()
 {
+    // Layers that were left ready to be JITed again (at the full tier,
+    // or on their first call) still hold their ops.
+    if (m_optimized) {
+        for (auto &layer : m_layers) {
+            OpcodeVec emptyops;
+            layer->ops().swap (emptyops);
+            std::vector<int> emptyargs;
+            layer->args().swap (emptyargs);
+        }
+    }
 #if 0
     if (m_layers.size()) {
         ustring name = m_layers.back()->layername();
@@ -747,6 +1144,30 @@ ShaderGroup::find_symbol (ustring layername, ustring symbolname) const
 
 
 
+bool
+ShaderGroup::object_attribute (ustring name, TypeDesc type, int index,
+                               void *val) const
+{
+    for (auto&& p : m_object_attributes) {
+        if (p.name() != name)
+            continue;
+        // An attribute may be given as an array type, or as several
+        // values, or both; either way it's a run of elements.
+        TypeDesc elemtype = p.type().elementtype();
+        int nelements = std::max (1, p.type().arraylen) * p.nvalues();
+        if (! equivalent (elemtype, type))
+            return false;
+        if (index < 0 ? nelements != 1 : index >= nelements)
+            return false;
+        size_t size = type.size();
+        memcpy (val, (const char *)p.data() + std::max(index,0)*size, size);
+        return true;
+    }
+    return false;
+}
+
+
+
 void
 ShaderGroup::clear_entry_layers ()
 {
@@ -787,27 +1208,26 @@ ShaderGroup::serialize () const
                                                    : inst->instoverride(p)->valuesource();
             if (vs == Symbol::InstanceVal) {
                 TypeDesc type = s->typespec().simpletype();
-                int offset = s->dataoffset();
                 if (type.is_unsized_array() && ! dstsyms_exist) {
                     // If we're being asked to serialize a group that isn't
                     // yet optimized, any "unsized" arrays will have their
-                    // concrete length and offset in the SymOverrideInfo,
-                    // not in the Symbol belonging to the instance.
+                    // concrete length in the SymOverrideInfo, not in the
+                    // Symbol belonging to the instance.
                     type.arraylen = inst->instoverride(p)->arraylen();
-                    offset = inst->instoverride(p)->dataoffset();
                 }
                 out << "param " << type << ' ' << s->name();
                 int nvals = type.numelements() * type.aggregate;
+                const void *data = inst->param_storage (p);
                 if (type.basetype == TypeDesc::INT) {
-                    const int *vals = &inst->m_iparams[offset];
+                    const int *vals = (const int *) data;
                     for (int i = 0; i < nvals; ++i)
                         out << ' ' << vals[i];
                 } else if (type.basetype == TypeDesc::FLOAT) {
-                    const float *vals = &inst->m_fparams[offset];
+                    const float *vals = (const float *) data;
                     for (int i = 0; i < nvals; ++i)
                         out << ' ' << vals[i];
                 } else if (type.basetype == TypeDesc::STRING) {
-                    const ustring *vals = &inst->m_sparams[offset];
+                    const ustring *vals = (const ustring *) data;
                     for (int i = 0; i < nvals; ++i)
                         out << ' ' << '\"' << Strutil::escape_chars(vals[i]) << '\"';
                 } else {
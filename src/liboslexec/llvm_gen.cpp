@@ -157,10 +157,25 @@ BackendLLVM::llvm_call_layer (int layer, bool unconditional)
         // insert point is now then_block
     }
 
-    std::string name = Strutil::format ("%s_%d", parent->layername().c_str(),
-                                        parent->id());
+    llvm::Value *funccall;
+    if (m_chunk_layers.empty() || m_chunk_layers[layer]) {
+        std::string name = Strutil::format ("%s_%d", parent->layername().c_str(),
+                                            parent->id());
+        funccall = ll.call_function (name.c_str(), args, 2);
+    } else {
+        // The layer is compiled in a different module (see run_split),
+        // so call it through the group's table of layer functions.  The
+        // entry may be swapped for the layer's real code while we run
+        // (see compile_lazy_layer), so load it with acquire ordering.
+        std::vector<llvm::Type*> params;
+        params.push_back (llvm_type_sg_ptr());
+        params.push_back (llvm_type_groupdata_ptr());
+        llvm::Type *functype = ll.type_function_ptr (ll.type_void(), params);
+        llvm::Value *slot = ll.constant_ptr (&group().m_llvm_layer_table[layer],
+                                             (llvm::PointerType *) ll.type_ptr (functype));
+        funccall = ll.call_function (ll.op_load_acquire (slot), args, 2);
+    }
     // Mark the call as a fast call
-    llvm::Value *funccall = ll.call_function (name.c_str(), args, 2);
     if (!parent->entry_layer())
         ll.mark_fast_func_call (funccall);
 
@@ -2298,7 +2313,7 @@ LLVMGEN (llvm_gen_texture)
             texture_handle = NULL;
     }
     args.push_back (rop.llvm_load_value (Filename));
-    args.push_back (rop.ll.constant_ptr (texture_handle));
+    args.push_back (rop.llvm_texture_handle_constant (texture_handle, Filename));
     args.push_back (opt);
     args.push_back (rop.llvm_load_value (S));
     args.push_back (rop.llvm_load_value (T));
@@ -2364,7 +2379,7 @@ LLVMGEN (llvm_gen_texture3d)
             texture_handle = NULL;
     }
     args.push_back (rop.llvm_load_value (Filename));
-    args.push_back (rop.ll.constant_ptr (texture_handle));
+    args.push_back (rop.llvm_texture_handle_constant (texture_handle, Filename));
     args.push_back (opt);
     args.push_back (rop.llvm_void_ptr (P));
     if (user_derivs) {
@@ -2438,7 +2453,7 @@ LLVMGEN (llvm_gen_environment)
             texture_handle = NULL;
     }
     args.push_back (rop.llvm_load_value (Filename));
-    args.push_back (rop.ll.constant_ptr (texture_handle));
+    args.push_back (rop.llvm_texture_handle_constant (texture_handle, Filename));
     args.push_back (opt);
     args.push_back (rop.llvm_void_ptr (R));
     if (user_derivs) {
@@ -2840,8 +2855,6 @@ LLVMGEN (llvm_gen_getattribute)
     // We'll pass the destination's attribute type directly to the 
     // RenderServices callback so that the renderer can perform any
     // necessary conversions from its internal format to OSL's.
-    const TypeDesc* dest_type = &Destination.typespec().simpletype();
-
     std::vector<llvm::Value *> args;
     args.push_back (rop.sg_void_ptr());
     args.push_back (rop.ll.constant ((int)Destination.has_derivs()));
@@ -2850,7 +2863,7 @@ LLVMGEN (llvm_gen_getattribute)
     args.push_back (rop.llvm_load_value (Attribute));
     args.push_back (rop.ll.constant ((int)array_lookup));
     args.push_back (rop.llvm_load_value (Index));
-    args.push_back (rop.ll.constant_ptr ((void *) dest_type));
+    args.push_back (rop.llvm_symbol_address_constant (Destination, true));
     args.push_back (rop.llvm_void_ptr (Destination));
 
     llvm::Value *r = rop.ll.call_function ("osl_get_attribute", &args[0], args.size());
@@ -2888,7 +2901,7 @@ LLVMGEN (llvm_gen_gettextureinfo)
             texture_handle = NULL;
     }
     args.push_back (rop.llvm_load_value (Filename));
-    args.push_back (rop.ll.constant_ptr (texture_handle));
+    args.push_back (rop.llvm_texture_handle_constant (texture_handle, Filename));
     args.push_back (rop.llvm_load_value (Dataname));
     // this is passes a TypeDesc to an LLVM op-code
     args.push_back (rop.ll.constant((int) Data.typespec().simpletype().basetype));
@@ -3192,7 +3205,7 @@ LLVMGEN (llvm_gen_closure)
 
     // Call osl_allocate_closure_component(closure, id, size).  It returns
     // the memory for the closure parameter data.
-    llvm::Value *render_ptr = rop.ll.constant_ptr(rop.shadingsys().renderer(), rop.ll.type_void_ptr());
+    llvm::Value *render_ptr = rop.ll.constant_ptr(rop.shadingsys().renderer(), "oslreloc_renderer", rop.ll.type_void_ptr());
     llvm::Value *sg_ptr = rop.sg_void_ptr();
     llvm::Value *id_int = rop.ll.constant(clentry->id);
     llvm::Value *size_int = rop.ll.constant(clentry->struct_size);
@@ -3226,7 +3239,9 @@ LLVMGEN (llvm_gen_closure)
     // zero out the closure parameter memory.
     if (clentry->prepare) {
         // Call clentry->prepare(renderservices *, int id, void *mem)
-        llvm::Value *funct_ptr = rop.ll.constant_ptr((void *)clentry->prepare, rop.llvm_type_prepare_closure_func());
+        llvm::Value *funct_ptr = rop.ll.constant_ptr((void *)clentry->prepare,
+                                      Strutil::format ("oslreloc_prepare_%d", clentry->id),
+                                      rop.llvm_type_prepare_closure_func());
         llvm::Value *args[3] = {render_ptr, id_int, mem_void_ptr};
         rop.ll.call_function (funct_ptr, args, 3);
     } else {
@@ -3258,7 +3273,9 @@ LLVMGEN (llvm_gen_closure)
     // setup(render_services, id, mem_ptr).
     if (clentry->setup) {
         // Call clentry->setup(renderservices *, int id, void *mem)
-        llvm::Value *funct_ptr = rop.ll.constant_ptr((void *)clentry->setup, rop.llvm_type_setup_closure_func());
+        llvm::Value *funct_ptr = rop.ll.constant_ptr((void *)clentry->setup,
+                                      Strutil::format ("oslreloc_setup_%d", clentry->id),
+                                      rop.llvm_type_setup_closure_func());
         llvm::Value *args[3] = {render_ptr, id_int, mem_void_ptr};
         rop.ll.call_function (funct_ptr, args, 3);
     }
@@ -3378,8 +3395,8 @@ LLVMGEN (llvm_gen_pointcloud_search)
     args.clear();
     static ustring errorfmt("Arrays too small for pointcloud lookup at (%s:%d)");
     args.push_back (rop.sg_void_ptr());
-    args.push_back (rop.ll.constant_ptr ((void *)errorfmt.c_str()));
-    args.push_back (rop.ll.constant_ptr ((void *)op.sourcefile().c_str()));
+    args.push_back (rop.ll.constant (errorfmt));
+    args.push_back (rop.ll.constant (op.sourcefile()));
     args.push_back (rop.ll.constant (op.sourceline()));
     rop.ll.call_function ("osl_error", &args[0], args.size());
 
@@ -3437,8 +3454,8 @@ LLVMGEN (llvm_gen_pointcloud_get)
     args.clear();
     static ustring errorfmt("Arrays too small for pointcloud attribute get at (%s:%d)");
     args.push_back (rop.sg_void_ptr());
-    args.push_back (rop.ll.constant_ptr ((void *)errorfmt.c_str()));
-    args.push_back (rop.ll.constant_ptr ((void *)op.sourcefile().c_str()));
+    args.push_back (rop.ll.constant (errorfmt));
+    args.push_back (rop.ll.constant (op.sourcefile()));
     args.push_back (rop.ll.constant (op.sourceline()));
     rop.ll.call_function ("osl_error", &args[0], args.size());
 
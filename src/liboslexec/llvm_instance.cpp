@@ -27,9 +27,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <unordered_map>
+#include <limits>
 
 #include <OpenImageIO/timer.h>
+#include <OpenImageIO/hash.h>
 #include <OpenImageIO/sysutil.h>
 #include <OpenImageIO/filesystem.h>
 #include <OpenImageIO/strutil.h>
@@ -238,6 +243,12 @@ BackendLLVM::llvm_type_groupdata ()
     int offset = 0;
     int order = 0;
 
+    // Once the group is optimized, other threads may be shading with it,
+    // so the layout already recorded in it (the data offsets, userdata
+    // offsets, size and reset spans) must not change.  Recompiling its
+    // layers just builds the same struct type against that layout.
+    bool record = ! group().optimized();
+
     if (llvm_debug() >= 2)
         std::cout << "Group param struct:\n";
 
@@ -251,6 +262,11 @@ BackendLLVM::llvm_type_groupdata ()
     offset += sz * sizeof(bool);
     ++order;
 
+    // Keep track of the bytes the init function resets: the flags, and
+    // the closure params.
+    GroupdataSpans reset;
+    reset.push_back (std::make_pair (0, offset));
+
     // Now add the array that tells which userdata have been initialized,
     // and the space for the userdata values.
     int nuserdata = (int) group().m_userdata_names.size();
@@ -265,6 +281,7 @@ BackendLLVM::llvm_type_groupdata ()
         fields.push_back (ll.type_array (ll.type_bool(), sz));
         offset += nuserdata * sizeof(bool);
         ++order;
+        reset[0].second += sz * sizeof(bool);
         for (int i = 0; i < nuserdata; ++i) {
             TypeDesc type = types[i];
             int n = type.numelements() * 3;   // always make deriv room
@@ -276,7 +293,9 @@ BackendLLVM::llvm_type_groupdata ()
             if (llvm_debug() >= 2)
                 std::cout << "  userdata " << names[i] << ' ' << type
                           << ", field " << order << ", offset " << offset << "\n";
-            offsets[i] = offset;
+            if (record)
+                offsets[i] = offset;
+            DASSERT (offsets[i] == offset);
             offset += int(type.size());
             ++order;
         }
@@ -310,14 +329,27 @@ BackendLLVM::llvm_type_groupdata ()
                           << " " << ts.c_str() << ", field " << order 
                           << ", size " << derivSize * int(sym.size())
                           << ", offset " << offset << std::endl;
-            sym.dataoffset ((int)offset);
+            if (record)
+                sym.dataoffset ((int)offset);
+            DASSERT (sym.dataoffset() == (int)offset);
+            if (sym.typespec().is_closure_based()) {
+                int len = derivSize * int(sym.size());
+                if (reset.back().first + reset.back().second == (int)offset)
+                    reset.back().second += len;
+                else
+                    reset.push_back (std::make_pair ((int)offset, len));
+            }
             offset += derivSize* int(sym.size());
 
             m_param_order_map[&sym] = order;
             ++order;
         }
     }
-    group().llvm_groupdata_size (offset);
+    if (record) {
+        group().llvm_groupdata_size (offset);
+        group().llvm_groupdata_reset (reset);
+    }
+    DASSERT (group().llvm_groupdata_size() == size_t(offset));
     if (llvm_debug() >= 2)
         std::cout << " Group struct had " << order << " fields, total size "
                   << offset << "\n\n";
@@ -481,7 +513,7 @@ BackendLLVM::llvm_assign_initial_value (const Symbol& sym)
     } else if (! sym.lockgeom() && ! sym.typespec().is_closure()) {
         // geometrically-varying param; memcpy its default value
         TypeDesc t = sym.typespec().simpletype();
-        ll.op_memcpy (llvm_void_ptr (sym), ll.constant_ptr (sym.data()),
+        ll.op_memcpy (llvm_void_ptr (sym), llvm_symbol_address_constant (sym),
                       t.size(), t.basesize() /*align*/);
         if (sym.has_derivs())
             llvm_zero_derivs (sym);
@@ -810,6 +842,10 @@ BackendLLVM::build_llvm_instance (bool groupentry)
         if (shadingsys().countlayerexecs())
             ll.call_function ("osl_incr_layers_executed", sg_void_ptr());
     }
+    if (shadingsys().profile() >= 2) {
+        llvm::Value *args[] = { sg_void_ptr(), ll.constant(this->layer()) };
+        ll.call_function ("osl_profile_layer_enter", args, 2);
+    }
 
     // Setup the symbols
     m_named_values.clear ();
@@ -918,6 +954,8 @@ BackendLLVM::build_llvm_instance (bool groupentry)
     // llvm_gen_debug_printf ("done copying connections");
 
     // All done
+    if (shadingsys().profile() >= 2)
+        ll.call_function ("osl_profile_layer_exit", sg_void_ptr());
     if (shadingsys().llvm_debug_layers())
         llvm_gen_debug_printf (Strutil::format("exit layer %d %s %s",
                                this->layer(), inst()->layername(), inst()->shadername()));
@@ -938,7 +976,7 @@ BackendLLVM::build_llvm_instance (bool groupentry)
 void
 BackendLLVM::initialize_llvm_group ()
 {
-    ll.setup_optimization_passes (shadingsys().llvm_optimize());
+    ll.setup_optimization_passes (m_fast_tier ? -1 : shadingsys().llvm_optimize());
 
     // Clear the shaderglobals and groupdata types -- they will be
     // created on demand.
@@ -985,27 +1023,641 @@ BackendLLVM::initialize_llvm_group ()
 
 
 
-static void empty_group_func (void*, void*)
+static void
+hash_symbol (std::ostream &out, const Symbol &s)
 {
+    out << "  sym " << s.name() << ' ' << int(s.symtype()) << ' '
+        << s.typespec().c_str() << ' ' << s.size() << ' '
+        << s.has_derivs() << ' ' << s.lockgeom() << ' '
+        << int(s.valuesource()) << ' ' << s.connected_down() << ' '
+        << s.renderer_output() << ' ' << s.fieldid() << ' ' << s.layer()
+        << ' ' << s.initbegin() << ' ' << s.initend() << ' '
+        << s.firstread() << ' ' << s.lastread() << ' '
+        << s.firstwrite() << ' ' << s.lastwrite();
+    if (s.data() && s.size() > 0) {
+        // Strings are hashed by their characters, not their (process-
+        // specific) ustring pointers.
+        if (s.typespec().simpletype().basetype == TypeDesc::STRING) {
+            const ustring *strs = (const ustring *) s.data();
+            for (int i = 0, n = s.size() / int(sizeof(ustring)); i < n; ++i)
+                out << ' ' << strs[i].length() << ':' << strs[i];
+        } else {
+            out << ' ' << LLVM_Util::symbol_encode (string_view ((const char *)s.data(), s.size()));
+        }
+    }
+    out << '\n';
 }
 
 
 
 void
-BackendLLVM::run ()
+BackendLLVM::hash_config (std::ostream &out)
 {
-    if (group().does_nothing()) {
-        group().llvm_compiled_init ((RunLLVMGroupFunc)empty_group_func);
-        group().llvm_compiled_version ((RunLLVMGroupFunc)empty_group_func);
-        return;
+    out << "OSL " << OSL_LIBRARY_VERSION_STRING << '\n'
+        << LLVM_Util::jit_target (ll.target_isa()) << '\n';
+#ifndef OSL_LLVM_NO_BITCODE
+    static std::string bitcode_hash =
+        OIIO::SHA1 (osl_llvm_compiled_ops_block, osl_llvm_compiled_ops_size).digest();
+    out << "ops " << bitcode_hash << '\n';
+#endif
+    ShadingSystemImpl &ss (shadingsys());
+    out << "options " << ss.llvm_optimize() << ' ' << ss.debug_nan() << ' '
+        << ss.debug_uninit() << ' ' << ss.range_checking() << ' '
+        << ss.lazy_userdata() << ' ' << ss.opt_texture_handle() << ' '
+        << ss.no_noise() << ' ' << ss.profile() << ' '
+        << ss.countlayerexecs() << ' ' << ss.llvm_debug_layers() << ' '
+        << ss.llvm_debug_ops() << ' ' << ss.commonspace_synonym() << ' '
+        << ss.debug_groupname() << ' ' << ss.debug_layername() << ' '
+        << m_fast_tier << '\n';
+    for (size_t i = 0; i < ss.m_raytypes.size(); ++i)
+        out << "raytype " << ss.m_raytypes[i] << '\n';
+}
+
+
+
+std::string
+BackendLLVM::source_hash ()
+{
+    // The optimized group -- and so its code -- is determined by the
+    // masters' code, the instance values and connections, and the options
+    // that steer the optimizer, on top of everything that goes into
+    // hash_config().  Group names and instance IDs don't matter, with one
+    // exception: the optimizer folds getattribute("shader:groupname").
+    std::ostringstream out;
+    hash_config (out);
+    ShadingSystemImpl &ss (shadingsys());
+    out << "optimizer " << ss.m_optimize << ' ' << ss.m_opt_simplify_param
+        << ss.m_opt_constant_fold << ss.m_opt_stale_assign << ss.m_opt_elide_useless_ops
+        << ss.m_opt_elide_unconnected_outputs << ss.m_opt_peephole
+        << ss.m_opt_coalesce_temps << ss.m_opt_assign << ss.m_opt_mix << ' '
+        << int(ss.m_opt_merge_instances) << ss.m_opt_merge_instances_with_userdata
+        << ss.m_opt_fold_getattribute << ss.m_opt_middleman
+        << ss.m_opt_texture_handle << ss.m_opt_seed_bblock_aliases << ' '
+        << ss.m_opt_passes << ' ' << ss.m_opt_adaptive_passes << ' '
+        << ss.m_lazylayers << ss.m_lazyglobals << ss.m_lazyunconnected
+        << ss.m_userdata_isconnected << ss.m_strict_messages
+        << ss.m_optimize_nondebug << ' ' << ss.m_debug_groupname << ' '
+        << ss.m_debug_layername << '\n';
+    for (auto&& name : ss.m_renderer_outputs)
+        out << "output " << name << '\n';
+
+    ShaderGroup &g (group());
+    bool groupname_folds = false;
+    for (int layer = 0; layer < g.nlayers(); ++layer)
+        for (const Symbol &s : g[layer]->master()->symbols())
+            if (s.symtype() == SymTypeConst && s.typespec().is_string() &&
+                *(const ustring *)s.data() == "shader:groupname")
+                groupname_folds = true;
+    out << "group " << (groupname_folds && ss.m_opt_fold_getattribute ? g.name() : ustring())
+        << ' ' << g.nlayers() << ' ' << g.num_entry_layers() << ' '
+        << g.raytypes_on() << ' ' << g.raytypes_off() << ' '
+        << g.object_variant_key().size() << ':' << g.object_variant_key() << '\n';
+    for (auto&& name : g.m_renderer_outputs)
+        out << "output " << name << '\n';
+
+    for (int layer = 0; layer < g.nlayers(); ++layer) {
+        const ShaderInstance *inst = g[layer];
+        out << "layer " << layer << ' ' << inst->layername() << ' '
+            << inst->shadername() << ' ' << inst->master()->code_digest() << ' '
+            << inst->entry_layer() << ' ' << inst->last_layer() << ' '
+            << inst->writes_globals() << ' ' << inst->userdata_params() << ' '
+            << inst->renderer_outputs() << ' ' << inst->merged_unused() << '\n';
+        for (int p = inst->firstparam(); p < inst->lastparam(); ++p) {
+            const SymOverrideInfo *so = inst->instoverride (p);
+            out << "  param " << p << ' ' << int(so->valuesource()) << ' '
+                << so->connected_down() << ' ' << so->lockgeom() << ' '
+                << so->arraylen();
+            TypeDesc t = inst->mastersymbol(p)->typespec().simpletype();
+            const void *data = inst->param_storage (p);
+            if (t.arraylen < 0) {
+                t.arraylen = so->arraylen();
+                if (t.arraylen <= 0)
+                    data = NULL;
+            }
+            if (data && t.basetype == TypeDesc::STRING) {
+                for (size_t i = 0, n = t.numelements()*t.aggregate; i < n; ++i)
+                    out << ' ' << ((const ustring *)data)[i].length() << ':'
+                        << ((const ustring *)data)[i];
+            } else if (data && t.size() > 0) {
+                out << ' ' << LLVM_Util::symbol_encode (string_view ((const char *)data, t.size()));
+            }
+            out << '\n';
+        }
+        for (int c = 0; c < inst->nconnections(); ++c) {
+            const Connection &con (inst->connection (c));
+            out << "  connection " << con.srclayer << ' '
+                << con.src.param << ' ' << con.src.arrayindex << ' '
+                << con.src.channel << ' ' << con.src.type.c_str() << ' '
+                << con.dst.param << ' ' << con.dst.arrayindex << ' '
+                << con.dst.channel << ' ' << con.dst.type.c_str() << '\n';
+        }
     }
 
-    // At this point, we already hold the lock for this group, by virtue
-    // of ShadingSystemImpl::optimize_group.
-    OIIO::Timer timer;
+    std::string key = out.str();
+    OIIO::SHA1 sha (key.data(), key.size());
+    return sha.digest();
+}
+
+
+
+std::string
+BackendLLVM::group_hash (bool structural)
+{
+    // Everything that can influence the code we generate goes into the
+    // hash: the OSL and LLVM versions and JIT target, the shadeops
+    // library, the options consulted during code generation, and the
+    // complete post-optimization state of every layer of the group.
+    //
+    // The structural variant leaves out the group name and the instance
+    // IDs, which only show up in diagnostics and in the names of the
+    // layer functions, so that identical groups built separately (for
+    // example, rebuilt by an interactive session) hash the same.  Only
+    // the relative order of the IDs matters to the generated code.
+    std::ostringstream out;
+    hash_config (out);
+    ShadingSystemImpl &ss (shadingsys());
+
+    ShaderGroup &g (group());
+    out << "group " << (structural ? ustring() : g.name()) << ' '
+        << g.nlayers() << ' ' << g.num_entry_layers() << '\n';
+    for (size_t i = 0; i < g.m_userdata_names.size(); ++i)
+        out << "userdata " << g.m_userdata_names[i] << ' '
+            << g.m_userdata_types[i] << ' ' << int(g.m_userdata_derivs[i]) << '\n';
+
+    for (int layer = 0; layer < g.nlayers(); ++layer) {
+        const ShaderInstance *inst = g[layer];
+        int id = inst->id();
+        if (structural) {
+            id = 0;
+            for (int i = 0; i < g.nlayers(); ++i)
+                id += (g[i]->id() < inst->id());
+        }
+        out << "layer " << layer << ' ' << inst->layername() << ' '
+            << inst->shadername() << ' ' << id << ' '
+            << inst->unused() << ' ' << inst->empty_instance() << ' '
+            << inst->entry_layer() << ' ' << inst->last_layer() << ' '
+            << inst->run_lazily() << ' ' << inst->outgoing_connections() << ' '
+            << inst->renderer_outputs() << ' ' << inst->writes_globals() << ' '
+            << inst->userdata_params() << ' ' << m_layer_remap[layer] << ' '
+            << inst->firstparam() << ' ' << inst->lastparam() << ' '
+            << inst->maincodebegin() << ' ' << inst->maincodeend() << '\n';
+        for (const Symbol &s : inst->symbols())
+            hash_symbol (out, s);
+        for (const Opcode &op : inst->ops()) {
+            out << "  op " << op.opname() << ' ' << op.method() << ' '
+                << op.firstarg() << ' ' << op.nargs();
+            for (unsigned int j = 0; j < Opcode::max_jumps; ++j)
+                out << ' ' << op.jump(j);
+            out << ' ' << op.argread_bits() << ' ' << op.argwrite_bits()
+                << ' ' << op.argtakesderivs_all() << ' ' << op.sourcefile()
+                << ' ' << op.sourceline() << '\n';
+            if (op.opname() == "closure") {
+                // The generated code depends on the closure's registered
+                // layout, not just its name.
+                for (int a = 0; a < op.nargs(); ++a) {
+                    const Symbol *s = inst->argsymbol (op.firstarg() + a);
+                    if (! s->is_constant() || ! s->typespec().is_string())
+                        continue;
+                    const ClosureRegistry::ClosureEntry *clentry =
+                        ss.find_closure (*(ustring *)s->data());
+                    if (! clentry)
+                        continue;
+                    out << "  closure " << clentry->name << ' ' << clentry->id
+                        << ' ' << clentry->struct_size << ' '
+                        << (clentry->prepare != NULL) << ' '
+                        << (clentry->setup != NULL);
+                    for (const ClosureParam &p : clentry->params)
+                        out << ' ' << p.type << ' ' << p.offset << ' '
+                            << (p.key ? p.key : "") << ' ' << p.field_size;
+                    out << '\n';
+                }
+            }
+        }
+        out << "  args";
+        for (int a : inst->args())
+            out << ' ' << a;
+        out << '\n';
+        for (int c = 0; c < inst->nconnections(); ++c) {
+            const Connection &con (inst->connection (c));
+            out << "  connection " << con.srclayer << ' '
+                << con.src.param << ' ' << con.src.arrayindex << ' '
+                << con.src.channel << ' ' << con.src.type.c_str() << ' '
+                << con.dst.param << ' ' << con.dst.arrayindex << ' '
+                << con.dst.channel << ' ' << con.dst.type.c_str() << '\n';
+        }
+    }
+
+    std::string key = out.str();
+    OIIO::SHA1 sha (key.data(), key.size());
+    return sha.digest();
+}
+
+
+
+void *
+BackendLLVM::resolve_relocatable_symbol (const std::string &name)
+{
+    string_view rest (name);
+    if (! Strutil::parse_prefix (rest, "oslreloc_"))
+        return NULL;
+    if (Strutil::parse_prefix (rest, "ustring_"))
+        return (void *) ustring (LLVM_Util::symbol_decode (rest)).c_str();
+    if (rest == "renderer")
+        return shadingsys().renderer();
+    if (Strutil::parse_prefix (rest, "texture_")) {
+        ustring filename (LLVM_Util::symbol_decode (rest));
+        RendererServices::TextureHandle *handle =
+            shadingsys().renderer()->get_texture_handle (filename);
+        if (! shadingsys().renderer()->good (handle))
+            return NULL;
+        return handle;
+    }
+    bool prepare = Strutil::parse_prefix (rest, "prepare_");
+    if (prepare || Strutil::parse_prefix (rest, "setup_")) {
+        int id = -1;
+        if (! Strutil::parse_int (rest, id) || id < 0)
+            return NULL;
+        const ClosureRegistry::ClosureEntry *clentry = shadingsys().find_closure (id);
+        if (! clentry)
+            return NULL;
+        return prepare ? (void *)clentry->prepare : (void *)clentry->setup;
+    }
+    if (Strutil::parse_prefix (rest, "param_")) {
+        int layer = -1;
+        if (! Strutil::parse_int (rest, layer) ||
+            ! Strutil::parse_char (rest, '_') ||
+            layer < 0 || layer >= group().nlayers())
+            return NULL;
+        ShaderInstance *inst = group()[layer];
+        int param = inst->findparam (ustring (LLVM_Util::symbol_decode (rest)));
+        return param >= 0 ? inst->symbol (param)->data() : NULL;
+    }
+    return NULL;
+}
+
+
+
+// Strings in the object file header are hex encoded, with a leading '='
+// so that even an empty one makes a field.
+static std::string
+field_encode (string_view s)
+{
+    return "=" + LLVM_Util::symbol_encode (s);
+}
+
+static bool
+field_decode (std::istream &fields, ustring &s)
+{
+    std::string f;
+    if (! (fields >> f) || f.empty() || f[0] != '=')
+        return false;
+    s = ustring (LLVM_Util::symbol_decode (string_view(f).substr(1)));
+    return true;
+}
+
+
+
+struct BackendLLVM::SavedObject {
+    std::string hash;                     // group_hash(true)
+    std::string source;                   // source_hash(), if saved
+    int local_mem = 0;
+    std::string init_name;
+    std::vector<std::pair<int,std::string> > layer_names;
+    std::vector<std::string> symbols;     // Relocatable symbols to bind
+    // What the optimizer worked out about the group, and the groupdata
+    // layout, which precompiled code must restore for itself.
+    size_t groupdata_size = 0;
+    GroupdataSpans reset;
+    struct Userdata { ustring name; TypeDesc type; int derivs, offset; };
+    std::vector<Userdata> userdata;
+    struct Param { int layer; ustring name; int offset; };
+    std::vector<Param> params;
+    std::vector<ustring> textures, closures, globals;
+    std::vector<ustring> attributes, attribute_scopes;
+    int unknown_textures = 0, unknown_closures = 0, unknown_attributes = 0;
+    std::string object;
+};
+
+
+
+bool
+BackendLLVM::read_object_file (const std::string &filename,
+                               SavedObject &saved)
+{
+    std::ifstream in (filename.c_str(), std::ios::in | std::ios::binary);
+    if (! in)
+        return false;
+
+    std::string line;
+    size_t objsize = 0;
+    if (! std::getline (in, line) || line != "OSL JIT cache 3")
+        return false;
+    while (! objsize && std::getline (in, line)) {
+        std::istringstream fields (line);
+        std::string key, name;
+        fields >> key;
+        bool ok = true;
+        if (key == "hash") {
+            ok = !! (fields >> saved.hash);
+        } else if (key == "source") {
+            ok = !! (fields >> saved.source);
+        } else if (key == "localmem") {
+            ok = !! (fields >> saved.local_mem);
+        } else if (key == "init") {
+            ok = !! (fields >> name);
+            saved.init_name = LLVM_Util::symbol_decode (name);
+        } else if (key == "layer") {
+            int layer = -1;
+            fields >> layer >> name;
+            ok = (layer >= 0 && layer < group().nlayers() && name.size());
+            saved.layer_names.push_back (std::make_pair (layer, LLVM_Util::symbol_decode (name)));
+        } else if (key == "symbol") {
+            ok = !! (fields >> name);
+            saved.symbols.push_back (name);
+        } else if (key == "groupdata") {
+            ok = !! (fields >> saved.groupdata_size);
+        } else if (key == "reset") {
+            int offset = -1, size = -1;
+            ok = (fields >> offset >> size) && offset >= 0 && size > 0 &&
+                 size_t(offset+size) <= saved.groupdata_size;
+            saved.reset.push_back (std::make_pair (offset, size));
+        } else if (key == "userdata") {
+            SavedObject::Userdata u;
+            ok = field_decode (fields, u.name) && (fields >> name >> u.derivs >> u.offset);
+            u.type.fromstring (name);
+            saved.userdata.push_back (u);
+        } else if (key == "param") {
+            SavedObject::Param param;
+            ok = (fields >> param.layer) && field_decode (fields, param.name) &&
+                 (fields >> param.offset) && param.layer >= 0 &&
+                 param.layer < group().nlayers() && param.offset >= 0;
+            saved.params.push_back (param);
+        } else if (key == "texture" || key == "closure" || key == "global") {
+            ustring s;
+            ok = field_decode (fields, s);
+            (key == "texture" ? saved.textures :
+             key == "closure" ? saved.closures : saved.globals).push_back (s);
+        } else if (key == "attribute") {
+            ustring attr, scope;
+            ok = field_decode (fields, attr) && field_decode (fields, scope);
+            saved.attributes.push_back (attr);
+            saved.attribute_scopes.push_back (scope);
+        } else if (key == "unknown") {
+            ok = !! (fields >> saved.unknown_textures >> saved.unknown_closures
+                            >> saved.unknown_attributes);
+        } else if (key == "object") {
+            ok = (fields >> objsize) && objsize;
+        } else {
+            ok = false;
+        }
+        if (! ok)
+            return false;
+    }
+    if (saved.init_name.empty() || ! objsize || saved.layer_names.empty())
+        return false;
+    saved.object.assign (objsize, '\0');
+    return !! in.read (&saved.object[0], objsize);
+}
+
+
+
+bool
+BackendLLVM::link_object (const std::string &filename,
+                          const SavedObject &saved, bool precompiled)
+{
+    // Set up an engine with the same helper function mappings that the
+    // code was originally linked against.  Laying out the groupdata also
+    // assigns the param data offsets and userdata offsets that the rest
+    // of the system expects.
     std::string err;
+    ll.module (ll.new_module ("llvm_ops_cached"));
+    if (! ll.make_jit_execengine (&err)) {
+        shadingcontext()->error ("Failed to create engine: %s\n", err.c_str());
+        delete ll.module();
+        ll.module (NULL);
+        return false;
+    }
+    initialize_llvm_group ();
+    if (! precompiled)
+        llvm_type_groupdata ();
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < saved.symbols.size(); ++i) {
+        void *addr = resolve_relocatable_symbol (saved.symbols[i]);
+        if (addr)
+            ll.add_symbol_mapping (saved.symbols[i], addr);
+        else
+            ok = false;
+    }
+    if (ok)
+        ok = ll.add_object_code (saved.object, &err);
+
+    RunLLVMGroupFunc init = NULL;
+    std::vector<std::pair<int,RunLLVMGroupFunc> > layers;
+    if (ok) {
+        init = (RunLLVMGroupFunc) ll.getPointerToFunction (saved.init_name);
+        ok = (init != NULL);
+        for (size_t i = 0; ok && i < saved.layer_names.size(); ++i) {
+            RunLLVMGroupFunc f = (RunLLVMGroupFunc) ll.getPointerToFunction (saved.layer_names[i].second);
+            layers.push_back (std::make_pair (saved.layer_names[i].first, f));
+            ok = (f != NULL);
+        }
+    }
+    if (ok) {
+        m_llvm_local_mem = saved.local_mem;
+        group().llvm_compiled_init (init);
+        for (size_t i = 0; i < layers.size(); ++i)
+            group().llvm_compiled_layer (layers[i].first, layers[i].second);
+        if (group().num_entry_layers())
+            group().llvm_compiled_version (NULL);
+        else
+            group().llvm_compiled_version (group().llvm_compiled_layer(group().nlayers()-1));
+        group().llvm_jit_memory (ll.jit_memory());
+    } else if (err.size()) {
+        shadingcontext()->warning ("Could not use %s object %s: %s",
+                                   precompiled ? "precompiled" : "cached JIT",
+                                   filename, err);
+    }
 
-    {
+    // As with freshly JITed code, we don't need the engine any more.
+    ll.execengine (NULL);
+    ll.module (NULL);
+    return ok;
+}
+
+
+
+bool
+BackendLLVM::load_cached_object (const std::string &filename,
+                                 const std::string &hash)
+{
+    SavedObject saved;
+    if (! read_object_file (filename, saved) || saved.hash != hash ||
+        ! link_object (filename, saved, false))
+        return false;
+    shadingsys().m_stat_llvm_cache_hits += 1;
+    shadingsys().m_stat_llvm_cache_bytes_read += (long long) saved.object.size();
+    return true;
+}
+
+
+
+bool
+BackendLLVM::load_precompiled ()
+{
+    ShaderGroup &g (group());
+    ustring load_file = g.llvm_object_load_file();
+    if (! load_file && ! g.llvm_object_save_file())
+        return false;
+    // Precompiled code is always the fully optimized tier.
+    m_fast_tier = false;
+    m_source_hash = source_hash ();
+    if (! load_file)
+        return false;
+
+    OIIO::Timer timer;
+    SavedObject saved;
+    bool ok = read_object_file (load_file.string(), saved) &&
+              saved.source == m_source_hash;
+
+    // Set up the layers' code and params just as the optimizer would
+    // have started out, but on copies, so that the originals are still
+    // there to optimize if the object can't be used after all.
+    std::vector<ShaderInstanceRef> originals;
+    if (ok) {
+        originals = g.m_layers;
+        for (int layer = 0; layer < g.nlayers(); ++layer)
+            g.m_layers[layer] = originals[layer]->clone_unoptimized();
+        for (int layer = 0; ok && layer < g.nlayers(); ++layer) {
+            ok = g[layer]->copy_code_from_master (g);
+            FOREACH_PARAM (Symbol &s, g[layer])
+                s.dataoffset (-1);
+        }
+        for (size_t i = 0; ok && i < saved.params.size(); ++i) {
+            ShaderInstance *inst = g[saved.params[i].layer];
+            int param = inst->findparam (saved.params[i].name);
+            if (param >= 0)
+                inst->symbol(param)->dataoffset (saved.params[i].offset);
+            ok = (param >= 0);
+        }
+        ok = ok && link_object (load_file.string(), saved, true);
+        if (! ok)
+            g.m_layers = originals;
+    }
+    if (! ok) {
+        shadingcontext()->warning ("Precompiled object %s can't be used for shader group %s (missing, or saved for a different group or configuration); optimizing and JITing it instead",
+                                   load_file, g.name());
+        return false;
+    }
+
+    g.llvm_groupdata_size (saved.groupdata_size);
+    g.llvm_groupdata_reset (saved.reset);
+    for (auto&& u : saved.userdata) {
+        g.m_userdata_names.push_back (u.name);
+        g.m_userdata_types.push_back (u.type);
+        g.m_userdata_derivs.push_back (char(u.derivs));
+        g.m_userdata_offsets.push_back (u.offset);
+    }
+    g.m_textures_needed = saved.textures;
+    g.m_closures_needed = saved.closures;
+    g.m_globals_needed = saved.globals;
+    g.m_attributes_needed = saved.attributes;
+    g.m_attribute_scopes = saved.attribute_scopes;
+    g.m_unknown_textures_needed = saved.unknown_textures;
+    g.m_unknown_closures_needed = saved.unknown_closures;
+    g.m_unknown_attributes_needed = saved.unknown_attributes;
+
+    m_stat_total_llvm_time = timer();
+    shadingsys().m_stat_groups_precompiled += 1;
+    if (shadingsys().m_compile_report)
+        shadingcontext()->info ("Loaded precompiled code for shader group %s from %s (%1.2fs)",
+                                g.name(), load_file, m_stat_total_llvm_time);
+    return true;
+}
+
+
+
+void
+BackendLLVM::save_cached_object (const std::string &filename,
+                                 const std::string &hash,
+                                 llvm::Function *init_func,
+                                 const std::vector<llvm::Function*> &funcs)
+{
+    const std::string &obj (ll.object_code());
+    if (! m_cacheable || obj.empty())
+        return;
+
+    ShaderGroup &g (group());
+    std::ostringstream header;
+    header << "OSL JIT cache 3\n"
+           << "hash " << hash << "\n";
+    if (m_source_hash.size())
+        header << "source " << m_source_hash << "\n";
+    header << "localmem " << m_llvm_local_mem << "\n"
+           << "init " << LLVM_Util::symbol_encode (ll.func_name(init_func)) << "\n";
+    for (int layer = 0, n = (int)funcs.size(); layer < n; ++layer) {
+        if (funcs[layer] && g.is_entry_layer(layer))
+            header << "layer " << layer << ' '
+                   << LLVM_Util::symbol_encode (ll.func_name(funcs[layer])) << "\n";
+    }
+    for (const std::string &s : ll.relocatable_symbols())
+        header << "symbol " << s << "\n";
+    header << "groupdata " << g.llvm_groupdata_size() << "\n";
+    for (auto&& span : g.llvm_groupdata_reset())
+        header << "reset " << span.first << ' ' << span.second << "\n";
+    for (size_t i = 0; i < g.m_userdata_names.size(); ++i)
+        header << "userdata " << field_encode (g.m_userdata_names[i]) << ' '
+               << g.m_userdata_types[i] << ' ' << int(g.m_userdata_derivs[i])
+               << ' ' << g.m_userdata_offsets[i] << "\n";
+    for (int layer = 0; layer < g.nlayers(); ++layer) {
+        if (g[layer]->unused())
+            continue;
+        FOREACH_PARAM (const Symbol &s, g[layer])
+            if (s.dataoffset() >= 0 && ! s.typespec().is_structure())
+                header << "param " << layer << ' ' << field_encode (s.name())
+                       << ' ' << s.dataoffset() << "\n";
+    }
+    for (auto&& f : g.m_textures_needed)
+        header << "texture " << field_encode (f) << "\n";
+    for (auto&& f : g.m_closures_needed)
+        header << "closure " << field_encode (f) << "\n";
+    for (auto&& f : g.m_globals_needed)
+        header << "global " << field_encode (f) << "\n";
+    for (size_t i = 0; i < g.m_attributes_needed.size(); ++i)
+        header << "attribute " << field_encode (g.m_attributes_needed[i]) << ' '
+               << field_encode (g.m_attribute_scopes[i]) << "\n";
+    header << "unknown " << int(g.m_unknown_textures_needed) << ' '
+           << int(g.m_unknown_closures_needed) << ' '
+           << int(g.m_unknown_attributes_needed) << "\n";
+    header << "object " << obj.size() << "\n";
+
+    // Write to a temporary file and rename it into place, so that other
+    // processes sharing the cache never see a partially written file.
+    std::string dir = Filesystem::parent_path (filename), err;
+    if (! Filesystem::is_directory (dir))
+        Filesystem::create_directory (dir, err);
+    std::string tmpname = Filesystem::unique_path (filename + ".%%%%-%%%%-%%%%");
+    std::ofstream out (tmpname.c_str(), std::ios::out | std::ios::binary);
+    if (out) {
+        std::string h = header.str();
+        out.write (h.data(), h.size());
+        out.write (obj.data(), obj.size());
+        out.close ();
+    }
+    if (out && std::rename (tmpname.c_str(), filename.c_str()) == 0) {
+        shadingsys().m_stat_llvm_cache_bytes_written += (long long) obj.size();
+    } else {
+        shadingcontext()->warning ("Could not write JIT object file %s", filename);
+        Filesystem::remove (tmpname, err);
+    }
+}
+
+
+
+bool
+BackendLLVM::setup_module_and_engine ()
+{
+    std::string err;
 #ifdef OSL_LLVM_NO_BITCODE
     // I don't know which exact part has thread safety issues, but it
     // crashes on windows when we don't lock.
@@ -1018,26 +1670,362 @@ BackendLLVM::run ()
 #ifdef OSL_LLVM_NO_BITCODE
     ll.module (ll.new_module ("llvm_ops"));
 #else
-    ll.module (ll.module_from_bitcode (osl_llvm_compiled_ops_block,
-                                       osl_llvm_compiled_ops_size,
-                                       "llvm_ops", &err));
+    OIIO::Timer parsetimer;
+    double parse_time = 0.0;
+    ll.module (ll.module_from_bitcode_template (osl_llvm_compiled_ops_block,
+                                                osl_llvm_compiled_ops_size,
+                                                "llvm_ops", &err, &parse_time));
     if (err.length())
         shadingcontext()->error ("ParseBitcodeFile returned '%s'\n", err.c_str());
     ASSERT (ll.module());
+    // Credit the time saved by cloning the pre-parsed module rather than
+    // parsing the bitcode again.
+    m_stat_llvm_setup_saved += std::max (0.0, parse_time - parsetimer());
 #endif
 
     // Create the ExecutionEngine
+    ll.fast_codegen (m_fast_tier);
     if (! ll.make_jit_execengine (&err)) {
         shadingcontext()->error ("Failed to create engine: %s\n", err.c_str());
         ASSERT (0);
+        return false;
+    }
+    return true;
+}
+
+
+
+void
+BackendLLVM::build_chunk (const std::vector<int> &layers, bool with_init,
+                          ChunkResult &result)
+{
+    OIIO::Timer timer;
+    int nlayers = group().nlayers();
+    m_chunk_layers.assign (nlayers, false);
+    for (int layer : layers)
+        m_chunk_layers[layer] = true;
+    if (! setup_module_and_engine ())
         return;
+    m_stat_llvm_setup_time += timer.lap();
+
+    initialize_llvm_group ();
+    {
+        // Laying out the groupdata of a group that isn't optimized yet
+        // also records the data offsets of its params, which all the
+        // chunks do; one at a time, please.
+        static spin_mutex mutex;
+        spin_lock lock (mutex);
+        llvm_type_groupdata ();
     }
 
-    // End of mutex lock, for the OSL_LLVM_NO_BITCODE case
+    m_llvm_local_mem = 0;
+    llvm::Function* init_func = with_init ? build_llvm_init () : NULL;
+    std::vector<llvm::Function*> funcs (nlayers, NULL);
+    for (int layer : layers) {
+        set_inst (layer);
+        if (m_layer_remap[layer] != -1) {
+            bool is_single_entry = (layer == (nlayers-1) && group().num_entry_layers() == 0);
+            funcs[layer] = build_llvm_instance (is_single_entry);
+        }
     }
+    m_stat_llvm_irgen_time += timer.lap();
 
-    m_stat_llvm_setup_time += timer.lap();
+    // Every layer function is an entry point here, since layers in other
+    // chunks may call it.
+    std::vector<std::string> entry_function_names;
+    if (init_func)
+        entry_function_names.push_back (ll.func_name(init_func));
+    for (int layer : layers)
+        if (funcs[layer])
+            entry_function_names.push_back (ll.func_name(funcs[layer]));
+    ll.internalize_module_functions ("osl_", external_function_names, entry_function_names);
+    ll.do_optimize();
+    m_stat_llvm_opt_time += timer.lap();
+
+    if (init_func)
+        result.init = (RunLLVMGroupFunc) ll.getPointerToFunction(init_func);
+    for (int layer : layers)
+        if (funcs[layer])
+            result.layers.push_back (std::make_pair (layer,
+                    (RunLLVMGroupFunc) ll.getPointerToFunction(funcs[layer])));
+    result.jit_memory = ll.jit_memory();
+
+    for (int layer : layers)
+        if (funcs[layer])
+            ll.delete_func_body (funcs[layer]);
+    if (init_func)
+        ll.delete_func_body (init_func);
+    ll.execengine (NULL);
+    ll.module (NULL);
+    m_stat_llvm_jit_time += timer.lap();
+}
+
+
+
+// Stand-ins for entry layers that haven't been JITed yet.  Stub N JITs
+// the Nth lazy layer of the group being run, then runs it.  There's a
+// fixed supply of them, since a stub can't carry any state of its own;
+// entry layers past that many are just JITed up front.
+template<int N>
+static void
+lazy_layer_stub (void *sg, void *groupdata)
+{
+    ShadingContext *ctx = ((ShaderGlobals *)sg)->context;
+    RunLLVMGroupFunc f = BackendLLVM::compile_lazy_layer (ctx, N);
+    if (f)
+        f (sg, groupdata);
+}
 
+
+
+// Stand-in for a lazy layer that failed to JIT, so that it does nothing
+// rather than trying (and failing) again on every call.
+static void
+lazy_layer_failed (void * /*sg*/, void * /*groupdata*/)
+{
+}
+
+#define LAZY_STUBS4(n) \
+    lazy_layer_stub<n>, lazy_layer_stub<n+1>, \
+    lazy_layer_stub<n+2>, lazy_layer_stub<n+3>
+#define LAZY_STUBS16(n) \
+    LAZY_STUBS4(n), LAZY_STUBS4(n+4), LAZY_STUBS4(n+8), LAZY_STUBS4(n+12)
+
+static const RunLLVMGroupFunc lazy_layer_stubs[] = {
+    LAZY_STUBS16(0), LAZY_STUBS16(16), LAZY_STUBS16(32), LAZY_STUBS16(48)
+};
+static const int max_lazy_layers = int (sizeof(lazy_layer_stubs) /
+                                        sizeof(lazy_layer_stubs[0]));
+
+
+
+std::vector<int>
+BackendLLVM::find_lazy_layers ()
+{
+    std::vector<int> lazy;
+    if (! shadingsys().llvm_lazy_entry_layers() ||
+          group().num_entry_layers() < 2)
+        return lazy;
+    // The stubs are indexed by position in the group's list of lazy
+    // layers, which must not change once the stubs are handed out, even
+    // if the group is recompiled.
+    if (group().m_llvm_lazy_layers.size())
+        return group().m_llvm_lazy_layers;
+    int nlayers = group().nlayers();
+    for (int layer = 0; layer < nlayers && int(lazy.size()) < max_lazy_layers; ++layer)
+        if (group().is_entry_layer (layer) && m_layer_remap[layer] != -1)
+            lazy.push_back (layer);
+    return lazy;
+}
+
+
+
+mutex &
+BackendLLVM::lazy_layer_mutex (ShaderGroup &group, int n)
+{
+    std::call_once (group.m_llvm_lazy_mutexes_once, [&](){
+        group.m_llvm_lazy_mutexes.reset (new mutex[max_lazy_layers]);
+    });
+    return group.m_llvm_lazy_mutexes[n];
+}
+
+
+
+RunLLVMGroupFunc
+BackendLLVM::compile_lazy_layer (ShadingContext *ctx, int n)
+{
+    ShaderGroup *group = ctx->group();
+    ShadingSystemImpl &shadingsys (ctx->shadingsys());
+    int layer = group->m_llvm_lazy_layers[n];
+
+    RunLLVMGroupFunc f = group->m_llvm_layer_table[layer].load();
+    if (f == lazy_layer_stubs[n]) {
+        OIIO::Timer timer;
+        // Not group->m_mutex: a recompile at the full tier holds that
+        // while it JITs the whole group, and this thread is shading.
+        lock_guard lock (lazy_layer_mutex (*group, n));
+        f = group->m_llvm_layer_table[layer].load();
+        if (f == lazy_layer_stubs[n]) {
+            // Compile it with a context of its own, since the caller's
+            // is in the middle of shading.
+            ShadingContext *jitctx = shadingsys.get_context ();
+            BackendLLVM be (shadingsys, *group, jitctx);
+            be.fast_tier (group->llvm_promotable());
+            be.find_used_layers ();
+            ChunkResult result;
+            be.build_chunk (std::vector<int>(1, layer), false, result);
+            if (result.layers.size() == 1 && result.layers[0].second) {
+                f = result.layers[0].second;
+                // Kept apart from the rest of the group's code, which a
+                // recompile may be replacing at this moment.
+                spin_lock mem_lock (group->m_llvm_lazy_jit_memory_mutex);
+                group->m_llvm_lazy_jit_memory.push_back (result.jit_memory);
+            } else {
+                ctx->error ("Could not JIT entry layer %s of shader group %s; it will not be run",
+                            (*group)[layer]->layername(), group->name());
+                f = lazy_layer_failed;
+            }
+            group->m_llvm_layer_table[layer].store (f);
+            group->llvm_compiled_layer (layer, f);
+
+            // Unless the group may yet be recompiled at a higher tier,
+            // that was the last use of the layer's ops.
+            if (! group->llvm_promotable()) {
+                OpcodeVec emptyops;
+                (*group)[layer]->ops().swap (emptyops);
+                std::vector<int> emptyargs;
+                (*group)[layer]->args().swap (emptyargs);
+            }
+            shadingsys.release_context (jitctx);
+
+            shadingsys.m_stat_llvm_lazy_layers_compiled += 1;
+            double t = timer();
+            {
+                spin_lock stat_lock (shadingsys.m_stat_mutex);
+                shadingsys.m_stat_llvm_lazy_time += t;
+                shadingsys.m_stat_llvm_setup_time += be.m_stat_llvm_setup_time;
+                shadingsys.m_stat_llvm_irgen_time += be.m_stat_llvm_irgen_time;
+                shadingsys.m_stat_llvm_opt_time += be.m_stat_llvm_opt_time;
+                shadingsys.m_stat_llvm_jit_time += be.m_stat_llvm_jit_time;
+                shadingsys.m_stat_llvm_setup_saved += be.m_stat_llvm_setup_saved;
+            }
+            if (shadingsys.m_compile_report)
+                ctx->info ("JITed entry layer %s of shader group %s on first call (%1.2fs)",
+                           (*group)[layer]->layername(), group->name(), t);
+        }
+    }
+    return f;
+}
+
+
+
+void
+BackendLLVM::run_split (int chunksize, const std::vector<int> &lazy_layers)
+{
+    // Divide the group into chunks of consecutive layers, each with about
+    // chunksize used layers.  The lazy layers have no chunk, nor do the
+    // layers whose code a respecialized group reuses; chunk 0, which has
+    // the init function, may be otherwise empty.
+    int nlayers = group().nlayers();
+    std::vector<bool> lazy (nlayers, false);
+    for (int layer : lazy_layers)
+        lazy[layer] = true;
+    std::vector<std::vector<int> > chunks (1);
+    int used = 0;
+    for (int layer = 0; layer < nlayers; ++layer) {
+        if (lazy[layer] || group().reused_layer (layer))
+            continue;
+        if (used == chunksize) {
+            chunks.push_back (std::vector<int>());
+            used = 0;
+        }
+        chunks.back().push_back (layer);
+        used += (m_layer_remap[layer] != -1);
+    }
+    int nchunks = (int) chunks.size();
+
+    // Layers in one chunk call layers in other chunks through this table,
+    // which is filled in once all the chunks are JITed.  If we're
+    // replacing code that's already in use (recompiling at a higher
+    // tier), the old entries must remain valid until then.  So must the
+    // entries of reused layers, for good, along with the run flags that
+    // their code checks and sets.
+    if (group().m_llvm_layer_table.size() != size_t(nlayers))
+        group().m_llvm_layer_table.resize (nlayers);
+    group().m_llvm_layer_remap = m_layer_remap;
+
+    // Each chunk gets its own backend, and each task its own LLVM
+    // context.  The tasks, run on the renderer's or our own thread pool,
+    // grab the next chunk until they're gone.
+    std::vector<std::unique_ptr<BackendLLVM> > backends (nchunks);
+    std::vector<ChunkResult> results (nchunks);
+    atomic_int next_chunk (0);
+    std::function<void(int)> compile_chunks = [&](int) {
+        for (int c = next_chunk++;  c < nchunks;  c = next_chunk++) {
+            ShadingContext *ctx = shadingsys().get_context ();
+            backends[c].reset (new BackendLLVM (shadingsys(), group(), ctx));
+            BackendLLVM &be (*backends[c]);
+            be.fast_tier (m_fast_tier);
+            be.m_layer_remap = m_layer_remap;
+            be.m_num_used_layers = m_num_used_layers;
+            be.build_chunk (chunks[c], c == 0, results[c]);
+            shadingsys().release_context (ctx);
+        }
+    };
+    OIIO::Timer timer;
+    int nthreads = std::min (nchunks, std::max (1, (int)std::thread::hardware_concurrency()));
+    shadingsys().parallel_for (nthreads, compile_chunks);
+    double wall = timer();
+
+    // Put it all together.  Fill in the table before publishing any entry
+    // points that might use it.
+    double thread_time = 0.0;
+    m_llvm_local_mem = 0;
+    for (int c = 0; c < nchunks; ++c) {
+        for (auto&& f : results[c].layers)
+            group().m_llvm_layer_table[f.first].store (f.second);
+        BackendLLVM &be (*backends[c]);
+        m_stat_llvm_setup_time += be.m_stat_llvm_setup_time;
+        m_stat_llvm_irgen_time += be.m_stat_llvm_irgen_time;
+        m_stat_llvm_opt_time += be.m_stat_llvm_opt_time;
+        m_stat_llvm_jit_time += be.m_stat_llvm_jit_time;
+        m_stat_llvm_setup_saved += be.m_stat_llvm_setup_saved;
+        m_llvm_local_mem += be.m_llvm_local_mem;
+        thread_time += be.m_stat_llvm_setup_time + be.m_stat_llvm_irgen_time
+                     + be.m_stat_llvm_opt_time + be.m_stat_llvm_jit_time;
+    }
+    if (! group().reuses_layers() && group().m_llvm_lazy_layers != lazy_layers)
+        group().m_llvm_lazy_layers = lazy_layers;
+    for (size_t i = 0; i < lazy_layers.size(); ++i) {
+        // Let any JIT of the layer that's under way finish first, so the
+        // stub (for JITing it anew, at this tier) is what remains.
+        lock_guard lock (lazy_layer_mutex (group(), int(i)));
+        group().m_llvm_layer_table[lazy_layers[i]].store (lazy_layer_stubs[i]);
+    }
+    group().llvm_compiled_init (results[0].init);
+    for (int layer = 0; layer < nlayers; ++layer)
+        if (group().is_entry_layer (layer))
+            group().llvm_compiled_layer (layer, group().m_llvm_layer_table[layer].load());
+    if (group().num_entry_layers())
+        group().llvm_compiled_version (NULL);
+    else
+        group().llvm_compiled_version (group().llvm_compiled_layer(nlayers-1));
+    // The reused layers' code stays where it was, next to the new.
+    if (! group().reuses_layers())
+        group().llvm_jit_memory (results[0].jit_memory);
+    else
+        group().add_llvm_jit_memory (results[0].jit_memory);
+    for (int c = 1; c < nchunks; ++c)
+        group().add_llvm_jit_memory (results[c].jit_memory);
+
+    if (shadingsys().m_max_local_mem_KB &&
+        m_llvm_local_mem/1024 > shadingsys().m_max_local_mem_KB) {
+        shadingcontext()->error ("Shader group \"%s\" needs too much local storage: %d KB",
+                                 group().name(), m_llvm_local_mem/1024);
+    }
+
+    // Don't count the lazy layers again when recompiling a group at a
+    // higher optimization tier.
+    if (lazy_layers.size() && ! group().llvm_promotable())
+        shadingsys().m_stat_llvm_lazy_layers += (int) lazy_layers.size();
+    if (nchunks > 1) {
+        shadingsys().m_stat_llvm_split_groups += 1;
+        spin_lock lock (shadingsys().m_stat_mutex);
+        shadingsys().m_stat_llvm_split_saved += std::max (0.0, thread_time - wall);
+    }
+}
+
+
+
+static void empty_group_func (void*, void*)
+{
+}
+
+
+
+void
+BackendLLVM::find_used_layers ()
+{
     // Set up m_num_used_layers to be the number of layers that are
     // actually used, and m_layer_remap[] to map original layer numbers
     // to the shorter list of actually-called layers. We also note that
@@ -1059,7 +2047,115 @@ BackendLLVM::run ()
             m_layer_remap[layer] = m_num_used_layers++;
         }
     }
-    shadingsys().m_stat_empty_instances += nlayers - m_num_used_layers;
+}
+
+
+
+void
+BackendLLVM::run ()
+{
+    if (group().does_nothing()) {
+        group().llvm_compiled_init ((RunLLVMGroupFunc)empty_group_func);
+        group().llvm_compiled_version ((RunLLVMGroupFunc)empty_group_func);
+        return;
+    }
+
+    // At this point, we already hold the lock for this group, by virtue
+    // of ShadingSystemImpl::optimize_group.
+    OIIO::Timer timer;
+
+    // Code precompiled ahead of time (see ShadingSystem::
+    // compile_group_object and load_group_object) is always fully
+    // optimized.
+    ustring load_file = group().llvm_object_load_file();
+    ustring save_file = group().llvm_object_save_file();
+    if (load_file || save_file)
+        m_fast_tier = false;
+
+    int nlayers = group().nlayers();
+    find_used_layers ();
+    // Don't count the empty layers again when recompiling a group at a
+    // higher optimization tier.
+    if (! group().llvm_promotable())
+        shadingsys().m_stat_empty_instances += nlayers - m_num_used_layers;
+
+    // Cached code is matched to the group by its structure alone, since
+    // the group names and instance IDs in the process that compiled it
+    // are bound to be different.  (Precompiled code was matched before
+    // the group was optimized; see load_precompiled().)
+    std::string object_hash, cache_filename;
+    bool use_cache = (! shadingsys().llvm_cache_dir().empty() && ! llvm_debug()
+                      && ! group().reuses_layers());
+    if (use_cache || save_file)
+        object_hash = group_hash (true);
+
+    // If there's an object cache, and it already holds the code for an
+    // identical group, just relink that and we're done.
+    if (use_cache) {
+        cache_filename = Strutil::format ("%s/%s.oslobj",
+                                          shadingsys().llvm_cache_dir(),
+                                          object_hash);
+        if (load_cached_object (cache_filename, object_hash)) {
+            m_stat_llvm_setup_time += timer.lap();
+            m_stat_total_llvm_time = timer();
+            if (shadingsys().m_compile_report)
+                shadingcontext()->info ("Loaded cached JIT code for shader group %s (%1.2fs)",
+                                        group().name(), m_stat_total_llvm_time);
+            return;
+        }
+        shadingsys().m_stat_llvm_cache_misses += 1;
+    }
+
+    // Very large groups may be split into chunks of layers that are
+    // compiled concurrently, and entry layers may be left to be compiled
+    // when first called.  (Not when we need the object code, which must
+    // all be in one piece.)
+    // A group that may be respecialized always gets a function for each
+    // layer, called through the layer table, so that respecializing it
+    // can keep the code of the layers that don't change (see
+    // ShadingSystemImpl::respecialize_downstream).  Those already have
+    // their code, lazy or not.
+    int split = shadingsys().llvm_split_layers();
+    std::vector<int> lazy_layers;
+    bool by_layer = false;
+    if (! llvm_debug() && cache_filename.empty() && ! save_file) {
+        by_layer = group().respecializable();
+        if (! group().reuses_layers())
+            lazy_layers = find_lazy_layers ();
+    } else
+        split = 0;
+    if ((split > 0 && m_num_used_layers > split) || lazy_layers.size() ||
+        by_layer) {
+        run_split (split > 0 ? split : std::numeric_limits<int>::max(),
+                   lazy_layers);
+        m_stat_total_llvm_time = timer();
+        if (shadingsys().m_compile_report) {
+            shadingcontext()->info ("JITed shader group %s%s in parallel chunks (%d entry layers deferred):",
+                                    group().name(), m_fast_tier ? " (fast tier)" : "",
+                                    (int)lazy_layers.size());
+            shadingcontext()->info ("    (%1.2fs wall; thread time %1.2f setup, %1.2f ir, %1.2f opt, %1.2f jit; local mem %dKB)",
+                                    m_stat_total_llvm_time, m_stat_llvm_setup_time,
+                                    m_stat_llvm_irgen_time, m_stat_llvm_opt_time,
+                                    m_stat_llvm_jit_time, m_llvm_local_mem/1024);
+        }
+        return;
+    }
+
+    if (! setup_module_and_engine ())
+        return;
+
+    // When caching, generate code that refers to process-specific
+    // addresses only through named symbols, and capture the object code
+    // that the JIT produces.
+    if ((cache_filename.size() || save_file) && ll.save_object_code()) {
+        ll.relocatable_pointers (true);
+        m_cacheable = true;
+    } else if (save_file) {
+        shadingcontext()->error ("Can't save object code for shader group %s: not supported by this JIT",
+                                 group().name());
+    }
+
+    m_stat_llvm_setup_time += timer.lap();
 
     initialize_llvm_group ();
 
@@ -1135,6 +2231,12 @@ BackendLLVM::run ()
         group().llvm_compiled_version (NULL);
     else
         group().llvm_compiled_version (group().llvm_compiled_layer(nlayers-1));
+    group().llvm_jit_memory (ll.jit_memory());
+
+    if (m_cacheable && cache_filename.size())
+        save_cached_object (cache_filename, object_hash, init_func, funcs);
+    if (m_cacheable && save_file)
+        save_cached_object (save_file.string(), object_hash, init_func, funcs);
 
     // Remove the IR for the group layer functions, we've already JITed it
     // and will never need the IR again.  This saves memory, and also saves
@@ -1158,7 +2260,8 @@ BackendLLVM::run ()
     m_stat_total_llvm_time = timer();
 
     if (shadingsys().m_compile_report) {
-        shadingcontext()->info ("JITed shader group %s:", group().name());
+        shadingcontext()->info ("JITed shader group %s%s:", group().name(),
+                                m_fast_tier ? " (fast tier)" : "");
         shadingcontext()->info ("    (%1.2fs = %1.2f setup, %1.2f ir, %1.2f opt, %1.2f jit; local mem %dKB)",
                            m_stat_total_llvm_time, 
                            m_stat_llvm_setup_time,
@@ -27,8 +27,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 
+#include <cstdlib>
 #include <memory>
 #include <OpenImageIO/thread.h>
+#include <OpenImageIO/timer.h>
 #include <boost/thread/tss.hpp>   /* for thread_specific_ptr */
 
 #include <OSL/oslconfig.h>
@@ -75,12 +77,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <llvm/ExecutionEngine/GenericValue.h>
 #if USE_MCJIT
 #  include <llvm/ExecutionEngine/MCJIT.h>
+#  include <llvm/ExecutionEngine/ObjectCache.h>
+#  include <llvm/Object/ObjectFile.h>
 #endif
 #if USE_OLD_JIT
 #  include <llvm/ExecutionEngine/JIT.h>
 #  include <llvm/ExecutionEngine/JITMemoryManager.h>
 #endif
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/Host.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/PrettyStackTrace.h>
 #if OSL_LLVM_VERSION >= 35
@@ -92,6 +97,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/IPO.h>
 #include <llvm/Transforms/Utils/UnifyFunctionExitNodes.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #if OSL_LLVM_VERSION >= 36
 #  include <llvm/ExecutionEngine/SectionMemoryManager.h>
@@ -123,18 +129,26 @@ namespace {
 static OIIO::spin_mutex llvm_global_mutex;
 static bool setup_done = false;
 static boost::thread_specific_ptr<LLVM_Util::PerThreadInfo> perthread_infos;
+#if USE_OLD_JIT
 static std::vector<std::shared_ptr<LLVMMemoryManager> > jitmm_hold;
+#endif
+static std::vector<LLVM_Util::JITMemoryRef> jit_memory_hold;
+static OIIO::atomic_ll jit_memory_live (0);
+static OIIO::atomic_ll jit_memory_freed (0);
 };
 
 
 
 
-// We hold certain things (LLVM context and custom JIT memory manager)
-// per thread and retained across LLVM_Util invocations.  We are
-// intentionally "leaking" them.
+// We hold certain things (LLVM context and, for the old JIT, the custom
+// JIT memory manager) per thread and retained across LLVM_Util
+// invocations.  We are intentionally "leaking" them.
 struct LLVM_Util::PerThreadInfo {
-    PerThreadInfo () : llvm_context(NULL), llvm_jitmm(NULL) {}
+    PerThreadInfo () : llvm_context(NULL), llvm_jitmm(NULL),
+                       bitcode_template(NULL), bitcode_template_src(NULL),
+                       bitcode_template_parse_time(0.0) {}
     ~PerThreadInfo () {
+        delete bitcode_template;
         delete llvm_context;
         // N.B. Do NOT delete the jitmm -- another thread may need the
         // code! Don't worry, we stashed a pointer in jitmm_hold.
@@ -151,17 +165,48 @@ struct LLVM_Util::PerThreadInfo {
 
     llvm::LLVMContext *llvm_context;
     LLVMMemoryManager *llvm_jitmm;
+    llvm::Module *bitcode_template;     // Fully parsed bitcode, to clone
+    const char *bitcode_template_src;   // The bitcode it was parsed from
+    double bitcode_template_parse_time; // How long the parse took
 };
 
 
 
 
+/// JITMemory - Owns the real LLVMMemoryManager that holds the code and
+/// data JITed for a module.  It outlives the ExecutionEngine, and the
+/// memory is released when the last reference to it goes away.
+class LLVM_Util::JITMemory {
+public:
+    JITMemory () : m_bytes(0) {}
+    ~JITMemory () {
+        jit_memory_live -= m_bytes;
+        jit_memory_freed += m_bytes;
+    }
+#if USE_MCJIT
+    LLVMMemoryManager *mm () { return &m_mm; }
+#endif
+    // Account for an allocation (only ever called by the thread that is
+    // doing the JITing, so m_bytes needs no lock).
+    void allocated (size_t size) {
+        m_bytes += (long long)size;
+        jit_memory_live += (long long)size;
+    }
+private:
+#if USE_MCJIT
+    LLVMMemoryManager m_mm;
+#endif
+    long long m_bytes;
+};
+
+
+
 size_t
 LLVM_Util::total_jit_memory_held ()
 {
     size_t jitmem = 0;
-    OIIO::spin_lock lock (llvm_global_mutex);
 #if USE_OLD_JIT
+    OIIO::spin_lock lock (llvm_global_mutex);
     for (size_t i = 0;  i < jitmm_hold.size();  ++i) {
         LLVMMemoryManager *mm = jitmm_hold[i].get();
         if (mm)
@@ -169,22 +214,33 @@ LLVM_Util::total_jit_memory_held ()
                     + mm->GetDefaultDataSlabSize() * mm->GetNumDataSlabs()
                     + mm->GetDefaultStubSlabSize() * mm->GetNumStubSlabs();
     }
+#else
+    jitmem = (size_t) jit_memory_live;
 #endif
     return jitmem;
 }
 
 
 
+size_t
+LLVM_Util::total_jit_memory_freed ()
+{
+    return (size_t) jit_memory_freed;
+}
+
+
+
 /// MemoryManager - Create a shell that passes on requests
 /// to a real LLVMMemoryManager underneath, but can be retained after the
 /// dummy is destroyed.  Also, we don't pass along any deallocations.
 class LLVM_Util::MemoryManager : public LLVMMemoryManager {
 protected:
     LLVMMemoryManager *mm;  // the real one
+    JITMemory *m_owner;     // what owns it (MCJIT only), for accounting
 public:
 
 #if USE_OLD_JIT // llvm::JITMemoryManager
-    MemoryManager(LLVMMemoryManager *realmm) : mm(realmm) { HasGOT = realmm->isManagingGOT(); }
+    MemoryManager(LLVMMemoryManager *realmm) : mm(realmm), m_owner(NULL) { HasGOT = realmm->isManagingGOT(); }
 
     virtual void setMemoryWritable() { mm->setMemoryWritable(); }
     virtual void setMemoryExecutable() { mm->setMemoryExecutable(); }
@@ -234,7 +290,7 @@ public:
 
 #else // MCJITMemoryManager
 
-    MemoryManager(LLVMMemoryManager *realmm) : mm(realmm) {}
+    MemoryManager(JITMemory *owner) : mm(owner->mm()), m_owner(owner) {}
     
     virtual void notifyObjectLoaded(llvm::ExecutionEngine *EE, const llvm::object::ObjectFile &oi) {
         mm->notifyObjectLoaded (EE, oi);
@@ -274,11 +330,15 @@ public:
     }
     virtual uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
                              unsigned SectionID, llvm::StringRef SectionName) {
+        if (m_owner)
+            m_owner->allocated (Size);
         return mm->allocateCodeSection(Size, Alignment, SectionID, SectionName);
     }
     virtual uint8_t *allocateDataSection(uintptr_t Size, unsigned Alignment,
                              unsigned SectionID, llvm::StringRef SectionName,
                              bool IsReadOnly) {
+        if (m_owner)
+            m_owner->allocated (Size);
         return mm->allocateDataSection(Size, Alignment, SectionID,
                                        SectionName, IsReadOnly);
     }
@@ -303,6 +363,31 @@ public:
 
 
 
+#if USE_MCJIT
+/// ObjectCache - Hook that lets us keep a copy of the relocatable object
+/// code that MCJIT generates for a module.  We never hand objects back
+/// to MCJIT through getObject(); previously saved object code is loaded
+/// explicitly with LLVM_Util::add_object_code().
+class LLVM_Util::ObjectCache : public llvm::ObjectCache {
+public:
+    virtual void notifyObjectCompiled (const llvm::Module *M,
+                                       llvm::MemoryBufferRef obj) {
+        m_object.assign (obj.getBufferStart(), obj.getBufferSize());
+    }
+    virtual std::unique_ptr<llvm::MemoryBuffer> getObject (const llvm::Module *M) {
+        return nullptr;
+    }
+    std::string m_object;
+};
+#else
+class LLVM_Util::ObjectCache {
+public:
+    std::string m_object;
+};
+#endif
+
+
+
 #if OSL_LLVM_VERSION <= 38
 class LLVM_Util::IRBuilder : public llvm::IRBuilder<true,llvm::ConstantFolder,
                                         llvm::IRBuilderDefaultInserter<true> > {
@@ -329,7 +414,9 @@ LLVM_Util::LLVM_Util (int debuglevel)
       m_builder(NULL), m_llvm_jitmm(NULL),
       m_current_function(NULL),
       m_llvm_module_passes(NULL), m_llvm_func_passes(NULL),
-      m_llvm_exec(NULL)
+      m_llvm_exec(NULL), m_object_cache(NULL),
+      m_relocatable_pointers(false), m_fast_codegen(false),
+      m_target_isa("baseline")
 {
     SetupLLVM ();
     m_thread = PerThreadInfo::get();
@@ -340,21 +427,16 @@ LLVM_Util::LLVM_Util (int debuglevel)
         if (! m_thread->llvm_context)
             m_thread->llvm_context = new llvm::LLVMContext();
 
-        if (! m_thread->llvm_jitmm) {
 #if USE_OLD_JIT
+        if (! m_thread->llvm_jitmm) {
             m_thread->llvm_jitmm = llvm::JITMemoryManager::CreateDefaultMemManager();
-#else
-            m_thread->llvm_jitmm = new LLVMMemoryManager;
-#endif
             ASSERT (m_thread->llvm_jitmm);
             jitmm_hold.push_back (std::shared_ptr<LLVMMemoryManager>(m_thread->llvm_jitmm));
         }
-#if USE_OLD_JIT
         m_llvm_jitmm = new MemoryManager(m_thread->llvm_jitmm);
-#else
-        // Hold the REAL manager and use it as an argument later
-        m_llvm_jitmm = reinterpret_cast<MemoryManager*>(m_thread->llvm_jitmm);
 #endif
+        // For MCJIT, each engine gets its own JITMemory, which is created
+        // in make_jit_execengine.
     }
 
     m_llvm_context = m_thread->llvm_context;
@@ -392,6 +474,8 @@ LLVM_Util::LLVM_Util (int debuglevel)
 LLVM_Util::~LLVM_Util ()
 {
     execengine (NULL);
+    release_jit_memory ();
+    delete m_object_cache;
     delete m_llvm_module_passes;
     delete m_llvm_func_passes;
     delete m_builder;
@@ -566,6 +650,58 @@ LLVM_Util::module_from_bitcode (const char *bitcode, size_t size,
 }
 
 
+llvm::Module *
+LLVM_Util::module_from_bitcode_template (const char *bitcode, size_t size,
+                                         const std::string &name,
+                                         std::string *err, double *parse_time)
+{
+#if USE_MCJIT
+    if (err)
+        err->clear();
+
+    // MCJIT will need every function body anyway, so rather than lazily
+    // deserializing the whole bitcode for every module, fully parse it
+    // once per thread and hand out copies of that.
+    PerThreadInfo *t = m_thread;
+    if (t->bitcode_template_src != bitcode) {
+        delete t->bitcode_template;
+        t->bitcode_template = NULL;
+        t->bitcode_template_src = NULL;
+        OIIO::Timer timer;
+        llvm::Module *m = module_from_bitcode (bitcode, size, name, err);
+        if (! m)
+            return NULL;
+# if OSL_LLVM_VERSION >= 38
+        LLVMErr merr = m->materializeAll();
+# else
+        LLVMErr merr = m->materializeAllPermanently();
+# endif
+        if (error_string (std::move(merr), err)) {
+            delete m;
+            return NULL;
+        }
+        t->bitcode_template = m;
+        t->bitcode_template_src = bitcode;
+        t->bitcode_template_parse_time = timer();
+    }
+    if (parse_time)
+        *parse_time = t->bitcode_template_parse_time;
+# if OSL_LLVM_VERSION >= 38
+    return llvm::CloneModule (t->bitcode_template).release();
+# else
+    return llvm::CloneModule (t->bitcode_template);
+# endif
+#else
+    // The old JIT materializes functions lazily, as needed, so a fresh
+    // lazy module is already the cheap option.
+    if (parse_time)
+        *parse_time = 0.0;
+    return module_from_bitcode (bitcode, size, name, err);
+#endif
+}
+
+
+
 void
 LLVM_Util::new_builder (llvm::BasicBlock *block)
 {
@@ -615,12 +751,25 @@ LLVM_Util::make_jit_execengine (std::string *err)
     // N.B. createJIT will take ownership of the the JITMemoryManager!
     engine_builder.setUseMCJIT (0);
 #else
-    // We are actually holding a LLVMMemoryManager
+    // Give each engine its own memory, so that the code can be freed
+    // when whoever holds jit_memory() is done with it.
+    release_jit_memory ();
+    m_jit_memory.reset (new JITMemory);
     engine_builder.setMCJITMemoryManager (std::unique_ptr<llvm::RTDyldMemoryManager>
-        (new MemoryManager(reinterpret_cast<LLVMMemoryManager*>(m_llvm_jitmm))));
+        (new MemoryManager(m_jit_memory.get())));
 #endif /* USE_OLD_JIT */
 
-    engine_builder.setOptLevel (llvm::CodeGenOpt::Default);
+    if (m_fast_codegen) {
+        engine_builder.setOptLevel (llvm::CodeGenOpt::None);
+        llvm::TargetOptions options;
+        options.EnableFastISel = true;
+        engine_builder.setTargetOptions (options);
+    } else {
+        engine_builder.setOptLevel (llvm::CodeGenOpt::Default);
+    }
+    std::string cpu = target_cpu (m_target_isa);
+    if (cpu.size())
+        engine_builder.setMCPU (cpu);
 
     m_llvm_exec = engine_builder.create();
     if (! m_llvm_exec)
@@ -636,6 +785,20 @@ LLVM_Util::make_jit_execengine (std::string *err)
 
 
 
+void
+LLVM_Util::release_jit_memory ()
+{
+    // If nobody took responsibility for the JIT memory, any functions we
+    // handed out must stay valid forever, as they always have.
+    if (m_jit_memory && m_jit_memory.use_count() == 1) {
+        OIIO::spin_lock lock (llvm_global_mutex);
+        jit_memory_hold.push_back (m_jit_memory);
+    }
+    m_jit_memory.reset ();
+}
+
+
+
 void
 LLVM_Util::execengine (llvm::ExecutionEngine *exec)
 {
@@ -659,6 +822,196 @@ LLVM_Util::getPointerToFunction (llvm::Function *func)
 
 
 
+void *
+LLVM_Util::getPointerToFunction (const std::string &name)
+{
+    llvm::ExecutionEngine *exec = execengine();
+#if USE_MCJIT
+    exec->finalizeObject ();
+    return (void *) exec->getFunctionAddress (name);
+#else
+    llvm::Function *func = module()->getFunction (name);
+    return func ? exec->getPointerToFunction (func) : NULL;
+#endif
+}
+
+
+
+bool
+LLVM_Util::save_object_code ()
+{
+    if (! m_object_cache)
+        m_object_cache = new ObjectCache;
+    m_object_cache->m_object.clear ();
+    m_relocatable_symbols.clear ();
+#if USE_MCJIT
+    execengine()->setObjectCache (m_object_cache);
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+
+const std::string &
+LLVM_Util::object_code () const
+{
+    static std::string empty;
+    return m_object_cache ? m_object_cache->m_object : empty;
+}
+
+
+
+bool
+LLVM_Util::add_object_code (const std::string &obj, std::string *err)
+{
+    if (err)
+        err->clear ();
+#if USE_MCJIT && OSL_LLVM_VERSION >= 37
+    std::unique_ptr<llvm::MemoryBuffer> buf (
+        llvm::MemoryBuffer::getMemBufferCopy (obj, "cached object"));
+# if OSL_LLVM_VERSION >= 40
+    llvm::Expected<std::unique_ptr<llvm::object::ObjectFile> > objfile =
+        llvm::object::ObjectFile::createObjectFile (buf->getMemBufferRef());
+    if (! objfile) {
+        error_string (objfile.takeError(), err);
+        return false;
+    }
+# else
+    llvm::ErrorOr<std::unique_ptr<llvm::object::ObjectFile> > objfile =
+        llvm::object::ObjectFile::createObjectFile (buf->getMemBufferRef());
+    if (! objfile) {
+        error_string (objfile.getError(), err);
+        return false;
+    }
+# endif
+    execengine()->addObjectFile (llvm::object::OwningBinary<llvm::object::ObjectFile>
+                                     (std::move(*objfile), std::move(buf)));
+    return true;
+#else
+    if (err)
+        *err = "loading object code is not supported for this LLVM version";
+    return false;
+#endif
+}
+
+
+
+llvm::GlobalVariable *
+LLVM_Util::external_symbol (const std::string &name, void *addr, size_t size)
+{
+    llvm::GlobalVariable *g = module()->getNamedGlobal (name);
+    if (! g) {
+        // Unless we know its size, declare it as an array of unknown
+        // length (like C's "extern char name[];") so that LLVM makes no
+        // assumptions about the size of whatever lives at that address.
+        // Symbols of known, nonzero size are known to be distinct
+        // objects, so comparisons of their addresses may be folded.
+        g = new llvm::GlobalVariable (*module(), type_array (type_char(), size),
+                                      false, llvm::GlobalValue::ExternalLinkage,
+                                      NULL, name);
+        execengine()->addGlobalMapping (g, addr);
+        m_relocatable_symbols.push_back (name);
+    }
+    return g;
+}
+
+
+
+void
+LLVM_Util::add_symbol_mapping (const std::string &name, void *addr)
+{
+    external_symbol (name, addr);
+}
+
+
+
+// Is v still referred to by code, either directly or by way of constant
+// expressions, initializers, and the globals they initialize?
+static bool
+referenced_by_code (const llvm::Value *v)
+{
+    for (const llvm::User *u : v->users()) {
+        if (llvm::isa<llvm::Instruction>(u))
+            return true;
+        if (llvm::isa<llvm::Constant>(u) && referenced_by_code (u))
+            return true;
+    }
+    return false;
+}
+
+
+
+std::vector<std::string>
+LLVM_Util::relocatable_symbols ()
+{
+    // The optimizer may well have folded away every use of some of them
+    // (string comparisons, for example), in which case they aren't in
+    // the object code and needn't be bound again.
+    std::vector<std::string> used;
+    for (const std::string &name : m_relocatable_symbols) {
+        llvm::GlobalVariable *g = module()->getNamedGlobal (name);
+        if (g && referenced_by_code (g))
+            used.push_back (name);
+    }
+    return used;
+}
+
+
+
+std::string
+LLVM_Util::target_cpu (const std::string &isa)
+{
+    if (isa.empty() || isa == "baseline")
+        return std::string();   // the triple's own default CPU
+    if (isa == "host")
+        return llvm::sys::getHostCPUName().str();
+    return isa;
+}
+
+
+
+std::string
+LLVM_Util::jit_target (const std::string &isa)
+{
+    std::string cpu = target_cpu (isa);
+    return OIIO::Strutil::format ("LLVM %s %s %s", OSL_LLVM_FULL_VERSION,
+                                  llvm::sys::getProcessTriple(),
+                                  cpu.size() ? cpu : std::string("baseline"));
+}
+
+
+
+std::string
+LLVM_Util::symbol_encode (OIIO::string_view s)
+{
+    static const char hexdigits[] = "0123456789abcdef";
+    std::string r;
+    r.reserve (2*s.size());
+    for (unsigned char c : s) {
+        r += hexdigits[c >> 4];
+        r += hexdigits[c & 15];
+    }
+    return r;
+}
+
+
+
+std::string
+LLVM_Util::symbol_decode (OIIO::string_view s)
+{
+    std::string r;
+    r.reserve (s.size()/2);
+    for (size_t i = 0; i+1 < s.size(); i += 2) {
+        char hex[3] = { s[i], s[i+1], 0 };
+        r += (char) strtol (hex, NULL, 16);
+    }
+    return r;
+}
+
+
+
 void
 LLVM_Util::InstallLazyFunctionCreator (void* (*P)(const std::string &))
 {
@@ -718,7 +1071,13 @@ LLVM_Util::setup_optimization_passes (int optlevel)
 
 #endif
 
-    if (optlevel >= 1 && optlevel <= 3) {
+    if (optlevel < 0) {
+        // Just the bare minimum to turn our naive IR (every variable in
+        // memory, lots of tiny basic blocks) into something that won't
+        // run terribly, as cheaply as possible.
+        mpm.add (llvm::createPromoteMemoryToRegisterPass());
+        mpm.add (llvm::createCFGSimplificationPass());
+    } else if (optlevel >= 1 && optlevel <= 3) {
         // For LLVM 3.0 and higher, llvm_optimize 1-3 means to use the
         // same set of optimizations as clang -O1, -O2, -O3
         llvm::PassManagerBuilder builder;
@@ -1145,9 +1504,41 @@ LLVM_Util::constant_ptr (void *p, llvm::PointerType *type)
 
 
 
+llvm::Value *
+LLVM_Util::constant_ptr (void *p, const std::string &name,
+                         llvm::PointerType *type)
+{
+    if (! m_relocatable_pointers || ! p)
+        return constant_ptr (p, type);
+    if (! type)
+        type = type_void_ptr();
+    return builder().CreatePointerCast (external_symbol (name, p), type);
+}
+
+
+
+llvm::Constant *
+LLVM_Util::ustring_constant (ustring s)
+{
+    if (! s.c_str())
+        return llvm::ConstantPointerNull::get ((llvm::PointerType *)type_string());
+    // The ustring's characters are encoded in the symbol name, so that
+    // it can be re-interned when the code is relinked.  Since distinct
+    // ustrings are distinct objects, giving the symbol its true size
+    // lets LLVM fold string comparisons just as when the ustrings' own
+    // addresses are baked into the code.
+    llvm::GlobalVariable *g = external_symbol ("oslreloc_ustring_" + symbol_encode (s.string()),
+                                               (void *)s.c_str(), s.length()+1);
+    return llvm::ConstantExpr::getPointerCast (g, type_string());
+}
+
+
+
 llvm::Value *
 LLVM_Util::constant (ustring s)
 {
+    if (m_relocatable_pointers && s.c_str())
+        return ustring_constant (s);
     // Create a const size_t with the ustring contents
     size_t bits = sizeof(size_t)*8;
     llvm::Value *str = llvm::ConstantInt::get (context(),
@@ -1167,6 +1558,37 @@ LLVM_Util::constant (const TypeDesc &type)
 
 
 
+llvm::Value *
+LLVM_Util::constant_data (const TypeDesc &type, const void *data)
+{
+    size_t n = type.numelements() * type.aggregate;
+    llvm::Constant *init = NULL;
+    if (type.basetype == TypeDesc::FLOAT) {
+        init = llvm::ConstantDataArray::get (context(),
+                   llvm::ArrayRef<float> ((const float *)data, n));
+    } else if (type.basetype == TypeDesc::INT) {
+        init = llvm::ConstantDataArray::get (context(),
+                   llvm::ArrayRef<uint32_t> ((const uint32_t *)data, n));
+    } else if (type.basetype == TypeDesc::UINT64) {
+        init = llvm::ConstantDataArray::get (context(),
+                   llvm::ArrayRef<uint64_t> ((const uint64_t *)data, n));
+    } else if (type.basetype == TypeDesc::STRING) {
+        std::vector<llvm::Constant *> strs;
+        for (size_t i = 0; i < n; ++i)
+            strs.push_back (ustring_constant (((const ustring *)data)[i]));
+        init = llvm::ConstantArray::get (llvm::ArrayType::get (type_string(), n),
+                                         strs);
+    } else {
+        ASSERT_MSG (0, "constant_data: unsupported type %s", type.c_str());
+    }
+    llvm::GlobalVariable *g = new llvm::GlobalVariable (*module(), init->getType(),
+                                  true, llvm::GlobalValue::PrivateLinkage,
+                                  init, "constdata");
+    return void_ptr (g);
+}
+
+
+
 llvm::Value *
 LLVM_Util::void_ptr_null ()
 {
@@ -1429,6 +1851,22 @@ LLVM_Util::op_load (llvm::Value *ptr)
 
 
 
+llvm::Value *
+LLVM_Util::op_load_acquire (llvm::Value *ptr)
+{
+    llvm::LoadInst *load = builder().CreateLoad (ptr);
+    // Atomic loads need an explicit alignment.
+    load->setAlignment (sizeof(void*));
+#if OSL_LLVM_VERSION >= 39
+    load->setAtomic (llvm::AtomicOrdering::Acquire);
+#else
+    load->setAtomic (llvm::Acquire);
+#endif
+    return load;
+}
+
+
+
 void
 LLVM_Util::op_store (llvm::Value *val, llvm::Value *ptr)
 {
@@ -574,27 +574,50 @@ ShadingSystemImpl::loadshader (string_view cname)
     }
     ++m_stat_shaders_requested;
     ustring name (cname);
-    lock_guard guard (m_mutex);  // Thread safety
-    ShaderNameMap::const_iterator found = m_shader_masters.find (name);
-    if (found != m_shader_masters.end()) {
+    std::promise<ShaderMaster::ref> promise;
+    ShaderMasterFuture found;
+    {
+        spin_lock guard (m_shader_masters_mutex);  // Thread safety
+        ShaderNameMap::const_iterator f = m_shader_masters.find (name);
+        if (f != m_shader_masters.end())
+            found = f->second;
+        else {
+            // Not found in the map -- we'll load it. Other threads asking
+            // for the same shader in the meantime will wait for us.
+            m_shader_masters[name] = promise.get_future().share();
+        }
+    }
+    if (found.valid()) {
         // if (debug())
         //     info ("Found %s in shader_masters", name.c_str());
-        // Already loaded this shader, return its reference
-        return (*found).second;
+        // Already loaded (or being loaded by another thread), return its
+        // reference once it's ready.
+        return wait_for_master (found);
     }
 
-    // Not found in the map
+    // Only copying the searchpath needs the global lock (attribute() may
+    // be changing it); the search and parse don't.
+    std::vector<std::string> searchpath_dirs;
+    {
+        lock_guard guard (m_mutex);
+        searchpath_dirs = m_searchpath_dirs;
+    }
     OSOReaderToMaster oso (*this);
     std::string filename = OIIO::Filesystem::searchpath_find (name.string() + ".oso",
-                                                        m_searchpath_dirs);
+                                                        searchpath_dirs);
     if (filename.empty ()) {
         error ("No .oso file could be found for shader \"%s\"", name.c_str());
+        // Don't remember the failure, the searchpath may change.
+        {
+            spin_lock guard (m_shader_masters_mutex);
+            m_shader_masters.erase (name);
+        }
+        promise.set_value (nullptr);
         return NULL;
     }
     OIIO::Timer timer;
     bool ok = oso.parse_file (filename);
     ShaderMaster::ref r = ok ? oso.master() : nullptr;
-    m_shader_masters[name] = r;
     double loadtime = timer();
     {
         spin_lock lock (m_stat_mutex);
@@ -615,11 +638,62 @@ ShadingSystemImpl::loadshader (string_view cname)
         error ("Unable to read \"%s\"", filename.c_str());
     }
 
+    promise.set_value (r);
     return r;
 }
 
 
 
+ShaderMaster::ref
+ShadingSystemImpl::wait_for_master (const ShaderMasterFuture &f)
+{
+    if (f.wait_for (std::chrono::seconds(0)) != std::future_status::ready) {
+        OIIO::Timer timer;
+        f.wait ();
+        double waittime = timer();
+        spin_lock lock (m_stat_mutex);
+        m_stat_master_load_wait_time += waittime;
+    }
+    return f.get ();
+}
+
+
+
+bool
+ShaderMaster::reload_code ()
+{
+    ASSERT (m_code_evicted);
+    OIIO::Timer timer;
+    OSOReaderToMaster oso (shadingsys());
+    if (! oso.parse_file (m_osofilename)) {
+        shadingsys().error ("Unable to reload code for shader \"%s\" from \"%s\"",
+                            m_shadername, m_osofilename);
+        return false;
+    }
+    ShaderMaster::ref fresh = oso.master();
+    if (code_hash (fresh->m_ops, fresh->m_args) != m_evicted_hash) {
+        shadingsys().error ("Shader \"%s\" changed on disk (\"%s\") after its code was evicted",
+                            m_shadername, m_osofilename);
+        return false;
+    }
+    // resolve_syms sets the ops' read/write flags. It also counts the
+    // fresh master's memory, which its destructor gives back except for
+    // the ops and args we take -- so the stats come out right.
+    fresh->resolve_syms ();
+    m_ops.swap (fresh->m_ops);
+    m_args.swap (fresh->m_args);
+    m_code_evicted = false;
+
+    ShadingSystemImpl &ss (shadingsys());
+    ss.m_stat_master_code_reloads += 1;
+    double loadtime = timer();
+    spin_lock lock (ss.m_stat_mutex);
+    ss.m_stat_master_load_time += loadtime;
+    return true;
+}
+
+
+
 bool
 ShadingSystemImpl::LoadMemoryCompiledShader (string_view shadername,
                                              string_view buffer)
@@ -634,20 +708,25 @@ ShadingSystemImpl::LoadMemoryCompiledShader (string_view shadername,
     }
 
     ustring name (shadername);
-    lock_guard guard (m_mutex);  // Thread safety
-    ShaderNameMap::const_iterator found = m_shader_masters.find (name);
-    if (found != m_shader_masters.end()) {
+    std::promise<ShaderMaster::ref> promise;
+    bool exists = false;
+    {
+        spin_lock guard (m_shader_masters_mutex);  // Thread safety
+        if (m_shader_masters.find (name) != m_shader_masters.end())
+            exists = true;
+        else   // Not found in the map
+            m_shader_masters[name] = promise.get_future().share();
+    }
+    if (exists) {
         if (debug())
             info ("Preload shader %s already exists in shader_masters", name.c_str());
         return false;
     }
 
-    // Not found in the map
     OSOReaderToMaster reader (*this);
     OIIO::Timer timer;
     bool ok = reader.parse_memory (buffer);
     ShaderMaster::ref r = ok ? reader.master() : nullptr;
-    m_shader_masters[name] = r;
     double loadtime = timer();
     {
         spin_lock lock (m_stat_mutex);
@@ -668,6 +747,7 @@ ShadingSystemImpl::LoadMemoryCompiledShader (string_view shadername,
         error ("Unable to parse preloaded shader \"%s\"", shadername);
     }
 
+    promise.set_value (r);
     return true;
 }
 
@@ -34,6 +34,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <OpenImageIO/strutil.h>
 #include <OpenImageIO/dassert.h>
+#include <OpenImageIO/hash.h>
 #include <OpenImageIO/thread.h>
 
 #include "oslexec_pvt.h"
@@ -72,6 +73,83 @@ ShaderMaster::~ShaderMaster ()
 
 
 
+void
+ShaderMaster::retain_code ()
+{
+    lock_guard lock (m_code_mutex);
+    ++m_code_users;
+}
+
+
+
+void
+ShaderMaster::release_code ()
+{
+    lock_guard lock (m_code_mutex);
+    DASSERT (m_code_users > 0);
+    if (--m_code_users == 0 && ! m_code_evicted &&
+          shadingsys().evict_master_code())
+        evict_code ();
+}
+
+
+
+size_t
+ShaderMaster::code_hash (const OpcodeVec &ops, const std::vector<int> &args)
+{
+    // FNV-1a.  ustrings are unique, so their pointers may stand in for
+    // the chars.
+    size_t h = size_t(14695981039346656037ULL);
+    auto add = [&](size_t val) {
+        const unsigned char *c = (const unsigned char *)&val;
+        for (size_t i = 0;  i < sizeof(val);  ++i)
+            h = (h ^ c[i]) * size_t(1099511628211ULL);
+    };
+    add (ops.size());
+    for (auto&& op : ops) {
+        add ((size_t) op.opname().c_str());
+        add ((size_t) op.method().c_str());
+        add ((size_t) op.firstarg());
+        add ((size_t) op.nargs());
+        for (unsigned int j = 0;  j < Opcode::max_jumps;  ++j)
+            add ((size_t) op.jump(j));
+        add ((size_t) op.sourcefile().c_str());
+        add ((size_t) op.sourceline());
+    }
+    add (args.size());
+    for (int a : args)
+        add ((size_t) a);
+    return h;
+}
+
+
+
+void
+ShaderMaster::evict_code ()
+{
+    // Masters that came from memory buffers have no .oso to reload
+    // from, so they keep their code.
+    if (m_osofilename == "<none>" || m_ops.empty())
+        return;
+    size_t opmem = vectorbytes (m_ops);
+    size_t argmem = vectorbytes (m_args);
+    m_evicted_hash = code_hash (m_ops, m_args);
+    OpcodeVec().swap (m_ops);
+    std::vector<int>().swap (m_args);
+    m_code_evicted = true;
+
+    ShadingSystemImpl &ss (shadingsys());
+    ss.m_stat_master_code_evictions += 1;
+    ss.m_stat_master_code_evicted_bytes += (long long)(opmem + argmem);
+    OIIO::spin_lock lock (ss.m_stat_mutex);
+    ss.m_stat_mem_master_ops -= opmem;
+    ss.m_stat_mem_master_args -= argmem;
+    ss.m_stat_mem_master -= opmem + argmem;
+    ss.m_stat_memory -= opmem + argmem;
+}
+
+
+
 int
 ShaderMaster::findsymbol (ustring name) const
 {
@@ -194,6 +272,70 @@ ShaderMaster::resolve_syms ()
     }
     // std::cout << shadername() << " has raytypes bits " << m_raytype_queries << "\n";
 
+    // Figure out which attributes of the object being shaded are asked
+    // for by name (the same forms that constfold_getattribute folds)
+    m_object_attribute_queries.clear ();
+    for (auto&& op : m_ops) {
+        if (op.opname() != Strings::getattribute)
+            continue;
+        int nargs = op.nargs();
+        if (nargs >= 4 && symbol(m_args[op.firstarg()+2])->typespec().is_string())
+            continue;   // names an object
+        const Symbol *Attribute (symbol(m_args[op.firstarg()+1]));
+        const Symbol *Index (symbol(m_args[op.firstarg()+nargs-2]));
+        const Symbol *Dest (symbol(m_args[op.firstarg()+nargs-1]));
+        bool array_lookup = Index->typespec().is_int();
+        if (! Attribute->is_constant() ||
+              (array_lookup && ! Index->is_constant()) ||
+              Dest->typespec().is_array())
+            continue;
+        ObjectAttributeQuery q (*(const ustring *)Attribute->data(),
+                                Dest->typespec().simpletype(),
+                                array_lookup ? *(const int *)Index->data() : -1);
+        if (std::find (m_object_attribute_queries.begin(),
+                       m_object_attribute_queries.end(), q)
+              == m_object_attribute_queries.end())
+            m_object_attribute_queries.push_back (q);
+    }
+
+    // Digest the code.  Strings are hashed by their characters, not by
+    // their (process-specific) ustring pointers.
+    std::ostringstream code;
+    code << shadertypename() << ' ' << m_shadername << ' ' << m_firstparam
+         << ' ' << m_lastparam << ' ' << m_maincodebegin << ' '
+         << m_maincodeend << '\n';
+    for (auto&& s : m_symbols) {
+        code << "sym " << s.name() << ' ' << int(s.symtype()) << ' '
+             << s.typespec().c_str() << ' ' << s.size() << ' '
+             << s.lockgeom() << ' ' << int(s.valuesource()) << ' '
+             << s.fieldid() << ' ' << s.initbegin() << ' ' << s.initend();
+        if (s.data() && s.size() > 0) {
+            if (s.typespec().simpletype().basetype == TypeDesc::STRING) {
+                const ustring *strs = (const ustring *) s.data();
+                for (int i = 0, n = s.size() / int(sizeof(ustring)); i < n; ++i)
+                    code << ' ' << strs[i].length() << ':' << strs[i];
+            } else {
+                code << ' ';
+                code.write ((const char *)s.data(), s.size());
+            }
+        }
+        code << '\n';
+    }
+    for (auto&& op : m_ops) {
+        code << "op " << op.opname() << ' ' << op.method() << ' '
+             << op.firstarg() << ' ' << op.nargs();
+        for (unsigned int j = 0;  j < Opcode::max_jumps;  ++j)
+            code << ' ' << op.jump(j);
+        code << ' ' << op.argread_bits() << ' ' << op.argwrite_bits()
+             << ' ' << op.argtakesderivs_all() << ' ' << op.sourcefile()
+             << ' ' << op.sourceline() << '\n';
+    }
+    code << "args";
+    for (int a : m_args)
+        code << ' ' << a;
+    std::string key = code.str();
+    m_code_digest = OIIO::SHA1 (key.data(), key.size()).digest();
+
     // Adjust statistics
     size_t opmem = vectorbytes (m_ops);
     size_t argmem = vectorbytes (m_args);
@@ -195,7 +195,7 @@ osl_error (ShaderGlobals *sg, const char* format_str, ...)
     va_start (args, format_str);
     std::string s = Strutil::vformat (format_str, args);
     va_end (args);
-    sg->context->error ("%s", s);
+    sg->context->record_error (ErrorHandler::EH_ERROR, s, format_str);
 }
 
 
@@ -207,7 +207,7 @@ osl_warning (ShaderGlobals *sg, const char* format_str, ...)
         va_start (args, format_str);
         std::string s = Strutil::vformat (format_str, args);
         va_end (args);
-        sg->context->warning ("%s", s);
+        sg->context->record_error (ErrorHandler::EH_WARNING, s, format_str);
     }
 }
 
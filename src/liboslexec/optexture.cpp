@@ -258,6 +258,7 @@ osl_texture (void *sg_, const char *name, void *handle,
     // It's actually faster to ask for 4 channels (even if we need fewer)
     // and ensure that they're being put in aligned memory.
     OIIO::simd::float4 result_simd, dresultds_simd, dresultdt_simd;
+    ExecProfileTimer prof ((ShadingContext *)sg->context, ExecProfile::Texture);
     bool ok = sg->renderer->texture (USTR(name),
                                      (TextureSystem::TextureHandle *)handle, NULL,
                                      *opt, sg, s, t, dsdx, dtdx, dsdy, dtdy, 4,
@@ -312,6 +313,7 @@ osl_texture3d (void *sg_, const char *name, void *handle,
     // It's actually faster to ask for 4 channels (even if we need fewer)
     // and ensure that they're being put in aligned memory.
     OIIO::simd::float4 result_simd, dresultds_simd, dresultdt_simd, dresultdr_simd;
+    ExecProfileTimer prof ((ShadingContext *)sg->context, ExecProfile::Texture);
     bool ok = sg->renderer->texture3d (USTR(name),
                                        (TextureSystem::TextureHandle *)handle, NULL,
                                        *opt, sg, P, dPdx, dPdy, dPdz,
@@ -369,6 +371,7 @@ osl_environment (void *sg_, const char *name, void *handle,
     // It's actually faster to ask for 4 channels (even if we need fewer)
     // and ensure that they're being put in aligned memory.
     OIIO::simd::float4 local_result;
+    ExecProfileTimer prof ((ShadingContext *)sg->context, ExecProfile::Texture);
     bool ok = sg->renderer->environment (USTR(name),
                                          (TextureSystem::TextureHandle *)handle,
                                          NULL, *opt, sg, R, dRdx, dRdy, 4,
@@ -480,6 +483,7 @@ osl_trace (void *sg_, void *opt_, void *Pos_, void *dPosdx_, void *dPosdy_,
     const Vec3 *Dir = (Vec3 *)Dir_;
     const Vec3 *dDirdx = dDirdx_ ? (Vec3 *)dDirdx_ : &Zero;
     const Vec3 *dDirdy = dDirdy_ ? (Vec3 *)dDirdy_ : &Zero;
+    ExecProfileTimer prof ((ShadingContext *)sg->context, ExecProfile::Trace);
     return sg->renderer->trace (*opt, sg, *Pos, *dPosdx, *dPosdy,
                                 *Dir, *dDirdx, *dDirdy);
 }
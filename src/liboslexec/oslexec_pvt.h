@@ -35,7 +35,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory>
 #include <list>
 #include <set>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <future>
 #include <unordered_map>
+#include <algorithm>
 
 #include <boost/thread/tss.hpp>   /* for thread_specific_ptr */
 
@@ -43,6 +50,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OpenImageIO/thread.h>
 #include <OpenImageIO/paramlist.h>
 #include <OpenImageIO/refcnt.h>
+#include <OpenImageIO/timer.h>
 
 #ifdef USE_BOOST_REGEX
 # include <boost/regex.hpp>
@@ -53,6 +61,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OSL/genclosure.h>
 #include <OSL/oslexec.h>
 #include <OSL/oslclosure.h>
+#include <OSL/llvm_util.h>
 #include "osl_pvt.h"
 #include "constantpool.h"
 
@@ -126,7 +135,7 @@ namespace Strings {
     extern ustring end, useparam;
     extern ustring uninitialized_string;
     extern ustring unull;
-    extern ustring raytype;
+    extern ustring raytype, getattribute;
     extern ustring color, point, vector, normal, matrix;
     extern ustring unknown;
     extern ustring _emptystring_;
@@ -142,6 +151,10 @@ class ShaderInstance;
 typedef std::shared_ptr<ShaderInstance> ShaderInstanceRef;
 class Dictionary;
 class RuntimeOptimizer;
+struct SpecializedInstance;
+typedef std::shared_ptr<SpecializedInstance> SpecializedInstanceRef;
+struct InstanceParams;
+typedef std::shared_ptr<const InstanceParams> InstanceParamsRef;
 class BackendLLVM;
 struct ConnectedParam;
 
@@ -151,6 +164,9 @@ void print_closure (std::ostream &out, const ClosureColor *closure, ShadingSyste
 /// group.
 typedef void (*RunLLVMGroupFunc)(void* /* shader globals */, void*);
 
+/// Byte ranges (offset, length) within a group's groupdata.
+typedef std::vector<std::pair<int,int> > GroupdataSpans;
+
 /// Signature of a constant-folding method
 typedef int (*OpFolder) (RuntimeOptimizer &rop, int opnum);
 
@@ -227,6 +243,143 @@ struct AttributeNeeded {
     }
 };
 
+// An attribute of the object being shaded that a shader asks for by a
+// constant name: getattribute (name, value) or getattribute (name,
+// index, value).
+struct ObjectAttributeQuery {
+    ustring name;
+    TypeDesc type;
+    int index;          ///< Array element asked for, or -1
+
+    ObjectAttributeQuery (ustring name, TypeDesc type, int index)
+        : name(name), type(type), index(index) {}
+
+    friend bool operator== (const ObjectAttributeQuery &a,
+                            const ObjectAttributeQuery &b) {
+        return a.name == b.name && a.type == b.type && a.index == b.index;
+    }
+};
+
+
+
+/// Where the runtime optimizer spends its time: the cost of each of its
+/// passes and of each op's constant folder, gathered when the
+/// "opt_profile" option is set.
+struct OptProfile {
+    struct Entry {
+        double time = 0;        ///< Total time spent
+        long long calls = 0;    ///< Number of times run
+        long long changes = 0;  ///< Number of changes made to the code
+    };
+    enum Pass {
+        CopyCode, ResolveIsconnected, SimplifyParams, ParamsHoldingGlobals,
+        BasicBlocks, OptimizeOps, VariableLifetimes, EliminateMiddleman,
+        RemoveUnusedParams, MergeInstances, VariableDependencies,
+        AddUseparam, CoalesceTemporaries, CollapseSyms, CollapseOps,
+        NumPasses
+    };
+    Entry passes[NumPasses];
+    std::map<ustring,Entry> folders;  ///< Constant folders, by op name
+    long long layer_passes = 0;   ///< Passes over all the layers' code
+    long long idle_passes = 0;    ///< ...of which changed nothing
+
+    /// Name of the pass, as it appears in reports.
+    static const char *pass_name (int pass);
+
+    /// Add in the profile of another optimization.
+    void merge (const OptProfile &p);
+
+    /// Print the profile for getstats(); print the full list of folders
+    /// only at level 3 and above.
+    void print (std::ostream &out, int level) const;
+
+    /// The profile as a JSON object.
+    std::string json () const;
+};
+
+
+
+/// The error messages, warnings, and printf output of one shader
+/// execution, queued for delivery to the ErrorHandler (see
+/// ShadingSystemImpl::queue_errors).
+struct ErrorBatch {
+    typedef std::pair<ErrorHandler::ErrCode, std::string> Item;
+    std::vector<Item> items;
+};
+
+/// Batches waiting for the error thread (see the "error_thread" option)
+/// to deliver them, in the order they were queued.  Any number of
+/// threads may push, and one thread pops; neither ever waits on a lock.
+/// A push that finds all capacity slots taken fails, rather than wait
+/// for the error thread to catch up.  (This is Vyukov's bounded queue:
+/// each slot's sequence number says whether it's ready to be written
+/// or read for a given position.)
+class ErrorQueue {
+public:
+    static const size_t capacity = 4096;    // must be a power of 2
+
+    ErrorQueue ();
+
+    /// Queue the batch, taking its items.  Return false, leaving the
+    /// batch alone, if the queue is full.
+    bool push (ErrorBatch &batch);
+
+    /// Take the oldest batch into 'batch', or return false if there's
+    /// none (or it's still being written).  Only one thread may pop.
+    bool pop (ErrorBatch &batch);
+
+    /// Number of batches ever pushed, including any still being written.
+    size_t pushed () const { return m_push_pos.load(); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        ErrorBatch batch;
+    };
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<size_t> m_push_pos;
+    std::atomic<size_t> m_pop_pos;
+};
+
+
+
+/// Where execution of a shader group spends its time: each layer's own
+/// time (not counting the upstream layers it runs) and number of runs,
+/// and the time spent in renderer callbacks, gathered when the "profile"
+/// option is 2 or more.
+struct ExecProfile {
+    struct Entry {
+        long long ticks = 0;    ///< Total time spent (timer ticks)
+        long long calls = 0;    ///< Number of times run
+    };
+    enum Callback {
+        Texture, Getattribute, Trace, Pointcloud, NumCallbacks
+    };
+    std::vector<Entry> layers;        ///< By layer index
+    std::vector<ustring> layernames;  ///< Names, filled in for reports
+    ustring groupname;                ///< Filled in for reports
+    Entry callbacks[NumCallbacks];
+
+    /// Name of the callback, as it appears in reports.
+    static const char *callback_name (int callback);
+
+    /// Forget everything, and make room for nlayers layers.
+    void clear (int nlayers);
+
+    /// Add in the profile of another execution of the same group.
+    void merge (const ExecProfile &p);
+
+    /// Total time over all the layers.
+    long long total_ticks () const;
+
+    /// Print the profile of one group for getstats(); at levels below 3,
+    /// list only the most expensive layers.
+    void print (std::ostream &out, int level) const;
+
+    /// The profile as a JSON object.
+    std::string json () const;
+};
+
 // Prefix for OSL shade op declarations. Make them local visibility, but
 // "C" linkage (no C++ name mangling).
 #define OSL_SHADEOP extern "C" OSL_DLL_LOCAL
@@ -358,7 +511,8 @@ inline void stlfree (T &v)
 class ShaderMaster : public RefCnt {
 public:
     typedef OIIO::intrusive_ptr<ShaderMaster> ref;
-    ShaderMaster (ShadingSystemImpl &shadingsys) : m_shadingsys(shadingsys) { }
+    ShaderMaster (ShadingSystemImpl &shadingsys)
+        : m_shadingsys(shadingsys), m_code_users(0), m_code_evicted(false) { }
     ~ShaderMaster ();
 
     std::string print ();  // Debugging
@@ -387,6 +541,7 @@ public:
         DASSERT (index < (int)m_symbols.size());
         return index >= 0 ? &m_symbols[index] : NULL;
     }
+    const SymbolVec &symbols () const { return m_symbols; }
 
     /// Return the name of the shader.
     ///
@@ -405,7 +560,40 @@ public:
 
     int raytype_queries () const { return m_raytype_queries; }
 
+    /// The attributes of the object being shaded that the code asks for
+    /// by constant name (see ShadingSystem::object_variant).
+    const std::vector<ObjectAttributeQuery> &object_attribute_queries () const {
+        return m_object_attribute_queries;
+    }
+
+    /// A digest of the master's code (symbols, default and constant
+    /// values, ops, and args) that, unlike code_hash(), is the same in
+    /// every process that loads the same shader.
+    const std::string &code_digest () const { return m_code_digest; }
+
+    /// Note that another instance will need to copy this master's code.
+    void retain_code ();
+
+    /// Note that an instance no longer needs this master's code (it has
+    /// copied it, or is going away).  When no instance needs the code
+    /// any more and the "evict_master_code" option is set, the ops and
+    /// args are freed; they are reloaded from the .oso if another
+    /// instance needs them later.
+    void release_code ();
+
+    /// Has the code been evicted?
+    bool code_evicted () const { return m_code_evicted; }
+
 private:
+    /// Free the ops and args. Call with m_code_mutex held.
+    void evict_code ();
+    /// Re-read the ops and args of an evicted master from its .oso
+    /// file, returning true on success. Call with m_code_mutex held.
+    bool reload_code ();
+    /// Hash of the code: everything about the ops and args that the
+    /// instances' symbols and optimizations depend on.
+    static size_t code_hash (const OpcodeVec &ops, const std::vector<int> &args);
+
     ShadingSystemImpl &m_shadingsys;    ///< Back-ptr to the shading system
     ShaderType m_shadertype;            ///< Type of shader
     std::string m_shadername;           ///< Shader name
@@ -423,6 +611,12 @@ private:
     int m_firstparam, m_lastparam;      ///< Subset of symbols that are params
     int m_maincodebegin, m_maincodeend; ///< Main shader code range
     int m_raytype_queries;              ///< Bitmask of raytypes queried
+    std::vector<ObjectAttributeQuery> m_object_attribute_queries;
+    std::string m_code_digest;          ///< See code_digest()
+    int m_code_users;                   ///< Instances yet to copy the code
+    bool m_code_evicted;                ///< Have the ops/args been freed?
+    size_t m_evicted_hash;              ///< code_hash() when evicted
+    mutable mutex m_code_mutex;         ///< Guards the code and its users
 
     friend class OSOReaderToMaster;
     friend class ShaderInstance;
@@ -513,9 +707,33 @@ public:
     ShaderGroupRef ShaderGroupBegin (string_view groupname,
                                      string_view usage,
                                      string_view groupspec);
+    ShaderGroupRef ShaderGroupCreate (string_view groupname = string_view());
+    bool Parameter (ShaderGroup &group, string_view name, TypeDesc t,
+                    const void *val, bool lockgeom);
+    bool Shader (ShaderGroup &group, string_view shaderusage,
+                 string_view shadername, string_view layername);
+    bool ConnectShaders (ShaderGroup &group,
+                         string_view srclayer, string_view srcparam,
+                         string_view dstlayer, string_view dstparam);
+    bool ShaderGroupEnd (ShaderGroup &group);
     bool ReParameter (ShaderGroup &group,
                       string_view layername, string_view paramname,
                       TypeDesc type, const void *val);
+    bool respecialize_group (ShaderGroup &group);
+    ShaderGroupRef object_variant (ShaderGroup &group,
+                                   const ParamValueList &attributes);
+    ShaderGroupRef object_variant (ShaderGroup &group, void *objdata);
+    /// ReParameter for an optimized group that keeps its unoptimized
+    /// layers, recording the change for respecialize_group.
+    bool reparameter_respecializable (ShaderGroup &group, int layerindex,
+                                      ustring paramname, TypeDesc type,
+                                      const void *val);
+    /// Respecialize into temp (a clone of the group, for respecializing)
+    /// just the layers that changed and those downstream of them, sharing
+    /// the others' optimized instances and code with the group.  Return
+    /// false, with the group as it was, if the whole group must be redone.
+    bool respecialize_downstream (ShaderGroup &group, ShaderGroup &temp,
+                                  const std::vector<int> &changed);
 
     // Internal error, warning, info, and message reporting routines that
     // take printf-like arguments.
@@ -559,9 +777,22 @@ public:
 #endif
 
     std::string getstats (int level=1) const;
+    std::string opt_profile_json () const;
+    std::string exec_profile_json () const;
 
     ErrorHandler &errhandler () const { return *m_err; }
 
+    /// Pass the messages from a shader execution (taking the contents of
+    /// items) to the ErrorHandler together: right away, or with the
+    /// "error_thread" option, by queueing them for the error thread.
+    /// Never waits for the error thread; if its queue is full, the
+    /// messages are dropped.
+    void queue_errors (std::vector<ErrorBatch::Item> &items);
+
+    /// Wait until everything queued for the error thread so far has
+    /// been delivered.
+    void flush_errors ();
+
     ShaderMaster::ref loadshader (string_view name);
 
     PerThreadInfo * create_thread_info();
@@ -574,7 +805,7 @@ public:
     void release_context (ShadingContext *ctx);
 
     bool execute (ShadingContext *ctx, ShaderGroup &group,
-                  ShaderGlobals &ssg, bool run=true);
+                  ShaderGlobals &ssg, bool run=true, bool *not_ready=NULL);
 
     const void* get_symbol (ShadingContext &ctx, ustring layername,
                             ustring symbolname, TypeDesc &type);
@@ -605,9 +836,20 @@ public:
     int llvm_debug () const { return m_llvm_debug; }
     int llvm_debug_layers () const { return m_llvm_debug_layers; }
     int llvm_debug_ops () const { return m_llvm_debug_ops; }
+    ustring llvm_cache_dir () const { return m_llvm_cache_dir; }
+    ustring llvm_target_isa () const { return m_llvm_target_isa; }
+    int llvm_split_layers () const { return m_llvm_split_layers; }
+    bool llvm_lazy_entry_layers () const { return m_llvm_lazy_entry_layers; }
+    bool allow_respecialize () const { return m_allow_respecialize; }
+    bool evict_master_code () const { return m_evict_master_code; }
+    bool llvm_tiered () const {
+        return m_llvm_tier_executions > 0 || m_llvm_tier_time > 0.0f;
+    }
     bool fold_getattribute () const { return m_opt_fold_getattribute; }
     bool opt_texture_handle () const { return m_opt_texture_handle; }
     int opt_passes() const { return m_opt_passes; }
+    bool opt_adaptive_passes() const { return m_opt_adaptive_passes; }
+    bool opt_profile() const { return m_opt_profile; }
     int max_warnings_per_thread() const { return m_max_warnings_per_thread; }
     bool countlayerexecs() const { return m_countlayerexecs; }
     bool lazy_userdata () const { return m_lazy_userdata; }
@@ -626,6 +868,17 @@ public:
     /// instances that were eliminated.
     int merge_instances (ShaderGroup &group, bool post_opt = false);
 
+    /// Make a new, unoptimized group with copies of the group's layers
+    /// (as they were before it was optimized, if it was) and the same
+    /// group-wide settings.  The caller must hold the group's lock.
+    ShaderGroupRef clone_group_unoptimized (const ShaderGroup &group);
+
+    /// Find or make the object variant of the group with the given key,
+    /// folding the given attributes.
+    ShaderGroupRef find_object_variant (ShaderGroup &group,
+                                        const std::string &key,
+                                        const ParamValueList &attributes);
+
     /// The group is set and won't be changed again; take advantage of
     /// this by optimizing the code knowing all our instance parameters
     /// (at least the ones that can't be overridden by the geometry).
@@ -674,7 +927,73 @@ public:
 
     int raytype_bit (ustring name);
 
-    void optimize_all_groups (int nthreads=0, int mythread=0, int totalthreads=1);
+    void optimize_all_groups (int nthreads=0);
+
+    void set_parallel_for (ShadingSystem::ParallelForFunc func) {
+        m_parallel_for = func;
+    }
+
+    /// Call task(i) for each i in [0,ntasks), concurrently if possible,
+    /// on the renderer's thread pool (see set_parallel_for) or else our
+    /// own.  Tasks must divide the work among themselves dynamically: if
+    /// the pool is already busy, task(0) alone may end up doing it all.
+    void parallel_for (int ntasks, const std::function<void(int)> &task);
+
+    /// Queue the group to be optimized and JITed by the background JIT
+    /// threads (starting them if needed), unless it's already optimized
+    /// or queued.  Used instead of optimize_group when the "async_jit"
+    /// option is set, so that the calling thread never blocks.
+    void async_optimize_group (ShaderGroup &group);
+
+    /// Queue all groups that have not yet been optimized.
+    void async_optimize_all_groups ();
+
+    /// Is the group optimized and ready to execute?
+    bool group_ready (const ShaderGroup &group) const;
+
+    /// Compile the group, or wait for the background JIT threads to.
+    bool wait_for_group (ShaderGroup &group);
+
+    /// Wait for the group's queued recompile at the full tier, if any.
+    bool wait_for_promotion (ShaderGroup &group);
+
+    /// If the group was compiled at the fast tier and has now become hot
+    /// enough (per the "llvm_tier_executions" and "llvm_tier_time"
+    /// options), queue it to be recompiled with full optimization.
+    void maybe_promote_group (ShaderGroup &group) {
+        if (group.m_llvm_promotable && ! group.m_llvm_promotion_queued &&
+            ((m_llvm_tier_executions > 0 &&
+              group.m_executions >= m_llvm_tier_executions) ||
+             (m_llvm_tier_time > 0.0f &&
+              OIIO::Timer::seconds (group.m_stat_total_shading_time_ticks) >= m_llvm_tier_time)))
+            promote_group (group);
+    }
+
+    /// Queue the group for the background JIT threads to recompile with
+    /// full optimization.
+    void promote_group (ShaderGroup &group);
+
+    /// Recompile a group that was compiled at the fast tier, with full
+    /// optimization, and swap in the new code.
+    void recompile_group (ShaderGroup &group);
+
+    /// Return the saved result of optimizing an instance whose
+    /// specialization is described by key (see RuntimeOptimizer::
+    /// specialization_key), or an empty ref if there is none.
+    SpecializedInstanceRef find_specialization (const std::string &key);
+
+    /// Save the result of optimizing an instance, for any other instance
+    /// with the same specialization.
+    void add_specialization (const std::string &key,
+                             const SpecializedInstanceRef &spec);
+
+    /// Forget all saved instance optimizations.
+    void clear_specializations ();
+
+    /// Return the shared, immutable copy of the given instance parameter
+    /// overrides, making one (and taking the contents of params) if no
+    /// instance has used the same overrides yet.
+    InstanceParamsRef intern_params (InstanceParams &params);
 
     typedef std::unordered_map<ustring,OpDescriptor,ustringHash> OpDescriptorMap;
 
@@ -701,16 +1020,20 @@ public:
     /// archive.
     bool archive_shadergroup (ShaderGroup *group, string_view filename);
 
+    bool compile_group_object (ShaderGroup *group, string_view filename);
+    bool load_group_object (ShaderGroup *group, string_view filename);
+
     void count_noise () { m_stat_noise_calls += 1; }
 
 private:
     void printstats () const;
 
-    /// Find the index of the named layer in the current shader group.
+    /// Find the index of the named layer in the shader group.
     /// If found, return the index >= 0 and put a pointer to the instance
     /// in inst; if not found, return -1 and set inst to NULL.
     /// (This is a helper for ConnectShaders.)
-    int find_named_layer_in_group (ustring layername, ShaderInstance * &inst);
+    int find_named_layer_in_group (ShaderGroup &group, ustring layername,
+                                   ShaderInstance * &inst);
 
     /// Turn a connectionname (such as "Kd" or "Cout[1]", etc.) into a
     /// ConnectedParam descriptor.  This routine is strictly a helper for
@@ -743,9 +1066,33 @@ private:
     mutable std::list<std::string> m_errseen, m_warnseen;
     static const int m_errseenmax = 32;
     mutable mutex m_errmutex;
-
-    typedef std::map<ustring,ShaderMaster::ref> ShaderNameMap;
+    mutable mutex m_error_batch_mutex;    ///< Keeps a batch's output together
+    // With the "error_thread" option, a single thread of our own passes
+    // the queued messages of all shading contexts to the ErrorHandler,
+    // so that render threads never wait on each other (or on the
+    // ErrorHandler) to report them.
+    ErrorQueue m_error_queue;
+    std::thread m_error_thread;
+    std::once_flag m_error_thread_started;
+    std::mutex m_error_mutex;             ///< For waiting on the error thread
+    std::condition_variable m_error_cv, m_error_done_cv;
+    std::atomic<size_t> m_errors_delivered; ///< Batches the thread delivered
+    bool m_error_thread_stop;             ///< Tell the error thread to exit
+    void error_thread_worker ();
+    void stop_error_thread ();
+    void deliver_errors (const std::vector<ErrorBatch::Item> &items);
+
+    // Each name maps to the (eventual) result of loading it, so that a
+    // thread loading one master doesn't hold up threads loading others,
+    // only those that asked for the same name.
+    typedef std::shared_future<ShaderMaster::ref> ShaderMasterFuture;
+    typedef std::unordered_map<ustring,ShaderMasterFuture,ustringHash> ShaderNameMap;
     ShaderNameMap m_shader_masters;       ///< name -> shader masters map
+    mutable spin_mutex m_shader_masters_mutex; ///< Guards m_shader_masters
+
+    /// Wait for another thread to finish loading a master, if it hasn't
+    /// already, and return it.
+    ShaderMaster::ref wait_for_master (const ShaderMasterFuture &f);
 
     ConstantPool<int> m_int_pool;
     ConstantPool<Float> m_float_pool;
@@ -770,6 +1117,7 @@ private:
     bool m_connection_error;              ///< Error for ConnectShaders to fail?
     bool m_greedyjit;                     ///< JIT as much as we can?
     bool m_countlayerexecs;               ///< Count number of layer execs?
+    int m_async_jit;                      ///< Number of background JIT threads
     int m_max_warnings_per_thread;        ///< How many warnings to display per thread before giving up?
     int m_profile;                        ///< Level of profiling of shader execution
     int m_optimize;                       ///< Runtime optimization level
@@ -790,6 +1138,9 @@ private:
     bool m_opt_seed_bblock_aliases;       ///< Turn on basic block alias seeds
     bool m_optimize_nondebug;             ///< Fully optimize non-debug!
     int m_opt_passes;                     ///< Opt passes per layer
+    int m_opt_specialization_cache;       ///< Max saved instance optimizations
+    bool m_opt_adaptive_passes;           ///< Stop passes once idle?
+    bool m_opt_profile;                   ///< Profile the optimizer?
     int m_llvm_optimize;                  ///< OSL optimization strategy
     int m_debug;                          ///< Debugging output
     int m_llvm_debug;                     ///< More LLVM debugging output
@@ -801,6 +1152,14 @@ private:
     ustring m_only_groupname;             ///< Name of sole group to compile
     ustring m_archive_groupname;          ///< Name of group to pickle/archive
     ustring m_archive_filename;           ///< Name of filename for group archive
+    ustring m_llvm_cache_dir;             ///< Directory of cached JIT objects
+    ustring m_llvm_target_isa;            ///< CPU to generate code for
+    int m_llvm_tier_executions;           ///< Executions before full opt
+    float m_llvm_tier_time;               ///< Shading time before full opt
+    int m_llvm_split_layers;              ///< Layers per concurrent JIT chunk
+    int m_llvm_lazy_entry_layers;         ///< JIT entry layers on first call?
+    bool m_allow_respecialize;            ///< Keep groups re-specializable?
+    bool m_evict_master_code;             ///< Free master code once copied?
     std::string m_searchpath;             ///< Shader search path
     std::vector<std::string> m_searchpath_dirs; ///< All searchpath dirs
     ustring m_commonspace_synonym;        ///< Synonym for "common" space
@@ -810,6 +1169,8 @@ private:
     int m_max_local_mem_KB;               ///< Local storage can a shader use
     bool m_compile_report;                ///< Print compilation report?
     bool m_buffer_printf;                 ///< Buffer/batch printf output?
+    int m_suppress_repeat_errors;         ///< Per-site errors/sec per context
+    bool m_error_thread_on;               ///< Deliver errors from own thread?
     bool m_no_noise;                      ///< Substitute trivial noise calls
     bool m_no_pointcloud;                 ///< Substitute trivial pointcloud calls
     bool m_force_derivs;                  ///< Force derivs on everything
@@ -825,7 +1186,6 @@ private:
 
     // State
     bool m_in_group;                      ///< Are we specifying a group?
-    ShaderUse m_group_use;                ///< Use of group
     ParamValueList m_pending_params;      ///< Pending Parameter() values
     ShaderGroupRef m_curgroup;            ///< Current shading attribute state
     mutable mutex m_mutex;                ///< Thread safety
@@ -834,15 +1194,19 @@ private:
     // Stats
     atomic_int m_stat_shaders_loaded;     ///< Stat: shaders loaded
     atomic_int m_stat_shaders_requested;  ///< Stat: shaders requested
+    atomic_int m_stat_master_code_evictions; ///< Stat: master code freed
+    atomic_int m_stat_master_code_reloads; ///< Stat: ...and read back in
+    atomic_ll m_stat_master_code_evicted_bytes; ///< Stat: bytes freed
     PeakCounter<int> m_stat_instances;    ///< Stat: instances
     PeakCounter<int> m_stat_contexts;     ///< Stat: shading contexts
-    int m_stat_groups;                    ///< Stat: shading groups
-    int m_stat_groupinstances;            ///< Stat: total inst in all groups
+    atomic_int m_stat_groups;             ///< Stat: shading groups
+    atomic_int m_stat_groupinstances;     ///< Stat: total inst in all groups
     atomic_int m_stat_instances_compiled; ///< Stat: instances compiled
     atomic_int m_stat_groups_compiled;    ///< Stat: groups compiled
     atomic_int m_stat_empty_instances;    ///< Stat: shaders empty after opt
     atomic_int m_stat_merged_inst;        ///< Stat: number of merged instances
     atomic_int m_stat_merged_inst_opt;    ///< Stat: merged insts after opt
+    atomic_ll m_stat_inst_merge_compares; ///< Stat: full instance comparisons
     atomic_int m_stat_empty_groups;       ///< Stat: groups empty after opt
     atomic_int m_stat_regexes;            ///< Stat: how many regex's compiled
     atomic_int m_stat_preopt_syms;        ///< Stat: pre-optimization symbols
@@ -855,7 +1219,28 @@ private:
     atomic_int m_stat_global_connections; ///< Stat: global connections elim'd
     atomic_int m_stat_tex_calls_codegened;///< Stat: total texture calls
     atomic_int m_stat_tex_calls_as_handles;///< Stat: texture calls with handles
+    atomic_int m_stat_llvm_cache_hits;    ///< Stat: groups found in JIT cache
+    atomic_int m_stat_llvm_cache_misses;  ///< Stat: groups not in JIT cache
+    atomic_int m_stat_groups_precompiled; ///< Stat: precompiled groups loaded
+    atomic_ll m_stat_llvm_cache_bytes_read;    ///< Stat: JIT cache bytes read
+    atomic_ll m_stat_llvm_cache_bytes_written; ///< Stat: JIT cache bytes written
+    atomic_ll m_stat_specialization_lookups; ///< Stat: instance opt cache lookups
+    atomic_ll m_stat_specialization_hits; ///< Stat: ...that were found
+    atomic_int m_stat_groups_promoted;    ///< Stat: groups recompiled hot
+    atomic_int m_stat_llvm_split_groups;  ///< Stat: groups JITed in chunks
+    atomic_int m_stat_llvm_lazy_layers;   ///< Stat: entry layers deferred
+    atomic_int m_stat_llvm_lazy_layers_compiled; ///< Stat: ...JITed later
+    atomic_int m_stat_groups_respecialized; ///< Stat: respecialize_group calls
+    atomic_int m_stat_respecialize_layers_kept; ///< Stat: ...layers not redone
+    atomic_int m_stat_object_variants;    ///< Stat: object variants made
+    atomic_int m_stat_object_variants_reused; ///< Stat: ...found in cache
+    atomic_int m_stat_async_jit_queued;   ///< Stat: groups queued for async JIT
+    atomic_ll m_stat_async_jit_not_ready; ///< Stat: executes of unready groups
+    int m_stat_async_jit_queue_peak;      ///< Stat: max async JIT queue depth
+    double m_stat_async_jit_wait_time;    ///< Stat: total time groups queued
+    // N.B. queue_peak and wait_time are protected by m_async_jit_mutex.
     double m_stat_master_load_time;       ///< Stat: time loading masters
+    double m_stat_master_load_wait_time;  ///< Stat: ...waiting for others
     double m_stat_optimization_time;      ///< Stat: time spent optimizing
     double m_stat_opt_locking_time;       ///<   locking time
     double m_stat_specialization_time;    ///<   runtime specialization time
@@ -864,11 +1249,20 @@ private:
     double m_stat_llvm_irgen_time;        ///<     llvm IR generation time
     double m_stat_llvm_opt_time;          ///<     llvm IR optimization time
     double m_stat_llvm_jit_time;          ///<     llvm JIT time
+    double m_stat_llvm_setup_saved;       ///<     setup time saved by cloning
+    double m_stat_llvm_promote_time;      ///<   time recompiling hot groups
+    double m_stat_llvm_split_saved;       ///<   time saved by JITing chunks
+    double m_stat_llvm_lazy_time;         ///<   time JITing deferred layers
+    double m_stat_respecialize_time;      ///< Stat: time respecializing groups
     double m_stat_inst_merge_time;        ///< Stat: time merging instances
+    double m_stat_inst_merge_opt_time;    ///<   ...of which after opt
+    OptProfile m_stat_opt_profile;        ///< Stat: optimizer pass profile
     double m_stat_getattribute_time;      ///< Stat: time spent in getattribute
     double m_stat_getattribute_fail_time; ///< Stat: time spent in getattribute
     atomic_ll m_stat_getattribute_calls;  ///< Stat: Number of getattribute
     atomic_ll m_stat_get_userdata_calls;  ///< Stat: # of get_userdata calls
+    atomic_ll m_stat_errors_suppressed;   ///< Stat: repeated errors dropped
+    atomic_ll m_stat_errors_dropped;      ///< Stat: errors lost to full queue
     atomic_ll m_stat_noise_calls;         ///< Stat: # of noise calls
     long long m_stat_pointcloud_searches;
     long long m_stat_pointcloud_searches_total_results;
@@ -878,6 +1272,7 @@ private:
     long long m_stat_pointcloud_writes;
     atomic_ll m_stat_layers_executed;     ///< Total layers executed
     atomic_ll m_stat_total_shading_time_ticks; ///< Total shading time (ticks)
+    atomic_ll m_stat_groupdata_init_ticks; ///< Groupdata init time (ticks)
 
     int m_stat_max_llvm_local_mem;        ///< Stat: max LLVM local mem
     PeakCounter<off_t> m_stat_memory;     ///< Stat: all shading system memory
@@ -891,20 +1286,58 @@ private:
     PeakCounter<off_t> m_stat_mem_inst;   ///< Stat: instance-related mem
     PeakCounter<off_t> m_stat_mem_inst_syms;
     PeakCounter<off_t> m_stat_mem_inst_paramvals;
+    PeakCounter<off_t> m_stat_mem_inst_paramvals_saved; ///< ...vs. full copies
     PeakCounter<off_t> m_stat_mem_inst_connections;
 
     mutable spin_mutex m_stat_mutex;     ///< Mutex for non-atomic stats
     ClosureRegistry m_closure_registry;
     std::vector<std::weak_ptr<ShaderGroup> > m_all_shader_groups;
     mutable spin_mutex m_all_shader_groups_mutex;
+    // Optimized instances, indexed by their specialization, so that the
+    // same instance in another group needn't be optimized again.
+    std::unordered_map<std::string, SpecializedInstanceRef> m_specializations;
+    spin_mutex m_specializations_mutex;
+    // Instance parameter overrides, indexed by their hash, so that
+    // instances with the same overrides share one copy.
+    std::unordered_multimap<size_t, std::weak_ptr<const InstanceParams> > m_interned_params;
+    spin_mutex m_interned_params_mutex;
+    size_t m_interned_params_sweep;       ///< Table size to prune at
     atomic_int m_groups_to_compile_count;
     atomic_int m_threads_currently_compiling;
+    ShadingSystem::ParallelForFunc m_parallel_for; ///< Renderer's thread pool
+    class CompilePool;
+    std::unique_ptr<CompilePool> m_compile_pool;   ///< Our own thread pool
+    std::once_flag m_compile_pool_once;   ///< Creates m_compile_pool
+    // Per-thread time spent compiling and sitting idle in
+    // optimize_all_groups (protected by m_stat_mutex).
+    std::vector<double> m_stat_compile_thread_busy_time;
+    std::vector<double> m_stat_compile_thread_idle_time;
+
+    // Queue of groups waiting for the background JIT threads.
+    struct AsyncJITRequest {
+        std::weak_ptr<ShaderGroup> group;
+        OIIO::Timer timer;             ///< Started when it was queued
+        bool promote;                  ///< Recompile with full opt?
+    };
+    std::deque<AsyncJITRequest> m_async_jit_queue;
+    std::vector<std::thread> m_async_jit_threads;
+    mutable std::mutex m_async_jit_mutex; ///< Guards the queue & threads
+    std::condition_variable m_async_jit_cv;
+    std::condition_variable m_async_jit_done_cv; ///< A JIT thread finished
+    bool m_async_jit_stop;                ///< Tell JIT threads to exit
+    void queue_async_jit (ShaderGroup &group, bool promote);
+    void async_jit_worker ();
+    void stop_async_jit ();
     mutable std::map<ustring,long long> m_group_profile_times;
     // N.B. group_profile_times is protected by m_stat_mutex.
+    /// Copy out the execution profiles of the live groups (each kept in
+    /// its group, so it goes away with it), by group id.
+    std::vector<std::pair<int,ExecProfile> > exec_profiles () const;
 
     friend class OSL::ShadingContext;
     friend class ShaderMaster;
     friend class ShaderInstance;
+    friend struct InstanceParams;
     friend class RuntimeOptimizer;
     friend class BackendLLVM;
 };
@@ -979,6 +1412,59 @@ typedef std::vector<Connection> ConnectionVec;
 
 
 
+/// The parameter values of a shader instance that differ from its
+/// master's defaults, in a form that can be shared by every instance with
+/// the same overrides. It's immutable; an instance that needs to change
+/// its values takes a complete private copy first.
+struct InstanceParams {
+    /// One overridden param.
+    struct Override {
+        int param;          ///< Index of the param
+        int fulloffset;     ///< Offset of its values in a complete copy
+        int nvalues;        ///< Number of values
+        int offset;         ///< Offset of its values in the vectors below
+        bool operator== (const Override &b) const {
+            return param == b.param && fulloffset == b.fulloffset &&
+                   nvalues == b.nvalues && offset == b.offset;
+        }
+    };
+
+    InstanceParams () : nfull_i(0), nfull_f(0), nfull_s(0), hashval(0),
+                        shadingsys(NULL) { }
+    ~InstanceParams ();
+
+    /// The override for the given param, or NULL if it has the default.
+    const Override *find (int param) const;
+
+    /// Are these overrides bitwise identical to b's?
+    bool equal (const InstanceParams &b) const;
+
+    /// Hash of the overrides, consistent with equal().
+    size_t hash () const;
+
+    /// Bytes held by the overrides.
+    off_t memsize () const {
+        return vectorbytes (overrides) + vectorbytes (iparams)
+             + vectorbytes (fparams) + vectorbytes (sparams);
+    }
+
+    /// Bytes that a complete copy of the values would take.
+    off_t fullmemsize () const {
+        return off_t(nfull_i)*sizeof(int) + off_t(nfull_f)*sizeof(float)
+             + off_t(nfull_s)*sizeof(ustring);
+    }
+
+    std::vector<Override> overrides;    ///< Overridden params, in order
+    std::vector<int> iparams;           ///< int param values
+    std::vector<float> fparams;         ///< float param values
+    std::vector<ustring> sparams;       ///< string param values
+    int nfull_i, nfull_f, nfull_s;      ///< Sizes of a complete copy
+    size_t hashval;                     ///< hash() of the overrides
+    ShadingSystemImpl *shadingsys;      ///< Shading system, once interned
+};
+
+
+
 /// ShaderInstance is a particular instance of a shader, with its own
 /// set of parameter values, coordinate transform, and connections to
 /// other instances within the same shader group.
@@ -1009,6 +1495,11 @@ public:
     ///
     void parameters (const ParamValueList &params);
 
+    /// Return a new, not yet optimized instance of the same master with
+    /// the same parameter values, connections, and flags as this one
+    /// (which must not have been optimized either).
+    ShaderInstanceRef clone_unoptimized () const;
+
     /// Find the named symbol, return its index in the symbol array, or
     /// -1 if not found.
     int findsymbol (ustring name) const;
@@ -1038,9 +1529,29 @@ public:
     }
 
     /// Where is the location that holds the parameter's instance value?
+    /// The non-const version first gives the instance its own copy of
+    /// any shared parameter values, since the caller may write to it.
     void *param_storage (int index);
     const void *param_storage (int index) const;
 
+    /// Where the symbol of an optimized instance should point for the
+    /// param's value: the shared copy, if that's what the instance has.
+    /// Anything that writes it must unshare_params() first, which points
+    /// the symbols at the instance's own copy.
+    void *param_symbol_data (int index) const {
+        return const_cast<void *>(param_storage (index));
+    }
+
+    /// Trade the instance's own complete copy of its parameter values
+    /// for the shared copy of just those that differ from the master's
+    /// defaults (see ShadingSystemImpl::intern_params).
+    void share_params ();
+
+    /// Give the instance its own complete copy of its parameter values,
+    /// so that it may change them, and point the param symbols (if it
+    /// has its own yet) at that copy.
+    void unshare_params ();
+
     /// Add a connection
     ///
     void add_connection (int srclayer, const ConnectedParam &srccon,
@@ -1220,7 +1731,9 @@ public:
     }
 
     /// Make our own version of the code and args from the master.
-    void copy_code_from_master (ShaderGroup &group);
+    /// Return false if the master's code was evicted and can't be
+    /// reloaded.
+    bool copy_code_from_master (ShaderGroup &group);
 
     /// Check the params to re-assess writes_globals and userdata_params.
     /// Sorry, can't think of a short name that isn't too cryptic.
@@ -1265,6 +1778,12 @@ public:
     /// equivalent, in that they may be merged into a single instance?
     bool mergeable (const ShaderInstance &b, const ShaderGroup &g) const;
 
+    /// A hash of the instance that's sure to be the same for any two
+    /// instances that are mergeable(), and very likely different
+    /// otherwise.  Connections are by layer number, so it's only
+    /// meaningful within a group.
+    size_t merge_signature () const;
+
 private:
     ShaderMaster::ref m_master;         ///< Reference to the master
     SymOverrideInfoVec m_instoverrides; ///< Instance parameter info
@@ -1275,6 +1794,7 @@ private:
     std::vector<int> m_iparams;         ///< int param values
     std::vector<float> m_fparams;       ///< float param values
     std::vector<ustring> m_sparams;     ///< string param values
+    InstanceParamsRef m_shared_params;  ///< Shared param overrides, if any
     int m_id;                           ///< Unique ID for the instance
     bool m_writes_globals;              ///< Do I have side effects?
     bool m_userdata_params;             ///< Might I read userdata for params?
@@ -1283,6 +1803,7 @@ private:
     bool m_merged_unused;               ///< Unused because of a merge
     bool m_last_layer;                  ///< Is it the group's last layer?
     bool m_entry_layer;                 ///< Is it an entry layer?
+    bool m_needs_master_code;           ///< Yet to copy the master's code?
     ConnectionVec m_connections;        ///< Connected input params
     int m_firstparam, m_lastparam;      ///< Subset of symbols that are params
     int m_maincodebegin, m_maincodeend; ///< Main shader code range
@@ -1352,8 +1873,8 @@ private:
 /// Represents a single message for use by getmessage and setmessage opcodes
 ///
 struct Message {
-    Message(ustring name, const TypeDesc& type, int layeridx, ustring sourcefile, int sourceline, Message* next) :
-       name(name), data(nullptr), type(type), layeridx(layeridx), sourcefile(sourcefile), sourceline(sourceline), next(next) {}
+    Message(ustring name, const TypeDesc& type, int layeridx, ustring sourcefile, int sourceline) :
+       name(name), data(nullptr), type(type), layeridx(layeridx), sourcefile(sourcefile), sourceline(sourceline) {}
 
     /// Some messages don't have data because getmessage() was called before setmessage
     /// (which is flagged as an error to avoid ambiguities caused by execution order)
@@ -1366,47 +1887,124 @@ struct Message {
     int layeridx;           ///< layer index where this was message was created
     ustring sourcefile;     ///< source code file that contains the call that created this message
     int sourceline;         ///< source code line that contains the call that created this message
-    Message* next;          ///< linked list of messages (managed by MessageList below)
 };
 
 /// Represents the list of messages set by a given shader using setmessage and getmessage
 ///
+/// The messages are found through an open-addressed hash table keyed on
+/// the (already hashed) name.  A slot only counts as occupied if it was
+/// filled in the current generation, so clear() doesn't have to touch
+/// the table at all.
 struct MessageList {
-     MessageList() : list_head(nullptr), message_data() {}
+     MessageList() : generation(1), count(0), message_data() {}
 
      void clear() {
-         list_head = NULL;
+         if (++generation == 0) {
+             // Wrapped around: old slots could look current, so really
+             // empty them (once every 4 billion clears).
+             for (auto& s : slots)
+                 s.generation = 0;
+             generation = 1;
+         }
+         count = 0;
          message_data.clear();
      }
 
     const Message* find(ustring name) const {
-        for (const Message* m = list_head; m != NULL; m = m->next)
-            if (m->name == name)
-                return m; // name matches
-        return nullptr; // not found
+        if (slots.empty())
+            return nullptr;
+        size_t mask = slots.size() - 1;
+        for (size_t i = name.hash() & mask; ; i = (i + 1) & mask) {
+            const Slot& s = slots[i];
+            if (s.generation != generation)
+                return nullptr; // not found
+            if (s.message->name == name)
+                return s.message; // name matches
+        }
     }
 
+    /// Add a message, which must not already be in the list.
     void add(ustring name, void* data, const TypeDesc& type, int layeridx, ustring sourcefile, int sourceline) {
-        list_head = new (message_data.alloc(sizeof(Message), alignof(Message))) Message(name, type, layeridx, sourcefile, sourceline, list_head);
+        Message* m = new (message_data.alloc(sizeof(Message), alignof(Message))) Message(name, type, layeridx, sourcefile, sourceline);
         if (data) {
-            list_head->data = message_data.alloc(type.size());
-            memcpy(list_head->data, data, type.size());
+            m->data = message_data.alloc(type.size());
+            memcpy(m->data, data, type.size());
         }
+        // Keep the table at most half full
+        if (2 * (count + 1) > slots.size())
+            grow();
+        insert(m);
+        ++count;
     }
 
 private:
-    Message*         list_head;
+    struct Slot {
+        Message* message = nullptr;
+        unsigned int generation = 0;  ///< generation it was filled in
+    };
+
+    void insert(Message* m) {
+        size_t mask = slots.size() - 1;
+        size_t i = m->name.hash() & mask;
+        while (slots[i].generation == generation)
+            i = (i + 1) & mask;
+        slots[i].message = m;
+        slots[i].generation = generation;
+    }
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.resize(std::max(size_t(16), 2 * old.size()));
+        for (auto& s : old)
+            if (s.generation == generation)
+                insert(s.message);
+    }
+
+    std::vector<Slot> slots;      ///< hash table (size is a power of 2)
+    unsigned int     generation;  ///< current generation of the table
+    size_t           count;       ///< messages in the current generation
     SimplePool<1024> message_data;
 };
 
 
+
+/// Pointer to the JITed function of a group or layer, which may be
+/// replaced while other threads are running the group (when a lazily
+/// JITed layer's stub gives way to its real code, or a group is
+/// recompiled at the full tier).  Stores publish the code
+/// with release ordering, and loads acquire it.  Copying is only for
+/// resizing a group's list of layers, before any thread runs it.
+struct AtomicLayerFunc {
+    AtomicLayerFunc (RunLLVMGroupFunc f = NULL) : m_func(f) { }
+    AtomicLayerFunc (const AtomicLayerFunc &x) : m_func(x.load()) { }
+    const AtomicLayerFunc& operator= (const AtomicLayerFunc &x) {
+        store (x.load());
+        return *this;
+    }
+    RunLLVMGroupFunc load () const {
+        return m_func.load (std::memory_order_acquire);
+    }
+    void store (RunLLVMGroupFunc f) {
+        m_func.store (f, std::memory_order_release);
+    }
+private:
+    std::atomic<RunLLVMGroupFunc> m_func;
+};
+
+// JITed code loads the entries of ShaderGroup::m_llvm_layer_table as
+// plain pointers (see BackendLLVM::llvm_call_layer).
+static_assert (sizeof(AtomicLayerFunc) == sizeof(RunLLVMGroupFunc),
+               "AtomicLayerFunc must be laid out as a bare pointer");
+
+
 }; // namespace pvt
 
 
 
 /// A ShaderGroup consists of one or more layers (each of which is a
 /// ShaderInstance), and the connections among them.
-class ShaderGroup {
+class ShaderGroup : public std::enable_shared_from_this<ShaderGroup> {
 public:
     ShaderGroup (string_view name);
     ShaderGroup (const ShaderGroup &g, string_view name);
@@ -1414,12 +2012,12 @@ public:
 
     /// Clear the layers
     ///
-    void clear () { m_layers.clear ();  m_optimized = 0;  m_executions = 0; }
+    void clear () { m_layers.clear ();  optimized (0);  m_executions = 0; }
 
     /// Append a new shader instance on to the end of this group
     ///
     void append (ShaderInstanceRef newlayer) {
-        ASSERT (! m_optimized && "should not append to optimized group");
+        ASSERT (! optimized() && "should not append to optimized group");
         m_layers.push_back (newlayer);
     }
 
@@ -1432,32 +2030,80 @@ public:
     /// Array indexing returns the i-th layer of the group
     ShaderInstance * operator[] (int i) const { return layer(i); }
 
-    int optimized () const { return m_optimized; }
-    void optimized (int opt) { m_optimized = opt; }
+    /// Has the group been optimized and JITed?  Everything the optimizer
+    /// wrote to the group is visible to a thread that sees it nonzero.
+    int optimized () const { return m_optimized.load (std::memory_order_acquire); }
+    void optimized (int opt) { m_optimized.store (opt, std::memory_order_release); }
 
     size_t llvm_groupdata_size () const { return m_llvm_groupdata_size; }
     void llvm_groupdata_size (size_t size) { m_llvm_groupdata_size = size; }
 
+    /// The groupdata bytes that must be zeroed before each execution --
+    /// the layer-run and userdata-initialized flags, and the closure
+    /// params.  That is everything the init function would store, so
+    /// clearing them stands in for running it.  Empty if not known.
+    /// Shading threads read them without a lock, so they may only be set
+    /// before the group is marked optimized.
+    const GroupdataSpans &llvm_groupdata_reset () const {
+        return m_llvm_groupdata_reset;
+    }
+    void llvm_groupdata_reset (GroupdataSpans &spans) {
+        ASSERT (! optimized());
+        m_llvm_groupdata_reset.swap (spans);
+    }
+
     RunLLVMGroupFunc llvm_compiled_version() const {
-        return m_llvm_compiled_version;
+        return m_llvm_compiled_version.load();
     }
     void llvm_compiled_version (RunLLVMGroupFunc func) {
-        m_llvm_compiled_version = func;
+        m_llvm_compiled_version.store (func);
     }
     RunLLVMGroupFunc llvm_compiled_init() const {
-        return m_llvm_compiled_init;
+        return m_llvm_compiled_init.load();
     }
     void llvm_compiled_init (RunLLVMGroupFunc func) {
-        m_llvm_compiled_init = func;
+        m_llvm_compiled_init.store (func);
     }
     RunLLVMGroupFunc llvm_compiled_layer (int layer) const {
         return layer < (int)m_llvm_compiled_layers.size()
-                            ? m_llvm_compiled_layers[layer] : NULL;
+                            ? m_llvm_compiled_layers[layer].load() : NULL;
     }
     void llvm_compiled_layer (int layer, RunLLVMGroupFunc func) {
-        m_llvm_compiled_layers.resize ((size_t)nlayers(), NULL);
+        m_llvm_compiled_layers.resize ((size_t)nlayers());
         if (layer < nlayers())
-            m_llvm_compiled_layers[layer] = func;
+            m_llvm_compiled_layers[layer].store (func);
+    }
+    /// Hold on to the memory containing the group's JITed code, which
+    /// will be freed when the group is destroyed.
+    void llvm_jit_memory (const LLVM_Util::JITMemoryRef &mem) {
+        m_llvm_jit_memory.assign (1, mem);
+    }
+    void llvm_jit_memory (const std::vector<LLVM_Util::JITMemoryRef> &mem) {
+        m_llvm_jit_memory = mem;
+    }
+    /// Code for the group may be spread over several chunks of memory
+    /// (see BackendLLVM::run_split).
+    void add_llvm_jit_memory (const LLVM_Util::JITMemoryRef &mem) {
+        m_llvm_jit_memory.push_back (mem);
+    }
+    const std::vector<LLVM_Util::JITMemoryRef> &llvm_jit_memory () const {
+        return m_llvm_jit_memory;
+    }
+
+    /// Files from which to load, or to which to save, the group's
+    /// precompiled code, or empty if none.
+    ustring llvm_object_load_file () const { return m_llvm_object_load_file; }
+    ustring llvm_object_save_file () const { return m_llvm_object_save_file; }
+
+    /// Was the group compiled at the fast tier, and thus may be
+    /// recompiled with full optimization once it proves to be hot?
+    bool llvm_promotable () const { return m_llvm_promotable; }
+
+    /// Is the layer an entry point whose code is JITed only when it's
+    /// first called (see "llvm_lazy_entry_layers")?
+    bool llvm_lazy_layer (int layer) const {
+        return std::find (m_llvm_lazy_layers.begin(), m_llvm_lazy_layers.end(),
+                          layer) != m_llvm_lazy_layers.end();
     }
 
     /// Is this shader group equivalent to ret void?
@@ -1473,6 +2119,10 @@ public:
     void start_running () {
 #ifndef NDEBUG
        m_executions++;
+#else
+       // Tiered compilation needs to know how hot the group is.
+       if (m_llvm_promotable)
+           m_executions++;
 #endif
     }
 
@@ -1532,25 +2182,79 @@ public:
     int raytypes_on ()  const { return m_raytypes_on; }
     int raytypes_off () const { return m_raytypes_off; }
 
+    /// Does the group keep its unoptimized layers, so that it may be
+    /// respecialized (see "allow_respecialize")?
+    bool respecializable () const { return ! m_unoptimized_layers.empty(); }
+
+    /// Is the group being respecialized around the optimized instances
+    /// and code of some of its layers (see respecialize_downstream), and
+    /// is this one of them?
+    bool reuses_layers () const { return ! m_reused_layers.empty(); }
+    bool reused_layer (int layer) const {
+        return ! m_reused_layers.empty() && m_reused_layers[layer];
+    }
+
+    /// Is this a variant of a group specialized for one object (see
+    /// ShadingSystem::object_variant)?  The key identifies the object's
+    /// attribute values.
+    bool object_variant () const { return ! m_object_variant_key.empty(); }
+    const std::string &object_variant_key () const { return m_object_variant_key; }
+
+    /// For an object variant, retrieve the value of one of the
+    /// attributes it was given (or an element of it, if index >= 0).
+    /// Return false if there's no such attribute of the given type.
+    bool object_attribute (ustring name, TypeDesc type, int index,
+                           void *val) const;
+
 private:
     // Put all the things that are read-only (after optimization) and
     // needed on every shade execution at the front of the struct, as much
     // together on one cache line as possible.
-    volatile int m_optimized;        ///< Is it already optimized?
+    std::atomic<int> m_optimized;    ///< Is it already optimized?
     bool m_does_nothing;             ///< Is the shading group just func() { return; }
     size_t m_llvm_groupdata_size;    ///< Heap size needed for its groupdata
     int m_id;                        ///< Unique ID for the group
     int m_num_entry_layers;          ///< Number of marked entry layers
-    RunLLVMGroupFunc m_llvm_compiled_version;
-    RunLLVMGroupFunc m_llvm_compiled_init;
-    std::vector<RunLLVMGroupFunc> m_llvm_compiled_layers;
+    AtomicLayerFunc m_llvm_compiled_version;
+    AtomicLayerFunc m_llvm_compiled_init;
+    GroupdataSpans m_llvm_groupdata_reset; ///< Bytes to zero on init
+    std::vector<AtomicLayerFunc> m_llvm_compiled_layers;
+    std::vector<LLVM_Util::JITMemoryRef> m_llvm_jit_memory; ///< Owns the JITed code
+    std::vector<AtomicLayerFunc> m_llvm_layer_table; ///< All layer funcs (split groups)
+    std::vector<int> m_llvm_lazy_layers; ///< Entry layers JITed on first call
+    std::vector<int> m_llvm_layer_remap; ///< Layers' run flags (split groups)
+    std::atomic<bool> m_llvm_promotable; ///< Compiled at the fast tier?
+    std::atomic<bool> m_llvm_promotion_queued; ///< Queued to recompile?
+    std::vector<LLVM_Util::JITMemoryRef> m_llvm_retired_jit_memory; ///< Fast tier code
+    ustring m_llvm_object_load_file; ///< Precompiled code to load
+    ustring m_llvm_object_save_file; ///< Where to save compiled code
     std::vector<ShaderInstanceRef> m_layers;
+    std::vector<ShaderInstanceRef> m_unoptimized_layers; ///< For respecializing
+    std::vector<std::pair<int,int> > m_respecialized_params; ///< (layer,param)
+    bool m_respecialize_pending;     ///< ReParameter since respecializing?
+    std::vector<int> m_respecialize_layers; ///< ...on which layers
+    std::vector<bool> m_reused_layers; ///< Layers kept while respecializing
+    std::string m_object_variant_key; ///< Identifies an object variant
+    ParamValueList m_object_attributes; ///< Object variant's attributes
+    std::unordered_map<std::string,std::weak_ptr<ShaderGroup> > m_object_variants;
     ustring m_name;
     int m_exec_repeat;               ///< How many times to execute group
     int m_raytype_queries;           ///< Bitmask of raytypes queried
     int m_raytypes_on;               ///< Bitmask of raytypes we assume to be on
     int m_raytypes_off;              ///< Bitmask of raytypes we assume to be off
+    // N.B. pending_params and group_use are only used while the group is
+    // being built (see ShadingSystem::Shader(ShaderGroup&,...)).
+    ParamValueList m_pending_params; ///< Parameter() values for next Shader()
+    pvt::ShaderUse m_group_use;      ///< Use of the group's shaders
+    std::atomic<bool> m_ended;       ///< Has ShaderGroupEnd been called?
     mutable mutex m_mutex;           ///< Thread-safe optimization
+    std::atomic<bool> m_async_jit_queued; ///< Queued for background JIT?
+    // Lazy layers are JITed under locks of their own, rather than m_mutex,
+    // which is held for the whole of a recompile at the full tier.
+    std::unique_ptr<mutex[]> m_llvm_lazy_mutexes; ///< One per stub
+    std::once_flag m_llvm_lazy_mutexes_once;     ///< Allocates them
+    std::vector<LLVM_Util::JITMemoryRef> m_llvm_lazy_jit_memory; ///< Their code
+    spin_mutex m_llvm_lazy_jit_memory_mutex;
     std::vector<ustring> m_textures_needed;
     std::vector<ustring> m_closures_needed;
     std::vector<ustring> m_globals_needed;
@@ -1566,6 +2270,8 @@ private:
     bool m_unknown_attributes_needed;
     atomic_ll m_executions;          ///< Number of times the group executed
     atomic_ll m_stat_total_shading_time_ticks; ///< Total shading time (ticks)
+    pvt::ExecProfile m_exec_profile; ///< Layer profile (profile >= 2)
+    spin_mutex m_exec_profile_mutex; ///< Guards m_exec_profile
 
     friend class OSL::pvt::ShadingSystemImpl;
     friend class OSL::pvt::BackendLLVM;
@@ -1591,7 +2297,8 @@ public:
 
     /// Bind a shader group and globals to this context and prepare to
     /// execute. (See similarly named method of ShadingSystem.)
-    bool execute_init (ShaderGroup &group, ShaderGlobals &globals, bool run=true);
+    bool execute_init (ShaderGroup &group, ShaderGlobals &globals,
+                       bool run=true, bool *not_ready=NULL);
 
     /// Execute the layer whose index is specified. (See similarly named
     /// method of ShadingSystem.)
@@ -1601,9 +2308,15 @@ public:
     /// group. (See similarly named method of ShadingSystem.)
     bool execute_cleanup ();
 
+    /// Reset the groupdata for one shaded point before running any of
+    /// its layers.
+    void init_groupdata (ShaderGroup &sgroup, ShaderGlobals &ssg,
+                         char *groupdata);
+
     /// Execute the shader group, including init, run of single entry point
     /// layer, and cleanup. (See similarly named method of ShadingSystem.)
-    bool execute (ShaderGroup &group, ShaderGlobals &globals, bool run=true);
+    bool execute (ShaderGroup &group, ShaderGlobals &globals,
+                  bool run=true, bool *not_ready=NULL);
 
     ClosureComponent * closure_component_allot(int id, size_t prim_size, const Color3 &w) {
         // Allocate the component and the mul back to back
@@ -1713,6 +2426,22 @@ public:
 
     void incr_layers_executed () { ++m_stat_layers_executed; }
 
+    /// Is the execution profile being gathered for this execution?
+    bool profiling_layers () const { return m_profile_layers; }
+
+    /// Start charging time to the given layer, until it exits (or until
+    /// it runs another layer).
+    void profile_layer_enter (int layer);
+    /// Stop charging time to the current layer, and go back to charging
+    /// the layer that ran it.
+    void profile_layer_exit ();
+    /// Charge time to one kind of renderer callback.
+    void profile_callback (pvt::ExecProfile::Callback callback, long long ticks) {
+        pvt::ExecProfile::Entry &e (m_exec_profile.callbacks[callback]);
+        e.ticks += ticks;
+        e.calls += 1;
+    }
+
     void incr_get_userdata_calls () { ++m_stat_get_userdata_calls; }
 
     // Clear the stats we record per-execution in this context (unlocked)
@@ -1739,20 +2468,26 @@ public:
         }
     }
 
-    // Record an error (or warning, printf, etc.)
-    void record_error (ErrorHandler::ErrCode code, const std::string &text) const;
+    // Record an error (or warning, printf, etc.).  The site identifies
+    // where the message comes from -- its format string, which for a
+    // given call is always at the same address -- for the
+    // "suppress_repeat_errors" option; NULL if unknown.
+    void record_error (ErrorHandler::ErrCode code, const std::string &text,
+                       const void *site = NULL) const;
     // Process all the recorded errors, warnings, printfs
     void process_errors () const;
 
 #if OIIO_VERSION >= 10803
     template<typename... Args>
     inline void error (string_view fmt, const Args&... args) const {
-        record_error(ErrorHandler::EH_ERROR, Strutil::format (fmt, args...));
+        record_error(ErrorHandler::EH_ERROR, Strutil::format (fmt, args...),
+                     fmt.data());
     }
 
     template<typename... Args>
     inline void warning (string_view fmt, const Args&... args) const {
-        record_error(ErrorHandler::EH_WARNING, Strutil::format (fmt, args...));
+        record_error(ErrorHandler::EH_WARNING, Strutil::format (fmt, args...),
+                     fmt.data());
     }
 
     template<typename... Args>
@@ -1796,6 +2531,12 @@ private:
     int m_stat_get_userdata_calls;      ///< Number of calls to get_userdata
     int m_stat_layers_executed;         ///< Number of layers executed
     long long m_ticks;                  ///< Time executing the shader
+    long long m_init_ticks;             ///< Time initializing groupdata
+    bool m_profile_layers;              ///< Gathering m_exec_profile?
+    pvt::ExecProfile m_exec_profile;    ///< Profile of this execution
+    std::vector<int> m_layer_stack;     ///< Layers running, innermost last
+    long long m_layer_mark;             ///< Last time charged to a layer
+    OIIO::Timer m_layer_timer;          ///< Times the layers
 
     TextureOpt m_textureopt;            ///< texture call options
     RendererServices::NoiseOpt m_noiseopt; ///< noise call options
@@ -1820,8 +2561,18 @@ private:
     int m_next_failed_attrib;
 
     // Buffering of error messages and printfs
-    typedef std::pair<ErrorHandler::ErrCode, std::string> ErrorItem;
-    mutable std::vector<ErrorItem> m_buffered_errors;
+    mutable std::vector<ErrorBatch::Item> m_buffered_errors;
+    // The sites (format strings) of the errors and warnings this context
+    // reported recently, and how many it passed on from each during the
+    // current second, for the "suppress_repeat_errors" option.
+    struct ErrorSite {
+        const void *site;
+        long long second;
+        int count;
+    };
+    static const int ERROR_SITES = 32;
+    mutable ErrorSite m_error_sites[ERROR_SITES];
+    mutable int m_next_error_site;
 
     // Calculate offset needed to align ClosureComponent's mem to a given alignment.
     inline size_t closure_alignment_offset_calc(size_t alignment) {
@@ -1872,6 +2623,26 @@ struct NoiseParams {
 
 namespace pvt {
 
+/// Charge the time spent in a scope (a renderer callback) to the
+/// execution profile of a context, if it's being gathered.
+class ExecProfileTimer {
+public:
+    ExecProfileTimer (ShadingContext *ctx, ExecProfile::Callback callback)
+        : m_ctx(ctx->profiling_layers() ? ctx : NULL), m_callback(callback),
+          m_timer(m_ctx ? OIIO::Timer::StartNow : OIIO::Timer::DontStartNow)
+    { }
+    ~ExecProfileTimer () {
+        if (m_ctx)
+            m_ctx->profile_callback (m_callback, m_timer.ticks());
+    }
+private:
+    ShadingContext *m_ctx;
+    ExecProfile::Callback m_callback;
+    OIIO::Timer m_timer;
+};
+
+
+
 /// Base class for objects that examine compiled shader groups (oso).
 /// This includes optimization passes, "back end" code generators, etc.
 /// The base class holds common data structures and methods that all
@@ -41,20 +41,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "osoreader.h"
 
-#undef yylex
-extern int osolex();
-
 using namespace OSL;
 using namespace OSL::pvt;
 
-void yyerror (const char *err);
-
-#define yylex osolex
-#define reader OSOReader::reader
-
-static TypeSpec current_typespec;
-static std::string current_shader_name;
-
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wparentheses-equality"
 #endif
@@ -69,6 +58,15 @@ OSL_NAMESPACE_EXIT
 %}
 
 
+// The parser is reentrant: rather than using globals, it's handed the
+// OSOReader to call back (which also holds the state of the parse) and
+// the scanner to read tokens from, so any number of threads may each be
+// parsing their own .oso file at once.
+%define api.pure
+%parse-param { OSL::pvt::OSOReader *osoreader } { void *scanner }
+%lex-param { void *scanner }
+
+
 // This is the definition for the union that defines YYSTYPE
 %union
 {
@@ -82,6 +80,18 @@ OSL_NAMESPACE_EXIT
 %locations
 
 
+%{
+
+// Declarations that need YYSTYPE and YYLTYPE
+
+extern int osolex (YYSTYPE *lval, YYLTYPE *lloc, void *scanner);
+
+void yyerror (YYLTYPE *lloc, OSOReader *osoreader, void *scanner,
+              const char *err);
+
+%}
+
+
 // Define the terminal symbols.
 %token <s> IDENTIFIER STRING_LITERAL HINT
 %token <i> INT_LITERAL
@@ -111,7 +121,7 @@ OSL_NAMESPACE_EXIT
 oso_file
         : version shader_declaration symbols_opt codemarker instructions
                 {
-                    OSOReader::osoreader->codeend ();
+                    osoreader->codeend ();
                     $$ = 0;
                 }
 	;
@@ -121,7 +131,7 @@ version
                 {
                     int major = (int) $2;
                     int minor = (int) (100*($2-major) + 0.5);
-                    OSOReader::osoreader->version ($1, major, minor);
+                    osoreader->version ($1, major, minor);
                     $$ = 0;
                 }
         ;
@@ -129,8 +139,7 @@ version
 shader_declaration
         : shader_type IDENTIFIER 
                 {
-                    OSOReader::osoreader->shader ($1, $2);
-                    current_shader_name = $2;
+                    osoreader->shader ($1, $2);
                 }
             hints_opt ENDOFLINE
                 {
@@ -146,9 +155,9 @@ symbols_opt
 codemarker
         : CODE IDENTIFIER ENDOFLINE
                 {
-                    if (! OSOReader::osoreader->parse_code_section())
+                    if (! osoreader->parse_code_section())
                         YYACCEPT;
-                    OSOReader::osoreader->codemarker ($2);
+                    osoreader->codemarker ($2);
                 }
         ;
 
@@ -160,11 +169,11 @@ instructions
 instruction
         : label opcode 
                 {
-                    OSOReader::osoreader->instruction ($1, $2);
+                    osoreader->instruction ($1, $2);
                 }
             arguments_opt jumptargets_opt hints_opt ENDOFLINE
                 {
-                    OSOReader::osoreader->instruction_end ();
+                    osoreader->instruction_end ();
                 }
         | codemarker
         | ENDOFLINE
@@ -183,16 +192,16 @@ symbol
         : SYMTYPE typespec arraylen_opt IDENTIFIER 
                 {
                     if ((SymType)$1 == SymTypeTemp &&
-                        OSOReader::osoreader->stop_parsing_at_temp_symbols())
+                        osoreader->stop_parsing_at_temp_symbols())
                         YYACCEPT;
-                    TypeSpec typespec = current_typespec;
+                    TypeSpec typespec = osoreader->current_typespec();
                     if ($3)
                         typespec.make_array ($3);
-                    OSOReader::osoreader->symbol ((SymType)$1, typespec, $4);
+                    osoreader->symbol ((SymType)$1, typespec, $4);
                 }
             initial_values_opt hints_opt
                 {
-                    OSOReader::osoreader->parameter_done ();
+                    osoreader->parameter_done ();
                 }
             ENDOFLINE
         | ENDOFLINE
@@ -202,17 +211,17 @@ symbol
 typespec
         : simple_typename
                 {
-                    current_typespec = osolextype ($1);
+                    osoreader->current_typespec (osolextype ($1));
                     $$ = 0;
                 }
         | CLOSURE simple_typename
                 {
-                    current_typespec = TypeSpec (osolextype ($2), true);
+                    osoreader->current_typespec (TypeSpec (osolextype ($2), true));
                     $$ = 0;
                 }
         | STRUCT IDENTIFIER
                 {
-                    current_typespec = TypeSpec ($2, 0);
+                    osoreader->current_typespec (TypeSpec ($2, 0));
                     $$ = 0;
                 }
         ;
@@ -248,12 +257,12 @@ initial_values
 initial_value
         : FLOAT_LITERAL
                 {
-                    OSOReader::osoreader->symdefault ($1);
+                    osoreader->symdefault ($1);
                     $$ = 0;
                 }
         | INT_LITERAL
                 {
-                    OSOReader::osoreader->symdefault ($1);
+                    osoreader->symdefault ($1);
                     $$ = 0;
                 }
         | STRING_LITERAL
@@ -267,7 +276,7 @@ initial_value
                         unescaped = OIIO::Strutil::unescape_chars(s);
                         s = string_view(unescaped);
                     }
-                    OSOReader::osoreader->symdefault (s.c_str());
+                    osoreader->symdefault (s.c_str());
                     $$ = 0;
                 }
         ;
@@ -294,7 +303,7 @@ arguments
 argument
         : IDENTIFIER
                 {
-                    OSOReader::osoreader->instruction_arg ($1);
+                    osoreader->instruction_arg ($1);
                 }
         ;
 
@@ -311,7 +320,7 @@ jumptargets
 jumptarget
         : INT_LITERAL
                 {
-                    OSOReader::osoreader->instruction_jump ($1);
+                    osoreader->instruction_jump ($1);
                 }
         ;
 
@@ -328,7 +337,7 @@ hints
 hint
         : HINT
                 {
-                    OSOReader::osoreader->hint ($1);
+                    osoreader->hint ($1);
                     $$ = 0;
                 }
         ;
@@ -339,10 +348,10 @@ hint
 
 
 void
-yyerror (const char *err)
+yyerror (YYLTYPE *lloc, OSOReader *osoreader, void *scanner, const char *err)
 {
-    OSOReader::osoreader->errhandler().error ("Error, line %d: %s", 
-             OSOReader::osoreader->lineno(), err);
+    osoreader->errhandler().error ("Error, line %d: %s", 
+             osoreader->lineno(), err);
 }
 
 
@@ -34,9 +34,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OpenImageIO/string_view.h>
 
 
-extern int osoparse ();
-
-
 OSL_NAMESPACE_ENTER
 
 namespace pvt {
@@ -54,7 +51,8 @@ public:
 
     /// Read in the oso file, parse it, call the various callbacks.
     /// Return true if the file was correctly parsed, false if there was
-    /// an unrecoverable error reading the file.
+    /// an unrecoverable error reading the file.  Any number of threads
+    /// may be parsing at once, each with its own OSOReader.
     virtual bool parse_file (const std::string &filename);
 
     /// Read in OSO from memory, parse, call the various callbacks.
@@ -139,11 +137,19 @@ public:
     /// Return a reference to the error handler
     ErrorHandler& errhandler () { return m_err; }
 
-    static OSOReader *osoreader;
+    /// Set or return the type of the symbol being declared.  Should only
+    /// be called by the parser.
+    void current_typespec (const TypeSpec &t) { m_current_typespec = t; }
+    const TypeSpec &current_typespec () const { return m_current_typespec; }
 
 private:
+    /// Parse the OSO code in buffer with a scanner of our own, returning
+    /// the parser's error code (nonzero if error).
+    int parse_buffer (const std::string &buffer);
+
     ErrorHandler &m_err;
     int m_lineno;
+    TypeSpec m_current_typespec;
 };
 
 
@@ -497,6 +497,7 @@ osl_pointcloud_search (ShaderGlobals *sg, const char *filename, void *center, fl
     else
         indices = (size_t *)alloca (sizeof(size_t) * max_points);
 
+    ExecProfileTimer prof (sg->context, ExecProfile::Pointcloud);
     int count = sg->renderer->pointcloud_search (sg, USTR(filename),
                                                  *((Vec3 *)center), radius, max_points, sort,
                                                  indices, (float *)out_distances, derivs_offset);
@@ -538,6 +539,7 @@ osl_pointcloud_get (ShaderGlobals *sg, const char *filename, void *in_indices, i
 
     shadingsys.pointcloud_stats (0, 1, 0);
 
+    ExecProfileTimer prof (sg->context, ExecProfile::Pointcloud);
     return sg->renderer->pointcloud_get (sg, USTR(filename), (size_t *)indices, count, USTR(attr_name),
                                          TYPEDESC(attr_type), out_data);
 }
@@ -566,6 +568,7 @@ osl_pointcloud_write (ShaderGlobals *sg, const char *filename, const Vec3 *pos,
         return 0;
 
     shadingsys.pointcloud_stats (0, 0, 0, 1);
+    ExecProfileTimer prof (sg->context, ExecProfile::Pointcloud);
     return sg->renderer->pointcloud_write (sg, USTR(filename), *pos,
                                            nattribs, names, types, values);
 }
@@ -122,7 +122,8 @@ RuntimeOptimizer::RuntimeOptimizer (ShadingSystemImpl &shadingsys,
       m_pass(0),
       m_next_newconst(0), m_next_newtemp(0),
       m_stat_opt_locking_time(0), m_stat_specialization_time(0),
-      m_stop_optimizing(false),
+      m_profile(shadingsys.opt_profile() ? new OptProfile : NULL),
+      m_stop_optimizing(false), m_reused_layers_ok(true),
       m_raytypes_on(group.raytypes_on()), m_raytypes_off(group.raytypes_off())
 {
     memset (&m_shaderglobals, 0, sizeof(ShaderGlobals));
@@ -1269,6 +1270,8 @@ RuntimeOptimizer::replace_param_value (Symbol *R, const void *newdata,
     if (Ntype == TypeDesc::UNKNOWN)
         Ntype = Rtype;
     int Nnvals = int(Ntype.aggregate * Ntype.numelements());
+    // Copy on write: the instance may still share its values with others.
+    inst()->unshare_params ();
     if (Rtype.basetype == TypeDesc::FLOAT &&
           Ntype.basetype == TypeDesc::FLOAT) {
         float *Rdefault = &inst()->m_fparams[R->dataoffset()];
@@ -1352,15 +1355,8 @@ RuntimeOptimizer::make_param_use_instanceval (Symbol *R, string_view why)
 
     // Point the symbol's data pointer to its instance value
     // uniform
-    void *Rdefault = NULL;
     DASSERT (R->dataoffset() >= 0);
-    TypeDesc Rtype = R->typespec().simpletype();
-    if (Rtype.basetype == TypeDesc::FLOAT)
-        Rdefault = &inst()->m_fparams[R->dataoffset()];
-    else if (Rtype.basetype == TypeDesc::INT)
-        Rdefault = &inst()->m_iparams[R->dataoffset()];
-    else if (Rtype.basetype == TypeDesc::STRING)
-        Rdefault = &inst()->m_sparams[R->dataoffset()];
+    void *Rdefault = inst()->param_symbol_data (inst()->symbolindex (R));
     DASSERT (Rdefault != NULL);
     R->data (Rdefault);
 
@@ -1794,6 +1790,33 @@ RuntimeOptimizer::mark_outgoing_connections ()
 
 
 
+bool
+RuntimeOptimizer::check_reused_connections ()
+{
+    for (int lay = 0;  lay < group().nlayers();  ++lay) {
+        const ShaderInstance *inst = group()[lay];
+        if (group().reused_layer (lay) || inst->unused())
+            continue;
+        for (auto&& c : inst->connections()) {
+            if (! group().reused_layer (c.srclayer))
+                continue;
+            // The reused layer's code only stores the outputs that were
+            // connected downstream when it was JITed.
+            const ShaderInstance *up = group()[c.srclayer];
+            const Symbol *src = up->symbol (c.src.param);
+            if (up->unused() || ! src || ! src->connected_down())
+                return false;
+            if (inst->symbol(c.dst.param)->has_derivs() && ! src->has_derivs() &&
+                ! src->typespec().is_closure_based() &&
+                src->typespec().elementtype().is_floatbased())
+                return false;
+        }
+    }
+    return true;
+}
+
+
+
 /// Check all params and output params to find any that are neither used
 /// in the shader (aside from their own init ops, which shouldn't count)
 /// nor connected to downstream layers, and for those, remove their init
@@ -2142,7 +2165,17 @@ RuntimeOptimizer::optimize_ops (int beginop, int endop,
         // constant-fold, dispatch to the appropriate routine.
         if (optimize() >= 2 && m_opt_constant_fold) {
             if (opd && opd->folder) {
-                int c = (*opd->folder) (*this, opnum);
+                int c;
+                if (m_profile) {
+                    Timer timer;
+                    c = (*opd->folder) (*this, opnum);
+                    OptProfile::Entry &e (m_profile->folders[op->opname()]);
+                    e.time += timer();
+                    e.calls += 1;
+                    e.changes += c;
+                } else {
+                    c = (*opd->folder) (*this, opnum);
+                }
                 if (c) {
                     changed += c;
                     // Re-check num_ops in case the folder inserted something
@@ -2264,6 +2297,7 @@ RuntimeOptimizer::optimize_instance ()
     // outputs that are known to be constants or globals into constants
     // or global aliases without any connection.
     if (optimize() >= 2 && m_opt_simplify_param) {
+        OptProfileTimer prof (m_profile.get(), OptProfile::SimplifyParams);
         simplify_params ();
     }
 
@@ -2287,6 +2321,7 @@ RuntimeOptimizer::optimize_instance ()
     int totalchanged = 0;
     int reallydone = 0;   // Force a few passes after we think we're done
     int npasses = shadingsys().opt_passes();
+    int max_idle_passes = shadingsys().opt_adaptive_passes() ? 1 : 3;
     for (m_pass = 0;  m_pass < npasses;  ++m_pass) {
 
         // Once we've made one pass (and therefore called
@@ -2303,8 +2338,11 @@ RuntimeOptimizer::optimize_instance ()
                        layer(), inst()->layername(), m_pass);
 
         // Track basic blocks and conditional states
-        find_conditionals ();
-        find_basic_blocks ();
+        {
+            OptProfileTimer prof (m_profile.get(), OptProfile::BasicBlocks);
+            find_conditionals ();
+            find_basic_blocks ();
+        }
 
         // Clear local messages for this instance
         m_local_unknown_message_sent = false;
@@ -2312,16 +2350,25 @@ RuntimeOptimizer::optimize_instance ()
 
         // Figure out which params are just aliases for globals (only
         // necessary to do once, on the first pass).
-        if (m_pass == 0 && optimize() >= 2)
+        if (m_pass == 0 && optimize() >= 2) {
+            OptProfileTimer prof (m_profile.get(), OptProfile::ParamsHoldingGlobals);
             find_params_holding_globals ();
+        }
 
         // Here is the meat of the optimization, where we pass over the
         // code for this instance and make various transformations.
-        int changed = optimize_ops (0, (int)inst()->ops().size());
+        int changed;
+        {
+            OptProfileTimer prof (m_profile.get(), OptProfile::OptimizeOps);
+            changed = prof.changes (optimize_ops (0, (int)inst()->ops().size()));
+        }
 
         // Now that we've rewritten the code, we need to re-track the
         // variable lifetimes.
-        track_variable_lifetimes ();
+        {
+            OptProfileTimer prof (m_profile.get(), OptProfile::VariableLifetimes);
+            track_variable_lifetimes ();
+        }
 
         // Recompute which of our params have downstream connections.
         mark_outgoing_connections ();
@@ -2329,15 +2376,18 @@ RuntimeOptimizer::optimize_instance ()
         // Find situations where an output is simply a copy of a connected
         // input, and eliminate the middleman.
         if (optimize() >= 2 && m_opt_middleman) {
-            int c = eliminate_middleman ();
+            OptProfileTimer prof (m_profile.get(), OptProfile::EliminateMiddleman);
+            int c = prof.changes (eliminate_middleman ());
             if (c)
                 mark_outgoing_connections ();
             changed += c;
         }
 
         // Elide unconnected parameters that are never read.
-        if (optimize() >= 1)
-            changed += remove_unused_params ();
+        if (optimize() >= 1) {
+            OptProfileTimer prof (m_profile.get(), OptProfile::RemoveUnusedParams);
+            changed += prof.changes (remove_unused_params ());
+        }
 
         // FIXME -- we should re-evaluate whether writes_globals() is still
         // true for this layer.
@@ -2345,9 +2395,16 @@ RuntimeOptimizer::optimize_instance ()
         // If nothing changed, we're done optimizing.  But wait, it may be
         // that after re-tracking variable lifetimes, we can notice new
         // optimizations!  So force another pass, then we're really done.
+        // With "opt_adaptive_passes", one such extra pass is enough: it's
+        // only needed because an idle pass may still have quietly
+        // replaced args with their aliases.
         totalchanged += changed;
+        if (m_profile) {
+            m_profile->layer_passes += 1;
+            m_profile->idle_passes += (changed < 1);
+        }
         if (changed < 1) {
-            if (++reallydone > 3)
+            if (++reallydone > max_idle_passes)
                 break;
         } else {
             reallydone = 0;
@@ -2369,6 +2426,14 @@ RuntimeOptimizer::optimize_instance ()
     // Now that we've optimized this layer, walk through the ops and
     // note which messages may have been sent, so subsequent layers will
     // know.
+    track_messages_sent ();
+}
+
+
+
+void
+RuntimeOptimizer::track_messages_sent ()
+{
     for (auto& op : inst()->ops()) {
         if (op.opname() == u_setmessage) {
             Symbol &Name (*inst()->argsymbol(op.firstarg()+0));
@@ -2382,6 +2447,207 @@ RuntimeOptimizer::optimize_instance ()
 
 
 
+std::string
+RuntimeOptimizer::specialization_key (int phase)
+{
+    ShaderInstance *in = inst();
+    if (in->connections().size())
+        return std::string();
+
+    std::string key;
+    auto add = [&](const void *data, size_t size) {
+        key.append ((const char *)data, size);
+    };
+    auto add_int = [&](int val) { add (&val, sizeof(val)); };
+    auto add_ptr = [&](const void *ptr) { add (&ptr, sizeof(ptr)); };
+
+    if (phase == 0) {
+        // The master, param values, and param attributes determine the
+        // instance's code and symbols as they were when we started.  (The
+        // master stays alive as long as the cache entry, so its address
+        // can't be reused by another.)
+        add_ptr (in->master());
+        if (in->m_shared_params) {
+            // Shared values are interned, so the same values are always
+            // the same block (which the cache entry keeps alive).
+            add_int (-1);
+            add_ptr (in->m_shared_params.get());
+        } else {
+            add_int ((int) in->m_iparams.size());
+            add (in->m_iparams.data(), in->m_iparams.size()*sizeof(int));
+            add_int ((int) in->m_fparams.size());
+            add (in->m_fparams.data(), in->m_fparams.size()*sizeof(float));
+            add_int ((int) in->m_sparams.size());
+            for (ustring s : in->m_sparams)
+                add_ptr (s.c_str());
+        }
+        FOREACH_PARAM (const Symbol &s, in) {
+            add_int (s.typespec().arraylength());
+            add_int (s.valuesource() | (s.lockgeom() << 4) |
+                     (s.renderer_output() << 5) | (s.has_init_ops() << 6));
+            add_int (s.dataoffset());
+        }
+        add_int (in->entry_layer() | (in->last_layer() << 1) |
+                 (in->writes_globals() << 2) | (in->userdata_params() << 3) |
+                 (in->renderer_outputs() << 4) | (in->merged_unused() << 5));
+        add_int (m_raytypes_on);
+        add_int (m_raytypes_off);
+        // getattribute() may fold to things about the layer or the group
+        // itself: "shader:layername", "shader:groupname", or the
+        // attributes of the object it's a variant for.
+        for (auto&& op : in->ops()) {
+            if (op.opname() == u_getattribute) {
+                add_ptr (in->layername().c_str());
+                add_ptr (group().name().c_str());
+                add_int ((int) group().object_variant_key().size());
+                key += group().object_variant_key();
+                break;
+            }
+        }
+    } else {
+        // The first optimization was itself determined by its key, so
+        // the code and symbols we start with now are, too.
+        if (m_specialization_keys[layer()].empty())
+            return std::string();
+        key = m_specialization_keys[layer()];
+        key += '\1';
+    }
+
+    // Which outputs are connected downstream, which messages earlier
+    // layers may have set, and how we're optimizing.
+    FOREACH_PARAM (const Symbol &s, in)
+        key += char(s.connected_down());
+    add_int (in->outgoing_connections());
+    std::vector<const char *> messages;
+    for (ustring m : m_messages_sent)
+        messages.push_back (m.c_str());
+    std::sort (messages.begin(), messages.end());
+    messages.erase (std::unique (messages.begin(), messages.end()), messages.end());
+    add_int (m_unknown_message_sent);
+    add_int ((int) messages.size());
+    for (const char *m : messages)
+        add_ptr (m);
+    add_int (m_optimize);
+    add_int (m_opt_simplify_param | (m_opt_constant_fold << 1) |
+             (m_opt_stale_assign << 2) | (m_opt_elide_useless_ops << 3) |
+             (m_opt_elide_unconnected_outputs << 4) | (m_opt_peephole << 5) |
+             (m_opt_coalesce_temps << 6) | (m_opt_assign << 7) |
+             (m_opt_mix << 8) | (m_opt_middleman << 9));
+    return key;
+}
+
+
+
+// If ptr points to one of the values in from, return a pointer to the
+// corresponding value in to.
+template<class T>
+static bool
+rebase_data (void *&ptr, const std::vector<T> &from, std::vector<T> &to)
+{
+    const T *begin = from.data(), *end = begin + from.size();
+    if (ptr >= (const void *)begin && ptr < (const void *)end) {
+        ptr = to.data() + ((const T *)ptr - begin);
+        return true;
+    }
+    return false;
+}
+
+
+
+// Point the data of any symbols that refer to param values held in one
+// set of arrays at the same values in another.
+static void
+rebase_param_data (SymbolVec &syms,
+                   const std::vector<int> &ifrom, std::vector<int> &ito,
+                   const std::vector<float> &ffrom, std::vector<float> &fto,
+                   const std::vector<ustring> &sfrom, std::vector<ustring> &sto)
+{
+    for (auto&& s : syms) {
+        void *data = s.data();
+        if (rebase_data (data, ifrom, ito) || rebase_data (data, ffrom, fto) ||
+            rebase_data (data, sfrom, sto))
+            s.data (data);
+    }
+}
+
+
+
+void
+RuntimeOptimizer::optimize_instance_memoized (int phase)
+{
+    ShadingSystemImpl &ss (shadingsys());
+    std::string key;
+    if (ss.m_opt_specialization_cache > 0 && ! debug() && ! ss.m_opt_layername)
+        key = specialization_key (phase);
+    if (phase == 0)
+        m_specialization_keys[layer()] = key;
+    if (key.empty()) {
+        optimize_instance ();
+        return;
+    }
+
+    ShaderInstance *in = inst();
+    SpecializedInstanceRef spec = ss.find_specialization (key);
+    if (spec) {
+        // Somebody already did the work; copy the result.  If its values
+        // stayed shared, they're ours too (the key says so), and the
+        // symbols already point at them.
+        in->m_instsymbols = spec->symbols;
+        in->m_instops = spec->ops;
+        in->m_instargs = spec->args;
+        if (! spec->shared_params) {
+            in->unshare_params ();
+            in->m_iparams = spec->iparams;
+            in->m_fparams = spec->fparams;
+            in->m_sparams = spec->sparams;
+            rebase_param_data (in->m_instsymbols, spec->iparams, in->m_iparams,
+                               spec->fparams, in->m_fparams,
+                               spec->sparams, in->m_sparams);
+        }
+        DASSERT (spec->shared_params == in->m_shared_params);
+        in->m_firstparam = spec->firstparam;
+        in->m_lastparam = spec->lastparam;
+        in->m_maincodebegin = spec->maincodebegin;
+        in->m_maincodeend = spec->maincodeend;
+        in->writes_globals (spec->writes_globals);
+        in->userdata_params (spec->userdata_params);
+        m_params_holding_globals[layer()] = spec->params_holding_globals;
+        m_next_newconst += spec->newconsts;
+        m_next_newtemp += spec->newtemps;
+        mark_outgoing_connections ();
+        track_messages_sent ();
+        return;
+    }
+
+    int newconst = m_next_newconst, newtemp = m_next_newtemp;
+    optimize_instance ();
+
+    spec.reset (new SpecializedInstance);
+    spec->master = in->m_master;
+    spec->symbols = in->m_instsymbols;
+    spec->ops = in->m_instops;
+    spec->args = in->m_instargs;
+    spec->iparams = in->m_iparams;
+    spec->fparams = in->m_fparams;
+    spec->sparams = in->m_sparams;
+    spec->shared_params = in->m_shared_params;
+    rebase_param_data (spec->symbols, in->m_iparams, spec->iparams,
+                       in->m_fparams, spec->fparams,
+                       in->m_sparams, spec->sparams);
+    spec->firstparam = in->m_firstparam;
+    spec->lastparam = in->m_lastparam;
+    spec->maincodebegin = in->m_maincodebegin;
+    spec->maincodeend = in->m_maincodeend;
+    spec->writes_globals = in->writes_globals();
+    spec->userdata_params = in->userdata_params();
+    spec->params_holding_globals = m_params_holding_globals[layer()];
+    spec->newconsts = m_next_newconst - newconst;
+    spec->newtemps = m_next_newtemp - newtemp;
+    ss.add_specialization (key, spec);
+}
+
+
+
 void
 RuntimeOptimizer::resolve_isconnected ()
 {
@@ -2447,18 +2713,19 @@ RuntimeOptimizer::track_variable_lifetimes ()
 //#define DEBUG_SYMBOL_DEPENDENCIES
 
 // Add to the dependency map that "symbol A depends on symbol B".
+// Fake symbol index for "derivatives" entry in dependency map.
+static const int DerivSym = -1;
+
+
+
 void
 RuntimeOptimizer::add_dependency (SymDependency &dmap, int A, int B)
 {
-    ASSERT (A < (int)inst()->symbols().size());
-    ASSERT (B < (int)inst()->symbols().size());
-    dmap[A].insert (B);
-
-#ifdef DEBUG_SYMBOL_DEPENDENCIES
-    // Unification -- make all of B's dependencies be dependencies of A.
-    for (auto&& r : dmap[B])
-        dmap[A].insert (r);
-#endif
+    // Symbol indices are the graph's nodes, with one more at the end to
+    // stand for "derivatives" (see DerivSym).
+    int nsyms = (int)inst()->symbols().size();
+    ASSERT (A < nsyms && B < nsyms);
+    dmap.add (A == DerivSym ? nsyms : A, B == DerivSym ? nsyms : B);
 }
 
 
@@ -2481,27 +2748,19 @@ RuntimeOptimizer::syms_used_in_op (Opcode &op, std::vector<int> &rsyms,
 
 
 
-// Fake symbol index for "derivatives" entry in dependency map.
-static const int DerivSym = -1;
-
-
-// Recursively mark symbols that have derivatives from dependency map
+// Mark symbols that have derivatives from dependency map
 void
-RuntimeOptimizer::mark_symbol_derivatives (SymDependency &symdeps, SymIntSet &visited, int d)
+RuntimeOptimizer::mark_symbol_derivatives (const SymDependency &symdeps, int d)
 {
-    for (auto&& r : symdeps[d]) {
-        if (visited.find(r) == visited.end()) {
-            visited.insert(r);
-            
-            Symbol *s = inst()->symbol(r);
-
-            if (! s->typespec().is_closure_based() && 
-                    s->typespec().elementtype().is_floatbased())
-                s->has_derivs (true);
-
-            mark_symbol_derivatives(symdeps, visited, r);
-        }
-    }
+    int nsyms = (int)inst()->symbols().size();
+    symdeps.visit_dependencies (d == DerivSym ? nsyms : d, [&](int r) {
+        if (r == nsyms)
+            return;   // DerivSym itself
+        Symbol *s = inst()->symbol(r);
+        if (! s->typespec().is_closure_based() &&
+                s->typespec().elementtype().is_floatbased())
+            s->has_derivs (true);
+    });
 }
 
 
@@ -2611,8 +2870,8 @@ RuntimeOptimizer::track_variable_dependencies ()
     }
 
     // Mark all symbols needing derivatives as such
-    SymIntSet visited;
-    mark_symbol_derivatives (symdeps, visited, DerivSym);
+    symdeps.finalize ((int)inst()->symbols().size() + 1);
+    mark_symbol_derivatives (symdeps, DerivSym);
 
     // Only some globals are allowed to have derivatives
     for (auto&& s : inst()->symbols()) {
@@ -2627,42 +2886,38 @@ RuntimeOptimizer::track_variable_dependencies ()
 
 #ifdef DEBUG_SYMBOL_DEPENDENCIES
     // Helpful for debugging
+    int nsyms = (int)inst()->symbols().size();
+    auto symname = [&](int n) {
+        return n == nsyms ? std::string("$derivs")
+                          : inst()->symbol(n)->mangled().string();
+    };
 
     std::cerr << "track_variable_dependencies\n";
     std::cerr << "\nDependencies:\n";
-    for (auto&& m : symdeps) {
-        if (m.first == DerivSym)
-            std::cerr << "$derivs depends on ";
-        else
-            std::cerr << inst->symbol(m.first)->mangled() << " depends on ";
-        for (auto&& d : m.second) {
-            if (d == DerivSym)
-                std::cerr << "$derivs ";
-            else
-                std::cerr << inst->symbol(d)->mangled() << ' ';
-        }
+    for (int n = 0; n <= nsyms; ++n) {
+        if (symdeps.deps_begin(n) == symdeps.deps_end(n))
+            continue;
+        std::cerr << symname(n) << " depends on ";
+        for (const int *d = symdeps.deps_begin(n); d != symdeps.deps_end(n); ++d)
+            std::cerr << symname(*d) << ' ';
         std::cerr << "\n";
     }
     std::cerr << "\n\n";
 
     // Invert the dependency
     SymDependency influences;
-    for (auto&& m : symdeps)
-        for (auto&& d : m.second)
-            influences[d].insert (m.first);
+    for (int n = 0; n <= nsyms; ++n)
+        for (const int *d = symdeps.deps_begin(n); d != symdeps.deps_end(n); ++d)
+            influences.add (*d, n);
+    influences.finalize (nsyms+1);
 
     std::cerr << "\nReverse dependencies:\n";
-    for (auto&& m : influences) {
-        if (m.first == DerivSym)
-            std::cerr << "$derivs contrbutes to ";
-        else
-            std::cerr << inst->symbol(m.first)->mangled() << " contributes to ";
-        for (auto&& d : m.second) {
-            if (d == DerivSym)
-                std::cerr << "$derivs ";
-            else
-                std::cerr << inst->symbol(d)->mangled() << ' ';
-        }
+    for (int n = 0; n <= nsyms; ++n) {
+        if (influences.deps_begin(n) == influences.deps_end(n))
+            continue;
+        std::cerr << symname(n) << " contributes to ";
+        for (const int *d = influences.deps_begin(n); d != influences.deps_end(n); ++d)
+            std::cerr << symname(*d) << ' ';
         std::cerr << "\n";
     }
     std::cerr << "\n\n";
@@ -2766,10 +3021,15 @@ RuntimeOptimizer::post_optimize_instance ()
     m_in_conditional.clear ();
     m_in_loop.clear ();
 
-    add_useparam (allsymptrs);
+    {
+        OptProfileTimer prof (m_profile.get(), OptProfile::AddUseparam);
+        add_useparam (allsymptrs);
+    }
 
-    if (optimize() >= 1 && m_opt_coalesce_temps)
+    if (optimize() >= 1 && m_opt_coalesce_temps) {
+        OptProfileTimer prof (m_profile.get(), OptProfile::CoalesceTemporaries);
         coalesce_temporaries ();
+    }
 }
 
 
@@ -3021,16 +3281,40 @@ RuntimeOptimizer::run ()
     if (debug())
         std::cout << "About to optimize shader group " << group().name() << "\n";
 
+    // A group respecialized around the optimized instances of some of
+    // its layers (see ShadingSystemImpl::respecialize_downstream) leaves
+    // those alone, and only optimizes the others.  Their code is already
+    // JITed, and their ops are gone.  Nor are any instances merged, which
+    // would change what the reused layers' code is connected to.
+    bool reuse = group().reuses_layers();
+
+    bool code_ok = true;
     for (int layer = 0;  layer < nlayers;  ++layer) {
+        if (group().reused_layer (layer))
+            continue;
         set_inst (layer);
         // These need to happen before merge_instances
-        inst()->copy_code_from_master (group());
-        mark_outgoing_connections();
+        OptProfileTimer prof (m_profile.get(), OptProfile::CopyCode);
+        if (inst()->copy_code_from_master (group()))
+            mark_outgoing_connections();
+        else
+            code_ok = false;
+    }
+    if (! code_ok) {
+        // Some master's code was evicted and couldn't be reloaded as it
+        // was.  There's nothing sensible to run, so the group does
+        // nothing rather than running code that doesn't match.
+        shadingcontext()->error ("Shader group \"%s\" could not be optimized: the code of one of its shaders could not be reloaded",
+                                 group().name());
+        group().does_nothing (true);
+        return;
     }
 
     // Inventory the network and print pre-optimized debug info
     size_t old_nsyms = 0, old_nops = 0;
     for (int layer = 0;  layer < nlayers;  ++layer) {
+        if (group().reused_layer (layer))
+            continue;
         set_inst (layer);
         if (debug() /* && optimize() >= 1*/) {
             find_basic_blocks ();
@@ -3044,46 +3328,66 @@ RuntimeOptimizer::run ()
         old_nops += inst()->ops().size();
     }
 
-    if (shadingsys().m_opt_merge_instances == 1)
-        shadingsys().merge_instances (group());
+    if (shadingsys().m_opt_merge_instances == 1 && ! reuse) {
+        OptProfileTimer prof (m_profile.get(), OptProfile::MergeInstances);
+        prof.changes (shadingsys().merge_instances (group()));
+    }
 
     m_params_holding_globals.resize (nlayers);
+    m_specialization_keys.resize (nlayers);
 
     // Optimize each layer, from first to last
     for (int layer = 0;  layer < nlayers;  ++layer) {
+        if (group().reused_layer (layer))
+            continue;
         set_inst (layer);
         if (inst()->unused())
             continue;
         // N.B. we need to resolve isconnected() calls before the instance
         // is otherwise optimized, or else isconnected() may not reflect
         // the original connectivity after substitutions are made.
-        resolve_isconnected ();
-        optimize_instance ();
+        {
+            OptProfileTimer prof (m_profile.get(), OptProfile::ResolveIsconnected);
+            resolve_isconnected ();
+        }
+        optimize_instance_memoized (0);
     }
 
     // Optimize each layer again, from last to first (because some
     // optimizations are only apparent when the subsequent shaders have
     // been simplified).
     for (int layer = nlayers-1;  layer >= 0;  --layer) {
+        if (group().reused_layer (layer))
+            continue;
         set_inst (layer);
         if (! inst()->unused())
-            optimize_instance ();
+            optimize_instance_memoized (1);
     }
 
     // Try merging instances again, now that we've optimized
-    shadingsys().merge_instances (group(), true);
+    if (! reuse) {
+        OptProfileTimer prof (m_profile.get(), OptProfile::MergeInstances);
+        prof.changes (shadingsys().merge_instances (group(), true));
+    }
 
     for (int layer = nlayers-1;  layer >= 0;  --layer) {
+        if (group().reused_layer (layer))
+            continue;
         set_inst (layer);
         if (inst()->unused())
             continue;
-        find_basic_blocks ();
-        track_variable_dependencies ();
+        {
+            OptProfileTimer prof (m_profile.get(), OptProfile::VariableDependencies);
+            find_basic_blocks ();
+            track_variable_dependencies ();
+        }
 
         // For our parameters that require derivatives, mark their
-        // upstream connections as also needing derivatives.
+        // upstream connections as also needing derivatives.  (Reused
+        // layers can't be given any; see check_reused_connections.)
         for (auto&& c : inst()->m_connections) {
-            if (inst()->symbol(c.dst.param)->has_derivs()) {
+            if (inst()->symbol(c.dst.param)->has_derivs() &&
+                ! group().reused_layer (c.srclayer)) {
                 Symbol *source = group()[c.srclayer]->symbol(c.src.param);
                 if (! source->typespec().is_closure_based() &&
                     source->typespec().elementtype().is_floatbased()) {
@@ -3095,21 +3399,32 @@ RuntimeOptimizer::run ()
 
     // Post-opt cleanup: add useparam, coalesce temporaries, etc.
     for (int layer = 0;  layer < nlayers;  ++layer) {
+        if (group().reused_layer (layer))
+            continue;
         set_inst (layer);
         post_optimize_instance ();
     }
 
     // Last chance to eliminate duplicate instances
-    shadingsys().merge_instances (group(), true);
+    if (! reuse) {
+        OptProfileTimer prof (m_profile.get(), OptProfile::MergeInstances);
+        prof.changes (shadingsys().merge_instances (group(), true));
+    }
 
     // Get rid of nop instructions and unused symbols.
     size_t new_nsyms = 0, new_nops = 0, new_deriv_syms = 0;
     for (int layer = 0;  layer < nlayers;  ++layer) {
+        if (group().reused_layer (layer))
+            continue;
         set_inst (layer);
         if (inst()->unused())
             continue;  // no need to print or gather stats for unused layers
         if (optimize() >= 1) {
-            collapse_syms ();
+            {
+                OptProfileTimer prof (m_profile.get(), OptProfile::CollapseSyms);
+                collapse_syms ();
+            }
+            OptProfileTimer prof (m_profile.get(), OptProfile::CollapseOps);
             collapse_ops ();
         }
         if (debug() && !inst()->unused()) {
@@ -3123,6 +3438,9 @@ RuntimeOptimizer::run ()
         new_nops += inst()->ops().size();
     }
 
+    if (reuse)
+        m_reused_layers_ok = check_reused_connections ();
+
     m_unknown_textures_needed = false;
     m_unknown_closures_needed = false;
     m_unknown_attributes_needed = false;
@@ -3136,6 +3454,10 @@ RuntimeOptimizer::run ()
         set_inst (layer);
         if (inst()->unused())
             continue;  // no need to print or gather stats for unused layers
+        // A reused layer's ops are gone, so it's taken to do something,
+        // and only its symbols are gathered here.
+        if (group().reused_layer (layer))
+            does_nothing = false;
         FOREACH_SYM (Symbol &s, inst()) {
             // set the layer numbers
             s.layer (layer);
@@ -3233,6 +3555,8 @@ RuntimeOptimizer::run ()
         ss.m_stat_syms_with_derivs += new_deriv_syms;
         if (does_nothing)
             ss.m_stat_empty_groups += 1;
+        if (m_profile)
+            ss.m_stat_opt_profile.merge (*m_profile);
     }
     if (shadingsys().m_compile_report) {
         shadingcontext()->info ("Optimized shader group %s:", group().name());
@@ -3267,5 +3591,112 @@ RuntimeOptimizer::run ()
 }
 
 
+
+
+const char *
+OptProfile::pass_name (int pass)
+{
+    static const char *names[NumPasses] = {
+        "copy_code", "resolve_isconnected", "simplify_params",
+        "find_params_holding_globals", "find_basic_blocks", "optimize_ops",
+        "track_variable_lifetimes", "eliminate_middleman",
+        "remove_unused_params", "merge_instances",
+        "track_variable_dependencies", "add_useparam",
+        "coalesce_temporaries", "collapse_syms", "collapse_ops"
+    };
+    return pass >= 0 && pass < NumPasses ? names[pass] : "";
+}
+
+
+
+void
+OptProfile::merge (const OptProfile &p)
+{
+    for (int i = 0;  i < NumPasses;  ++i) {
+        passes[i].time += p.passes[i].time;
+        passes[i].calls += p.passes[i].calls;
+        passes[i].changes += p.passes[i].changes;
+    }
+    for (auto&& f : p.folders) {
+        Entry &e (folders[f.first]);
+        e.time += f.second.time;
+        e.calls += f.second.calls;
+        e.changes += f.second.changes;
+    }
+    layer_passes += p.layer_passes;
+    idle_passes += p.idle_passes;
+}
+
+
+
+void
+OptProfile::print (std::ostream &out, int level) const
+{
+    if (! layer_passes)
+        return;
+    out << Strutil::format ("    Optimizer profile: %lld layer passes, %lld (%.1f%%) changed nothing\n",
+                            layer_passes, idle_passes,
+                            (100.0 * idle_passes) / layer_passes);
+    for (int i = 0;  i < NumPasses;  ++i) {
+        const Entry &e (passes[i]);
+        if (! e.calls)
+            continue;
+        out << Strutil::format ("      %-28s %10s  %8lld runs  %8lld changes\n",
+                                pass_name(i),
+                                Strutil::timeintervalformat (e.time, 2),
+                                e.calls, e.changes);
+    }
+
+    // Constant folders, most expensive first
+    std::vector<std::pair<double,ustring> > sorted;
+    for (auto&& f : folders)
+        sorted.emplace_back (f.second.time, f.first);
+    std::sort (sorted.begin(), sorted.end(),
+               [](const std::pair<double,ustring> &a,
+                  const std::pair<double,ustring> &b) {
+                   return a.first > b.first;
+               });
+    if (level < 3 && sorted.size() > 10)
+        sorted.resize (10);
+    if (sorted.size())
+        out << "      Most expensive constant folders:\n";
+    for (auto&& f : sorted) {
+        const Entry &e (folders.find (f.second)->second);
+        out << Strutil::format ("        %-26s %10s  %8lld calls  %8lld folds\n",
+                                f.second, Strutil::timeintervalformat (e.time, 2),
+                                e.calls, e.changes);
+    }
+}
+
+
+
+std::string
+OptProfile::json () const
+{
+    std::ostringstream out;
+    out << Strutil::format ("{\"layer_passes\": %lld, \"idle_passes\": %lld, \"passes\": {",
+                            layer_passes, idle_passes);
+    bool first = true;
+    for (int i = 0;  i < NumPasses;  ++i) {
+        const Entry &e (passes[i]);
+        out << Strutil::format ("%s\"%s\": {\"time\": %.6f, \"calls\": %lld, \"changes\": %lld}",
+                                first ? "" : ", ", pass_name(i),
+                                e.time, e.calls, e.changes);
+        first = false;
+    }
+    out << "}, \"folders\": {";
+    first = true;
+    for (auto&& f : folders) {
+        const Entry &e (f.second);
+        out << Strutil::format ("%s\"%s\": {\"time\": %.6f, \"calls\": %lld, \"changes\": %lld}",
+                                first ? "" : ", ", f.first,
+                                e.time, e.calls, e.changes);
+        first = false;
+    }
+    out << "}}";
+    return out.str();
+}
+
+
 }; // namespace pvt
 OSL_NAMESPACE_EXIT
@@ -37,6 +37,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define USE_FLAT_MAP 1
 
 #include "oslexec_pvt.h"
+#include "symdependency.h"
 using namespace OSL;
 using namespace OSL::pvt;
 
@@ -55,6 +56,56 @@ typedef std::set<int> FastIntSet;
 
 
 
+/// The result of optimizing one instance, saved so that it may be copied
+/// to any other instance with the same specialization (see RuntimeOptimizer::
+/// specialization_key).  The entry keeps its own copy of the instance's
+/// param values; symbols whose data point into them are rebased when the
+/// entry is copied in or out.
+struct SpecializedInstance {
+    ShaderMaster::ref master;           ///< Keeps the master's data alive
+    SymbolVec symbols;
+    OpcodeVec ops;
+    std::vector<int> args;
+    std::vector<int> iparams;
+    std::vector<float> fparams;
+    std::vector<ustring> sparams;
+    InstanceParamsRef shared_params;    ///< Or the values it still shares
+    int firstparam, lastparam;
+    int maincodebegin, maincodeend;
+    bool writes_globals, userdata_params;
+    std::unordered_map<ustring,ustring,ustringHash> params_holding_globals;
+    int newconsts, newtemps;            ///< Consts and temps it added
+};
+
+
+
+/// Add the time spent in a scope to one pass of an OptProfile, if it's
+/// being gathered (i.e., if the profile pointer isn't NULL).
+class OptProfileTimer {
+public:
+    OptProfileTimer (OptProfile *profile, OptProfile::Pass pass)
+        : m_entry(profile ? &profile->passes[pass] : NULL),
+          m_timer(profile ? OIIO::Timer::StartNow : OIIO::Timer::DontStartNow)
+    { }
+    ~OptProfileTimer () {
+        if (m_entry) {
+            m_entry->time += m_timer();
+            m_entry->calls += 1;
+        }
+    }
+    /// Record the number of changes the pass made, and pass it through.
+    int changes (int c) {
+        if (m_entry)
+            m_entry->changes += c;
+        return c;
+    }
+private:
+    OptProfile::Entry *m_entry;
+    OIIO::Timer m_timer;
+};
+
+
+
 /// OSOProcessor that does runtime optimization on shaders.
 class RuntimeOptimizer : public OSOProcessorBase {
 public:
@@ -78,10 +129,26 @@ public:
     int raytypes_on ()  const { return m_raytypes_on; }
     int raytypes_off () const { return m_raytypes_off; }
 
+    /// If the group reuses the optimized instances of some layers (see
+    /// ShaderGroup::reused_layer), did the others come out able to work
+    /// with them as they are?
+    bool reused_layers_ok () const { return m_reused_layers_ok; }
+
     /// Optimize one layer of a group, given what we know about its
     /// instance variables and connections.
     void optimize_instance ();
 
+    /// Like optimize_instance, but if an instance with the same
+    /// specialization was already optimized (in this group or another),
+    /// just copy the result.  Phase is 0 for a layer's first optimization
+    /// and 1 for its second.
+    void optimize_instance_memoized (int phase);
+
+    /// Return a string that identifies everything that optimize_instance
+    /// depends on for the current instance, or an empty string if it
+    /// depends on things we don't capture (i.e., incoming connections).
+    std::string specialization_key (int phase);
+
     /// One optimization pass over a range of instructions [begin, end).
     /// Return the number of changes made. If seed_block_aliases is not
     /// NULL, use that as the initial set of block_aliases.
@@ -317,8 +384,7 @@ public:
 
     /// For each symbol, have a list of the symbols it depends on (or that
     /// depends on it).
-    typedef std::set<int> SymIntSet;
-    typedef std::map<int, SymIntSet> SymDependency;
+    typedef SymDependencyGraph SymDependency;
 
     void syms_used_in_op (Opcode &op,
                           std::vector<int> &rsyms, std::vector<int> &wsyms);
@@ -327,12 +393,20 @@ public:
 
     void add_dependency (SymDependency &dmap, int A, int B);
 
-    void mark_symbol_derivatives (SymDependency &symdeps, SymIntSet &visited, int d);
+    void mark_symbol_derivatives (const SymDependency &symdeps, int d);
 
     void mark_outgoing_connections ();
 
+    /// Check that the layers optimized anew take from the reused layers
+    /// only outputs those already compute, with derivs if needed.
+    bool check_reused_connections ();
+
     int remove_unused_params ();
 
+    /// Note the messages that the current instance may set, for
+    /// subsequent layers.
+    void track_messages_sent ();
+
     /// Turn isconnected() calls into constant assignments
     void resolve_isconnected ();
 
@@ -430,6 +504,8 @@ private:
     typedef std::unordered_map<ustring,ustring,ustringHash> ustringmap_t;
     std::vector<ustringmap_t> m_params_holding_globals;
                    ///< Which params of each layer really just hold globals
+    std::vector<std::string> m_specialization_keys;
+                   ///< Key of each layer's first optimization
 
     // All below is just for the one inst we're optimizing at the moment:
     int m_pass;                       ///< Optimization pass we're on now
@@ -453,7 +529,9 @@ private:
     std::set<UserDataNeeded> m_userdata_needed;
     double m_stat_opt_locking_time;       ///<   locking time
     double m_stat_specialization_time;    ///<   specialization time
+    std::unique_ptr<OptProfile> m_profile; ///< Pass profile, if gathered
     bool m_stop_optimizing;           ///< for debugging
+    bool m_reused_layers_ok;          ///< Redone layers fit the reused ones?
     int m_raytypes_on;                ///< Ray types known to be on
     int m_raytypes_off;               ///< Ray types known to be off
 
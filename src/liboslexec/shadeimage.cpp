@@ -205,6 +205,7 @@ shade_image (ShadingSystem &shadingsys, ShaderGroup &group,
 
     // We're done shading with this context.
     shadingsys.release_context (ctx);
+    shadingsys.flush_errors ();
 
     // Now that we're done rendering, release the thread-specific
     // pointer we saved.  A simple app could skip this; but if the app
@@ -185,6 +185,51 @@ ShadingSystem::ConnectShaders (string_view srclayer, string_view srcparam,
 
 
 
+ShaderGroupRef
+ShadingSystem::ShaderGroupCreate (string_view groupname)
+{
+    return m_impl->ShaderGroupCreate (groupname);
+}
+
+
+
+bool
+ShadingSystem::Parameter (ShaderGroup &group, string_view name, TypeDesc t,
+                          const void *val, bool lockgeom)
+{
+    return m_impl->Parameter (group, name, t, val, lockgeom);
+}
+
+
+
+bool
+ShadingSystem::Shader (ShaderGroup &group, string_view shaderusage,
+                       string_view shadername, string_view layername)
+{
+    return m_impl->Shader (group, shaderusage, shadername, layername);
+}
+
+
+
+bool
+ShadingSystem::ConnectShaders (ShaderGroup &group,
+                               string_view srclayer, string_view srcparam,
+                               string_view dstlayer, string_view dstparam)
+{
+    return m_impl->ConnectShaders (group, srclayer, srcparam,
+                                   dstlayer, dstparam);
+}
+
+
+
+bool
+ShadingSystem::ShaderGroupEnd (ShaderGroup &group)
+{
+    return m_impl->ShaderGroupEnd (group);
+}
+
+
+
 bool
 ShadingSystem::ReParameter (ShaderGroup &group, string_view layername,
                             string_view paramname, TypeDesc type,
@@ -195,6 +240,33 @@ ShadingSystem::ReParameter (ShaderGroup &group, string_view layername,
 
 
 
+bool
+ShadingSystem::respecialize_group (ShaderGroup &group)
+{
+    return m_impl->respecialize_group (group);
+}
+
+
+
+ShaderGroupRef
+ShadingSystem::object_variant (ShaderGroup *group,
+                               const ParamValueList &attributes)
+{
+    DASSERT (group);
+    return m_impl->object_variant (*group, attributes);
+}
+
+
+
+ShaderGroupRef
+ShadingSystem::object_variant (ShaderGroup *group, void *objdata)
+{
+    DASSERT (group);
+    return m_impl->object_variant (*group, objdata);
+}
+
+
+
 PerThreadInfo *
 ShadingSystem::create_thread_info ()
 {
@@ -230,9 +302,9 @@ ShadingSystem::release_context (ShadingContext *ctx)
 
 bool
 ShadingSystem::execute (ShadingContext *ctx, ShaderGroup &group,
-                        ShaderGlobals &globals, bool run)
+                        ShaderGlobals &globals, bool run, bool *not_ready)
 {
-    return m_impl->execute (ctx, group, globals, run);
+    return m_impl->execute (ctx, group, globals, run, not_ready);
 }
 
 
@@ -248,9 +320,10 @@ ShadingSystem::execute (ShadingContext &ctx, ShaderGroup &group,
 
 bool
 ShadingSystem::execute_init (ShadingContext &ctx, ShaderGroup &group,
-                             ShaderGlobals &globals, bool run)
+                             ShaderGlobals &globals, bool run,
+                             bool *not_ready)
 {
-    return ctx.execute_init (group, globals, run);
+    return ctx.execute_init (group, globals, run, not_ready);
 }
 
 
@@ -384,6 +457,30 @@ ShadingSystem::getstats (int level) const
 
 
 
+std::string
+ShadingSystem::opt_profile_json () const
+{
+    return m_impl->opt_profile_json ();
+}
+
+
+
+std::string
+ShadingSystem::exec_profile_json () const
+{
+    return m_impl->exec_profile_json ();
+}
+
+
+
+void
+ShadingSystem::flush_errors ()
+{
+    m_impl->flush_errors ();
+}
+
+
+
 void
 ShadingSystem::register_closure (string_view name, int id,
                                  const ClosureParam *params,
@@ -420,6 +517,57 @@ ShadingSystem::optimize_all_groups (int nthreads)
 
 
 
+void
+ShadingSystem::set_parallel_for (ParallelForFunc func)
+{
+    m_impl->set_parallel_for (func);
+}
+
+
+
+bool
+ShadingSystem::compile_group_object (ShaderGroup *group, string_view filename)
+{
+    return m_impl->compile_group_object (group, filename);
+}
+
+
+
+bool
+ShadingSystem::load_group_object (ShaderGroup *group, string_view filename)
+{
+    return m_impl->load_group_object (group, filename);
+}
+
+
+
+bool
+ShadingSystem::group_ready (const ShaderGroup *group) const
+{
+    DASSERT (group);
+    return m_impl->group_ready (*group);
+}
+
+
+
+bool
+ShadingSystem::wait_for_group (ShaderGroup *group)
+{
+    DASSERT (group);
+    return m_impl->wait_for_group (*group);
+}
+
+
+
+bool
+ShadingSystem::wait_for_promotion (ShaderGroup *group)
+{
+    DASSERT (group);
+    return m_impl->wait_for_promotion (*group);
+}
+
+
+
 TextureSystem *
 ShadingSystem::texturesys () const
 {
@@ -627,7 +775,7 @@ ustring missingcolor("missingcolor"), missingalpha("missingalpha");
 ustring end("end"), useparam("useparam");
 ustring uninitialized_string("!!!uninitialized!!!");
 ustring unull("unull");
-ustring raytype("raytype");
+ustring raytype("raytype"), getattribute("getattribute");
 ustring color("color"), point("point"), vector("vector"), normal("normal");
 ustring matrix("matrix");
 ustring unknown ("unknown");
@@ -639,6 +787,79 @@ ustring _emptystring_ ("");
 namespace pvt {   // OSL::pvt
 
 
+/// CompilePool - Persistent set of threads for parallel_for, so that we
+/// don't spawn and join a new batch of threads for every call.
+/// run(n,f) calls f(0) on the calling thread and f(1..n-1) on pool
+/// threads, and returns when all of them are done.  The pool runs one
+/// job at a time; a call made while it's busy (from another thread, or
+/// from within a job) just calls f(0).
+class ShadingSystemImpl::CompilePool {
+public:
+    CompilePool () : m_job(NULL), m_participants(0), m_pending(0),
+                     m_generation(0), m_stop(false) { }
+    ~CompilePool () {
+        {
+            std::lock_guard<std::mutex> lock (m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all ();
+        for (auto&& t : m_threads)
+            t.join ();
+    }
+
+    void run (int nthreads, const std::function<void(int)> &job) {
+        std::unique_lock<std::mutex> lock (m_mutex);
+        if (m_job) {
+            lock.unlock ();
+            job (0);
+            return;
+        }
+        while ((int)m_threads.size() < nthreads-1) {
+            int id = (int)m_threads.size() + 1;
+            m_threads.push_back (std::thread ([this,id](){ worker (id); }));
+        }
+        m_job = &job;
+        m_participants = nthreads;
+        m_pending = nthreads - 1;
+        ++m_generation;
+        m_cv.notify_all ();
+        lock.unlock ();
+        job (0);
+        lock.lock ();
+        m_done_cv.wait (lock, [this](){ return m_pending == 0; });
+        m_job = NULL;
+    }
+
+private:
+    void worker (int id) {
+        int seen = 0;
+        std::unique_lock<std::mutex> lock (m_mutex);
+        while (1) {
+            m_cv.wait (lock, [&](){ return m_stop || m_generation != seen; });
+            if (m_stop)
+                return;
+            seen = m_generation;
+            if (id >= m_participants)
+                continue;   // not needed for this job
+            const std::function<void(int)> *job = m_job;
+            lock.unlock ();
+            (*job) (id);
+            lock.lock ();
+            if (--m_pending == 0)
+                m_done_cv.notify_all ();
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cv, m_done_cv;
+    const std::function<void(int)> *m_job;
+    int m_participants, m_pending, m_generation;
+    bool m_stop;
+};
+
+
+
 ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
                                       TextureSystem *texturesystem,
                                       ErrorHandler *err)
@@ -650,7 +871,7 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_lockgeom_default (true), m_strict_messages(true),
       m_range_checking(true),
       m_unknown_coordsys_error(true), m_connection_error(true),
-      m_greedyjit(false), m_countlayerexecs(false),
+      m_greedyjit(false), m_countlayerexecs(false), m_async_jit(0),
       m_max_warnings_per_thread(100),
       m_profile(0),
       m_optimize(2),
@@ -664,15 +885,21 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_opt_middleman(true), m_opt_texture_handle(true),
       m_opt_seed_bblock_aliases(true),
       m_optimize_nondebug(false),
-      m_opt_passes(10),
+      m_opt_passes(10), m_opt_specialization_cache(4096),
+      m_opt_adaptive_passes(false), m_opt_profile(false),
       m_llvm_optimize(0),
       m_debug(0), m_llvm_debug(0),
       m_llvm_debug_layers(0), m_llvm_debug_ops(0),
+      m_llvm_target_isa("baseline"),
+      m_llvm_tier_executions(0), m_llvm_tier_time(0.0f),
+      m_llvm_split_layers(0), m_llvm_lazy_entry_layers(0),
+      m_allow_respecialize(false), m_evict_master_code(false),
       m_commonspace_synonym("world"),
       m_colorspace("Rec709"),
       m_max_local_mem_KB(2048),
       m_compile_report(false),
-      m_buffer_printf(true),
+      m_buffer_printf(true), m_suppress_repeat_errors(0),
+      m_error_thread_on(false),
       m_no_noise(false),
       m_no_pointcloud(false),
       m_force_derivs(false),
@@ -682,11 +909,18 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_stat_total_llvm_time(0),
       m_stat_llvm_setup_time(0), m_stat_llvm_irgen_time(0),
       m_stat_llvm_opt_time(0), m_stat_llvm_jit_time(0),
-      m_stat_inst_merge_time(0),
-      m_stat_max_llvm_local_mem(0)
+      m_stat_llvm_setup_saved(0), m_stat_llvm_promote_time(0),
+      m_stat_llvm_split_saved(0), m_stat_llvm_lazy_time(0),
+      m_stat_respecialize_time(0),
+      m_stat_inst_merge_time(0), m_stat_inst_merge_opt_time(0),
+      m_stat_max_llvm_local_mem(0),
+      m_interned_params_sweep(1024)
 {
     m_stat_shaders_loaded = 0;
     m_stat_shaders_requested = 0;
+    m_stat_master_code_evictions = 0;
+    m_stat_master_code_reloads = 0;
+    m_stat_master_code_evicted_bytes = 0;
     m_stat_groups = 0;
     m_stat_groupinstances = 0;
     m_stat_instances_compiled = 0;
@@ -694,6 +928,7 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
     m_stat_empty_instances = 0;
     m_stat_merged_inst = 0;
     m_stat_merged_inst_opt = 0;
+    m_stat_inst_merge_compares = 0;
     m_stat_empty_groups = 0;
     m_stat_regexes = 0;
     m_stat_preopt_syms = 0;
@@ -706,12 +941,30 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
     m_stat_global_connections = 0;
     m_stat_tex_calls_codegened = 0;
     m_stat_tex_calls_as_handles = 0;
+    m_stat_llvm_cache_hits = 0;
+    m_stat_llvm_cache_misses = 0;
+    m_stat_groups_precompiled = 0;
+    m_stat_llvm_cache_bytes_read = 0;
+    m_stat_llvm_cache_bytes_written = 0;
+    m_stat_specialization_lookups = 0;
+    m_stat_specialization_hits = 0;
+    m_stat_groups_promoted = 0;
+    m_stat_llvm_split_groups = 0;
+    m_stat_llvm_lazy_layers = 0;
+    m_stat_llvm_lazy_layers_compiled = 0;
+    m_stat_groups_respecialized = 0;
+    m_stat_respecialize_layers_kept = 0;
+    m_stat_object_variants = 0;
+    m_stat_object_variants_reused = 0;
     m_stat_master_load_time = 0;
+    m_stat_master_load_wait_time = 0;
     m_stat_optimization_time = 0;
     m_stat_getattribute_time = 0;
     m_stat_getattribute_fail_time = 0;
     m_stat_getattribute_calls = 0;
     m_stat_get_userdata_calls = 0;
+    m_stat_errors_suppressed = 0;
+    m_stat_errors_dropped = 0;
     m_stat_noise_calls = 0;
     m_stat_pointcloud_searches = 0;
     m_stat_pointcloud_searches_total_results = 0;
@@ -721,9 +974,18 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
     m_stat_pointcloud_writes = 0;
     m_stat_layers_executed = 0;
     m_stat_total_shading_time_ticks = 0;
+    m_stat_groupdata_init_ticks = 0;
+
+    m_errors_delivered = 0;
+    m_error_thread_stop = false;
 
     m_groups_to_compile_count = 0;
     m_threads_currently_compiling = 0;
+    m_async_jit_stop = false;
+    m_stat_async_jit_queued = 0;
+    m_stat_async_jit_not_ready = 0;
+    m_stat_async_jit_queue_peak = 0;
+    m_stat_async_jit_wait_time = 0;
 
     // If client didn't supply an error handler, just use the default
     // one that echoes to the terminal.
@@ -1019,6 +1281,8 @@ ShadingSystemImpl::query_closure(const char **name, int *id,
 
 ShadingSystemImpl::~ShadingSystemImpl ()
 {
+    stop_async_jit ();
+    stop_error_thread ();
     printstats ();
     // N.B. just let m_texsys go -- if we asked for one to be created,
     // we asked for a shared one.
@@ -1048,6 +1312,23 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
         _dst = ustring (*(const char **)val);                           \
         return true;                                                    \
     }
+    // Options the runtime optimizer depends on, which the keys of the
+    // specialization cache don't include: changing one clears the cache.
+#define ATTR_SET_OPT(_name,_ctype,_dst)                                 \
+    if (name == _name && type == OIIO::BaseTypeFromC<_ctype>::value) {  \
+        if (_dst != *(_ctype *)(val))                                   \
+            clear_specializations ();                                   \
+        _dst = *(_ctype *)(val);                                        \
+        return true;                                                    \
+    }
+#define ATTR_SET_STRING_OPT(_name,_dst)                                 \
+    if (name == _name && type == TypeDesc::STRING) {                    \
+        ustring v (*(const char **)val);                                \
+        if (_dst != v)                                                  \
+            clear_specializations ();                                   \
+        _dst = v;                                                       \
+        return true;                                                    \
+    }
 
     if (name == "options" && type == TypeDesc::STRING) {
         return OIIO::optparser (*this, *(const char **)val);
@@ -1055,36 +1336,39 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
 
     lock_guard guard (m_mutex);  // Thread safety
     ATTR_SET ("statistics:level", int, m_statslevel);
-    ATTR_SET ("debug", int, m_debug);
+    ATTR_SET_OPT ("debug", int, m_debug);
     ATTR_SET ("lazylayers", int, m_lazylayers);
     ATTR_SET ("lazyglobals", int, m_lazyglobals);
     ATTR_SET ("lazyunconnected", int, m_lazyunconnected);
     ATTR_SET ("lazy_userdata", int, m_lazy_userdata);
-    ATTR_SET ("userdata_isconnected", int, m_userdata_isconnected);
+    ATTR_SET_OPT ("userdata_isconnected", int, m_userdata_isconnected);
     ATTR_SET ("clearmemory", int, m_clearmemory);
     ATTR_SET ("debug_nan", int, m_debugnan);
     ATTR_SET ("debugnan", int, m_debugnan);  // back-compatible alias
     ATTR_SET ("debug_uninit", int, m_debug_uninit);
     ATTR_SET ("lockgeom", int, m_lockgeom_default);
     ATTR_SET ("profile", int, m_profile);
-    ATTR_SET ("optimize", int, m_optimize);
-    ATTR_SET ("opt_simplify_param", int, m_opt_simplify_param);
-    ATTR_SET ("opt_constant_fold", int, m_opt_constant_fold);
-    ATTR_SET ("opt_stale_assign", int, m_opt_stale_assign);
-    ATTR_SET ("opt_elide_useless_ops", int, m_opt_elide_useless_ops);
-    ATTR_SET ("opt_elide_unconnected_outputs", int, m_opt_elide_unconnected_outputs);
-    ATTR_SET ("opt_peephole", int, m_opt_peephole);
-    ATTR_SET ("opt_coalesce_temps", int, m_opt_coalesce_temps);
-    ATTR_SET ("opt_assign", int, m_opt_assign);
-    ATTR_SET ("opt_mix", int, m_opt_mix);
-    ATTR_SET ("opt_merge_instances", int, m_opt_merge_instances);
-    ATTR_SET ("opt_merge_instances_with_userdata", int, m_opt_merge_instances_with_userdata);
-    ATTR_SET ("opt_fold_getattribute", int, m_opt_fold_getattribute);
-    ATTR_SET ("opt_middleman", int, m_opt_middleman);
-    ATTR_SET ("opt_texture_handle", int, m_opt_texture_handle);
-    ATTR_SET ("opt_seed_bblock_aliases", int, m_opt_seed_bblock_aliases);
-    ATTR_SET ("opt_passes", int, m_opt_passes);
-    ATTR_SET ("optimize_nondebug", int, m_optimize_nondebug);
+    ATTR_SET_OPT ("optimize", int, m_optimize);
+    ATTR_SET_OPT ("opt_simplify_param", int, m_opt_simplify_param);
+    ATTR_SET_OPT ("opt_constant_fold", int, m_opt_constant_fold);
+    ATTR_SET_OPT ("opt_stale_assign", int, m_opt_stale_assign);
+    ATTR_SET_OPT ("opt_elide_useless_ops", int, m_opt_elide_useless_ops);
+    ATTR_SET_OPT ("opt_elide_unconnected_outputs", int, m_opt_elide_unconnected_outputs);
+    ATTR_SET_OPT ("opt_peephole", int, m_opt_peephole);
+    ATTR_SET_OPT ("opt_coalesce_temps", int, m_opt_coalesce_temps);
+    ATTR_SET_OPT ("opt_assign", int, m_opt_assign);
+    ATTR_SET_OPT ("opt_mix", int, m_opt_mix);
+    ATTR_SET_OPT ("opt_merge_instances", int, m_opt_merge_instances);
+    ATTR_SET_OPT ("opt_merge_instances_with_userdata", int, m_opt_merge_instances_with_userdata);
+    ATTR_SET_OPT ("opt_fold_getattribute", int, m_opt_fold_getattribute);
+    ATTR_SET_OPT ("opt_middleman", int, m_opt_middleman);
+    ATTR_SET_OPT ("opt_texture_handle", int, m_opt_texture_handle);
+    ATTR_SET_OPT ("opt_seed_bblock_aliases", int, m_opt_seed_bblock_aliases);
+    ATTR_SET_OPT ("opt_passes", int, m_opt_passes);
+    ATTR_SET ("opt_specialization_cache", int, m_opt_specialization_cache);
+    ATTR_SET_OPT ("opt_adaptive_passes", int, m_opt_adaptive_passes);
+    ATTR_SET ("opt_profile", int, m_opt_profile);
+    ATTR_SET_OPT ("optimize_nondebug", int, m_optimize_nondebug);
     ATTR_SET ("llvm_optimize", int, m_llvm_optimize);
     ATTR_SET ("llvm_debug", int, m_llvm_debug);
     ATTR_SET ("llvm_debug_layers", int, m_llvm_debug_layers);
@@ -1093,25 +1377,46 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("range_checking", int, m_range_checking);
     ATTR_SET ("unknown_coordsys_error", int, m_unknown_coordsys_error);
     ATTR_SET ("connection_error", int, m_connection_error);
-    ATTR_SET ("greedyjit", int, m_greedyjit);
     ATTR_SET ("countlayerexecs", int, m_countlayerexecs);
     ATTR_SET ("max_warnings_per_thread", int, m_max_warnings_per_thread);
     ATTR_SET ("max_local_mem_KB", int, m_max_local_mem_KB);
     ATTR_SET ("compile_report", int, m_compile_report);
     ATTR_SET ("buffer_printf", int, m_buffer_printf);
+    ATTR_SET ("suppress_repeat_errors", int, m_suppress_repeat_errors);
+    ATTR_SET ("error_thread", int, m_error_thread_on);
     ATTR_SET ("no_noise", int, m_no_noise);
     ATTR_SET ("no_pointcloud", int, m_no_pointcloud);
-    ATTR_SET ("force_derivs", int, m_force_derivs);
+    ATTR_SET_OPT ("force_derivs", int, m_force_derivs);
     ATTR_SET ("exec_repeat", int, m_exec_repeat);
-    ATTR_SET_STRING ("commonspace", m_commonspace_synonym);
-    ATTR_SET_STRING ("debug_groupname", m_debug_groupname);
-    ATTR_SET_STRING ("debug_layername", m_debug_layername);
-    ATTR_SET_STRING ("opt_layername", m_opt_layername);
+    ATTR_SET ("llvm_tier_executions", int, m_llvm_tier_executions);
+    ATTR_SET ("llvm_tier_time", float, m_llvm_tier_time);
+    ATTR_SET ("llvm_split_layers", int, m_llvm_split_layers);
+    ATTR_SET ("llvm_lazy_entry_layers", int, m_llvm_lazy_entry_layers);
+    ATTR_SET ("allow_respecialize", int, m_allow_respecialize);
+    ATTR_SET ("evict_master_code", int, m_evict_master_code);
+    ATTR_SET_STRING_OPT ("commonspace", m_commonspace_synonym);
+    ATTR_SET_STRING_OPT ("debug_groupname", m_debug_groupname);
+    ATTR_SET_STRING_OPT ("debug_layername", m_debug_layername);
+    ATTR_SET_STRING_OPT ("opt_layername", m_opt_layername);
     ATTR_SET_STRING ("only_groupname", m_only_groupname);
     ATTR_SET_STRING ("archive_groupname", m_archive_groupname);
     ATTR_SET_STRING ("archive_filename", m_archive_filename);
+    ATTR_SET_STRING ("llvm_cache_dir", m_llvm_cache_dir);
+    ATTR_SET_STRING ("llvm_target_isa", m_llvm_target_isa);
 
     // cases for special handling
+    if ((name == "greedyjit" || name == "async_jit") && type == TypeDesc::INT) {
+        if (name == "greedyjit")
+            m_greedyjit = *(const int *)val;
+        else
+            m_async_jit = *(const int *)val;
+        // With both set, ShaderGroupEnd queues each group for the
+        // background JIT threads; queue the groups that were ended
+        // before, so that execute() never has to look for them.
+        if (m_greedyjit && m_async_jit && m_groups_to_compile_count)
+            async_optimize_all_groups ();
+        return true;
+    }
     if (name == "searchpath:shader" && type == TypeDesc::STRING) {
         m_searchpath = std::string (*(const char **)val);
         OIIO::Filesystem::searchpath_split (m_searchpath, m_searchpath_dirs);
@@ -1119,6 +1424,8 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     }
     if (name == "colorspace" && type == TypeDesc::STRING) {
         ustring c = ustring (*(const char **)val);
+        if (c != m_colorspace)
+            clear_specializations ();
         if (set_colorspace (m_colorspace))
             m_colorspace = c;
         else
@@ -1128,20 +1435,28 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     if (name == "raytypes" && type.basetype == TypeDesc::STRING) {
         ASSERT (type.numelements() <= 32 &&
                 "ShaderGlobals.raytype is an int, max of 32 raytypes");
-        m_raytypes.clear ();
+        std::vector<ustring> raytypes;
         for (size_t i = 0;  i < type.numelements();  ++i)
-            m_raytypes.emplace_back(((const char **)val)[i]);
+            raytypes.emplace_back(((const char **)val)[i]);
+        if (raytypes != m_raytypes)
+            clear_specializations ();
+        m_raytypes.swap (raytypes);
         return true;
     }
     if (name == "renderer_outputs" && type.basetype == TypeDesc::STRING) {
-        m_renderer_outputs.clear ();
+        std::vector<ustring> outputs;
         for (size_t i = 0;  i < type.numelements();  ++i)
-            m_renderer_outputs.emplace_back(((const char **)val)[i]);
+            outputs.emplace_back(((const char **)val)[i]);
+        if (outputs != m_renderer_outputs)
+            clear_specializations ();
+        m_renderer_outputs.swap (outputs);
         return true;
     }
     return false;
 #undef ATTR_SET
 #undef ATTR_SET_STRING
+#undef ATTR_SET_OPT
+#undef ATTR_SET_STRING_OPT
 }
 
 
@@ -1192,6 +1507,9 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("opt_texture_handle", int, m_opt_texture_handle);
     ATTR_DECODE ("opt_seed_bblock_aliases", int, m_opt_seed_bblock_aliases);
     ATTR_DECODE ("opt_passes", int, m_opt_passes);
+    ATTR_DECODE ("opt_specialization_cache", int, m_opt_specialization_cache);
+    ATTR_DECODE ("opt_adaptive_passes", int, m_opt_adaptive_passes);
+    ATTR_DECODE ("opt_profile", int, m_opt_profile);
     ATTR_DECODE ("optimize_nondebug", int, m_optimize_nondebug);
     ATTR_DECODE ("llvm_optimize", int, m_llvm_optimize);
     ATTR_DECODE ("debug", int, m_debug);
@@ -1203,6 +1521,7 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("unknown_coordsys_error", int, m_unknown_coordsys_error);
     ATTR_DECODE ("connection_error", int, m_connection_error);
     ATTR_DECODE ("greedyjit", int, m_greedyjit);
+    ATTR_DECODE ("async_jit", int, m_async_jit);
     ATTR_DECODE ("countlayerexecs", int, m_countlayerexecs);
     ATTR_DECODE ("max_warnings_per_thread", int, m_max_warnings_per_thread);
     ATTR_DECODE_STRING ("commonspace", m_commonspace_synonym);
@@ -1213,21 +1532,47 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE_STRING ("only_groupname", m_only_groupname);
     ATTR_DECODE_STRING ("archive_groupname", m_archive_groupname);
     ATTR_DECODE_STRING ("archive_filename", m_archive_filename);
+    ATTR_DECODE_STRING ("llvm_cache_dir", m_llvm_cache_dir);
+    ATTR_DECODE_STRING ("llvm_target_isa", m_llvm_target_isa);
     ATTR_DECODE ("max_local_mem_KB", int, m_max_local_mem_KB);
     ATTR_DECODE ("compile_report", int, m_compile_report);
     ATTR_DECODE ("buffer_printf", int, m_buffer_printf);
+    ATTR_DECODE ("suppress_repeat_errors", int, m_suppress_repeat_errors);
+    ATTR_DECODE ("error_thread", int, m_error_thread_on);
     ATTR_DECODE ("no_noise", int, m_no_noise);
     ATTR_DECODE ("no_pointcloud", int, m_no_pointcloud);
     ATTR_DECODE ("force_derivs", int, m_force_derivs);
     ATTR_DECODE ("exec_repeat", int, m_exec_repeat);
+    ATTR_DECODE ("llvm_tier_executions", int, m_llvm_tier_executions);
+    ATTR_DECODE ("llvm_tier_time", float, m_llvm_tier_time);
+    ATTR_DECODE ("llvm_split_layers", int, m_llvm_split_layers);
+    ATTR_DECODE ("llvm_lazy_entry_layers", int, m_llvm_lazy_entry_layers);
+    ATTR_DECODE ("allow_respecialize", int, m_allow_respecialize);
+    ATTR_DECODE ("evict_master_code", int, m_evict_master_code);
 
     ATTR_DECODE ("stat:masters", int, m_stat_shaders_loaded);
+    ATTR_DECODE ("stat:master_code_evictions", int, m_stat_master_code_evictions);
+    ATTR_DECODE ("stat:master_code_reloads", int, m_stat_master_code_reloads);
+    ATTR_DECODE ("stat:master_code_evicted_bytes", long long, m_stat_master_code_evicted_bytes);
     ATTR_DECODE ("stat:groups", int, m_stat_groups);
     ATTR_DECODE ("stat:instances_compiled", int, m_stat_instances_compiled);
     ATTR_DECODE ("stat:groups_compiled", int, m_stat_groups_compiled);
+    ATTR_DECODE ("stat:groups_promoted", int, m_stat_groups_promoted);
+    ATTR_DECODE ("stat:llvm_split_groups", int, m_stat_llvm_split_groups);
+    ATTR_DECODE ("stat:llvm_lazy_layers", int, m_stat_llvm_lazy_layers);
+    ATTR_DECODE ("stat:llvm_lazy_layers_compiled", int, m_stat_llvm_lazy_layers_compiled);
+    ATTR_DECODE ("stat:groups_respecialized", int, m_stat_groups_respecialized);
+    ATTR_DECODE ("stat:respecialize_layers_kept", int, m_stat_respecialize_layers_kept);
+    ATTR_DECODE ("stat:object_variants", int, m_stat_object_variants);
+    ATTR_DECODE ("stat:object_variants_reused", int, m_stat_object_variants_reused);
+    ATTR_DECODE ("stat:async_jit_queued", int, m_stat_async_jit_queued);
+    ATTR_DECODE ("stat:async_jit_not_ready", long long, m_stat_async_jit_not_ready);
+    ATTR_DECODE ("stat:async_jit_queue_peak", int, m_stat_async_jit_queue_peak);
+    ATTR_DECODE ("stat:async_jit_wait_time", float, m_stat_async_jit_wait_time);
     ATTR_DECODE ("stat:empty_instances", int, m_stat_empty_instances);
     ATTR_DECODE ("stat:merged_inst", int, m_stat_merged_inst);
     ATTR_DECODE ("stat:merged_inst_opt", int, m_stat_merged_inst_opt);
+    ATTR_DECODE ("stat:inst_merge_compares", long long, m_stat_inst_merge_compares);
     ATTR_DECODE ("stat:empty_groups", int, m_stat_empty_groups);
     ATTR_DECODE ("stat:instances", int, m_stat_groupinstances);
     ATTR_DECODE ("stat:regexes", int, m_stat_regexes);
@@ -1241,18 +1586,34 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("stat:global_connections", int, m_stat_global_connections);
     ATTR_DECODE ("stat:tex_calls_codegened", int, m_stat_tex_calls_codegened);
     ATTR_DECODE ("stat:tex_calls_as_handles", int, m_stat_tex_calls_as_handles);
+    ATTR_DECODE ("stat:llvm_cache_hits", int, m_stat_llvm_cache_hits);
+    ATTR_DECODE ("stat:llvm_cache_misses", int, m_stat_llvm_cache_misses);
+    ATTR_DECODE ("stat:groups_precompiled", int, m_stat_groups_precompiled);
+    ATTR_DECODE ("stat:llvm_cache_bytes_read", long long, m_stat_llvm_cache_bytes_read);
+    ATTR_DECODE ("stat:llvm_cache_bytes_written", long long, m_stat_llvm_cache_bytes_written);
     ATTR_DECODE ("stat:master_load_time", float, m_stat_master_load_time);
+    ATTR_DECODE ("stat:master_load_wait_time", float, m_stat_master_load_wait_time);
     ATTR_DECODE ("stat:optimization_time", float, m_stat_optimization_time);
     ATTR_DECODE ("stat:opt_locking_time", float, m_stat_opt_locking_time);
     ATTR_DECODE ("stat:specialization_time", float, m_stat_specialization_time);
+    ATTR_DECODE ("stat:specialization_lookups", long long, m_stat_specialization_lookups);
+    ATTR_DECODE ("stat:specialization_hits", long long, m_stat_specialization_hits);
     ATTR_DECODE ("stat:total_llvm_time", float, m_stat_total_llvm_time);
     ATTR_DECODE ("stat:llvm_setup_time", float, m_stat_llvm_setup_time);
     ATTR_DECODE ("stat:llvm_irgen_time", float, m_stat_llvm_irgen_time);
     ATTR_DECODE ("stat:llvm_opt_time", float, m_stat_llvm_opt_time);
     ATTR_DECODE ("stat:llvm_jit_time", float, m_stat_llvm_jit_time);
+    ATTR_DECODE ("stat:llvm_setup_saved", float, m_stat_llvm_setup_saved);
+    ATTR_DECODE ("stat:llvm_promote_time", float, m_stat_llvm_promote_time);
+    ATTR_DECODE ("stat:llvm_split_saved", float, m_stat_llvm_split_saved);
+    ATTR_DECODE ("stat:llvm_lazy_time", float, m_stat_llvm_lazy_time);
+    ATTR_DECODE ("stat:respecialize_time", float, m_stat_respecialize_time);
     ATTR_DECODE ("stat:inst_merge_time", float, m_stat_inst_merge_time);
+    ATTR_DECODE ("stat:inst_merge_opt_time", float, m_stat_inst_merge_opt_time);
     ATTR_DECODE ("stat:getattribute_calls", long long, m_stat_getattribute_calls);
     ATTR_DECODE ("stat:get_userdata_calls", long long, m_stat_get_userdata_calls);
+    ATTR_DECODE ("stat:errors_suppressed", long long, m_stat_errors_suppressed);
+    ATTR_DECODE ("stat:errors_dropped", long long, m_stat_errors_dropped);
     ATTR_DECODE ("stat:noise_calls", long long, m_stat_noise_calls);
     ATTR_DECODE ("stat:pointcloud_searches", long long, m_stat_pointcloud_searches);
     ATTR_DECODE ("stat:pointcloud_gets", long long, m_stat_pointcloud_gets);
@@ -1280,8 +1641,12 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("stat:mem_inst_syms_peak", long long, m_stat_mem_inst_syms.peak());
     ATTR_DECODE ("stat:mem_inst_paramvals_current", long long, m_stat_mem_inst_paramvals.current());
     ATTR_DECODE ("stat:mem_inst_paramvals_peak", long long, m_stat_mem_inst_paramvals.peak());
+    ATTR_DECODE ("stat:mem_inst_paramvals_saved_current", long long, m_stat_mem_inst_paramvals_saved.current());
+    ATTR_DECODE ("stat:mem_inst_paramvals_saved_peak", long long, m_stat_mem_inst_paramvals_saved.peak());
     ATTR_DECODE ("stat:mem_inst_connections_current", long long, m_stat_mem_inst_connections.current());
     ATTR_DECODE ("stat:mem_inst_connections_peak", long long, m_stat_mem_inst_connections.peak());
+    ATTR_DECODE ("stat:jit_memory_current", long long, LLVM_Util::total_jit_memory_held());
+    ATTR_DECODE ("stat:jit_memory_freed", long long, LLVM_Util::total_jit_memory_freed());
 
     return false;
 #undef ATTR_DECODE
@@ -1558,6 +1923,163 @@ ShadingSystemImpl::message (const std::string &msg) const
 
 
 
+ErrorQueue::ErrorQueue ()
+    : m_slots(new Slot[capacity]), m_push_pos(0), m_pop_pos(0)
+{
+    for (size_t i = 0;  i < capacity;  ++i)
+        m_slots[i].seq = i;
+}
+
+
+
+bool
+ErrorQueue::push (ErrorBatch &batch)
+{
+    size_t pos = m_push_pos.load (std::memory_order_relaxed);
+    Slot *slot;
+    while (1) {
+        slot = &m_slots[pos & (capacity-1)];
+        size_t seq = slot->seq.load (std::memory_order_acquire);
+        if (seq == pos) {
+            // The slot is free for this position; claim it.
+            if (m_push_pos.compare_exchange_weak (pos, pos+1,
+                                                  std::memory_order_relaxed))
+                break;
+            // else pos now holds the latest position; try again
+        } else if (seq < pos) {
+            return false;   // still holds the batch from a lap ago: full
+        } else {
+            pos = m_push_pos.load (std::memory_order_relaxed);
+        }
+    }
+    slot->batch.items.swap (batch.items);
+    slot->seq.store (pos+1, std::memory_order_release);
+    return true;
+}
+
+
+
+bool
+ErrorQueue::pop (ErrorBatch &batch)
+{
+    size_t pos = m_pop_pos.load (std::memory_order_relaxed);
+    Slot *slot = &m_slots[pos & (capacity-1)];
+    if (slot->seq.load (std::memory_order_acquire) != pos+1)
+        return false;   // empty, or the next batch isn't written yet
+    batch.items.clear ();
+    batch.items.swap (slot->batch.items);
+    m_pop_pos.store (pos+1, std::memory_order_relaxed);
+    // Free the slot for the push one lap from now.
+    slot->seq.store (pos+capacity, std::memory_order_release);
+    return true;
+}
+
+
+
+void
+ShadingSystemImpl::queue_errors (std::vector<ErrorBatch::Item> &items)
+{
+    if (! m_error_thread_on) {
+        lock_guard lock (m_error_batch_mutex);
+        deliver_errors (items);
+        items.clear ();
+        return;
+    }
+    std::call_once (m_error_thread_started, [this](){
+        m_error_thread = std::thread ([this](){ error_thread_worker(); });
+    });
+    size_t n = items.size();
+    ErrorBatch batch;
+    batch.items.swap (items);
+    if (! m_error_queue.push (batch)) {
+        // Rather than hold up shading until the error thread catches
+        // up, lose these messages (and say how many, in the stats).
+        m_stat_errors_dropped += (long long) n;
+        return;
+    }
+    // No lock here: if the thread misses this, it looks again shortly.
+    m_error_cv.notify_one ();
+}
+
+
+
+void
+ShadingSystemImpl::flush_errors ()
+{
+    if (! m_error_thread.joinable())
+        return;
+    size_t target = m_error_queue.pushed ();
+    std::unique_lock<std::mutex> lock (m_error_mutex);
+    m_error_cv.notify_one ();
+    m_error_done_cv.wait (lock, [&](){ return m_errors_delivered >= target; });
+}
+
+
+
+void
+ShadingSystemImpl::error_thread_worker ()
+{
+    ErrorBatch batch;
+    while (1) {
+        while (m_error_queue.pop (batch)) {
+            deliver_errors (batch.items);
+            ++m_errors_delivered;
+        }
+        std::unique_lock<std::mutex> lock (m_error_mutex);
+        m_error_done_cv.notify_all ();
+        if (m_error_thread_stop && m_errors_delivered >= m_error_queue.pushed())
+            return;   // stopping, and nothing left to deliver
+        // Producers notify without the lock, so a wakeup can slip by
+        // between the pop and the wait; don't sleep long on one.
+        m_error_cv.wait_for (lock, std::chrono::milliseconds(10));
+    }
+}
+
+
+
+void
+ShadingSystemImpl::stop_error_thread ()
+{
+    if (! m_error_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock (m_error_mutex);
+        m_error_thread_stop = true;
+    }
+    // It delivers whatever is left before it stops.
+    m_error_cv.notify_one ();
+    m_error_thread.join ();
+}
+
+
+
+void
+ShadingSystemImpl::deliver_errors (const std::vector<ErrorBatch::Item> &items)
+{
+    for (auto&& e : items) {
+        switch (e.first) {
+        case ErrorHandler::EH_MESSAGE :
+        case ErrorHandler::EH_DEBUG :
+            message (e.second);
+            break;
+        case ErrorHandler::EH_INFO :
+            info (e.second);
+            break;
+        case ErrorHandler::EH_WARNING :
+            warning (e.second);
+            break;
+        case ErrorHandler::EH_ERROR :
+        case ErrorHandler::EH_SEVERE :
+            error (e.second);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+
+
 void
 ShadingSystemImpl::pointcloud_stats (int search, int get, int results,
                                      int writes)
@@ -1623,6 +2145,7 @@ ShadingSystemImpl::getstats (int level) const
     BOOLOPT (strict_messages);
     BOOLOPT (range_checking);
     BOOLOPT (greedyjit);
+    INTOPT (async_jit);
     BOOLOPT (countlayerexecs);
     BOOLOPT (opt_simplify_param);
     BOOLOPT (opt_constant_fold);
@@ -1640,14 +2163,29 @@ ShadingSystemImpl::getstats (int level) const
     BOOLOPT (opt_texture_handle);
     BOOLOPT (opt_seed_bblock_aliases);
     INTOPT  (opt_passes);
+    INTOPT  (opt_specialization_cache);
+    BOOLOPT (opt_adaptive_passes);
+    BOOLOPT (opt_profile);
     INTOPT (no_noise);
     INTOPT (no_pointcloud);
     INTOPT (force_derivs);
     INTOPT (exec_repeat);
+    INTOPT (llvm_tier_executions);
+    INTOPT (llvm_split_layers);
+    INTOPT (llvm_lazy_entry_layers);
+    BOOLOPT (allow_respecialize);
+    BOOLOPT (evict_master_code);
+    INTOPT (suppress_repeat_errors);
+    opt += Strutil::format ("error_thread=%d ", m_error_thread_on);
+    if (m_llvm_tier_time > 0.0f)
+        opt += Strutil::format ("llvm_tier_time=%g ", m_llvm_tier_time);
     STROPT (debug_groupname);
     STROPT (debug_layername);
     STROPT (archive_groupname);
     STROPT (archive_filename);
+    STROPT (llvm_cache_dir);
+    if (m_llvm_target_isa != "baseline")
+        STROPT (llvm_target_isa);
 #undef BOOLOPT
 #undef INTOPT
 #undef STROPT
@@ -1658,11 +2196,18 @@ ShadingSystemImpl::getstats (int level) const
     out << "    Loaded:    " << m_stat_shaders_loaded << "\n";
     out << "    Masters:   " << m_stat_shaders_loaded << "\n";
     out << "    Instances: " << m_stat_instances << "\n";
+    if (m_stat_master_code_evictions)
+        out << "    Master code evicted: " << m_stat_master_code_evictions
+            << " (" << Strutil::memformat (m_stat_master_code_evicted_bytes)
+            << "), reloaded: " << m_stat_master_code_reloads << "\n";
     out << "  Time loading masters: "
         << Strutil::timeintervalformat (m_stat_master_load_time, 2) << "\n";
+    if (m_stat_master_load_wait_time > 0.0)
+        out << "    (waiting for other threads' loads: "
+            << Strutil::timeintervalformat (m_stat_master_load_wait_time, 2) << ")\n";
     out << "  Shading groups:   " << m_stat_groups << "\n";
     out << "    Total instances in all groups: " << m_stat_groupinstances << "\n";
-    float iperg = (float)m_stat_groupinstances/std::max(m_stat_groups,1);
+    float iperg = (float)m_stat_groupinstances/std::max(int(m_stat_groups),1);
     out << "    Avg instances per group: "
         << Strutil::format ("%.1f", iperg) << "\n";
     out << "  Shading contexts: " << m_stat_contexts << "\n";
@@ -1688,10 +2233,38 @@ ShadingSystemImpl::getstats (int level) const
 
     out << "  Compiled " << m_stat_groups_compiled << " groups, "
         << m_stat_instances_compiled << " instances\n";
+    if (m_stat_compile_thread_busy_time.size()) {
+        out << "  optimize_all_groups per-thread compile/idle time:\n";
+        for (size_t t = 0; t < m_stat_compile_thread_busy_time.size(); ++t)
+            out << "    thread " << t << ": "
+                << Strutil::timeintervalformat (m_stat_compile_thread_busy_time[t], 2)
+                << " / "
+                << Strutil::timeintervalformat (m_stat_compile_thread_idle_time[t], 2)
+                << "\n";
+    }
+    if (m_stat_async_jit_queued) {
+        size_t depth = 0;
+        {
+            std::lock_guard<std::mutex> lock (m_async_jit_mutex);
+            depth = m_async_jit_queue.size();
+        }
+        out << "  Async JIT: " << m_stat_async_jit_queued << " groups queued ("
+            << depth << " still waiting, peak queue depth "
+            << m_stat_async_jit_queue_peak << ")\n";
+        out << "    Total queue wait: "
+            << Strutil::timeintervalformat (m_stat_async_jit_wait_time, 2)
+            << ", executions deferred: " << m_stat_async_jit_not_ready << "\n";
+    }
     out << "  Merged " << (m_stat_merged_inst+m_stat_merged_inst_opt)
         << " instances (" << m_stat_merged_inst << " initial, "
         << m_stat_merged_inst_opt << " after opt) in "
         << Strutil::timeintervalformat (m_stat_inst_merge_time, 2) << "\n";
+    out << "    initial: "
+        << Strutil::timeintervalformat (m_stat_inst_merge_time - m_stat_inst_merge_opt_time, 2)
+        << ", after opt: "
+        << Strutil::timeintervalformat (m_stat_inst_merge_opt_time, 2)
+        << ", " << m_stat_inst_merge_compares
+        << " full comparisons of instances with matching signatures\n";
     if (m_stat_instances_compiled > 0)
         out << "  After optimization, " << m_stat_empty_instances
             << " empty instances ("
@@ -1724,16 +2297,67 @@ ShadingSystemImpl::getstats (int level) const
         << Strutil::timeintervalformat (m_stat_opt_locking_time, 2) << "\n";
     out << "    runtime specialization:    "
         << Strutil::timeintervalformat (m_stat_specialization_time, 2) << "\n";
+    if (m_stat_specialization_lookups)
+        out << Strutil::format ("      (reused %lld of %lld instance optimizations, %.1f%%)\n",
+                                (long long)m_stat_specialization_hits,
+                                (long long)m_stat_specialization_lookups,
+                                (100.0*m_stat_specialization_hits) / m_stat_specialization_lookups);
+    if (m_opt_profile && level >= 2) {
+        spin_lock lock (m_stat_mutex);
+        m_stat_opt_profile.print (out, level);
+    }
     if (m_stat_total_llvm_time > 0.0) {
         out << "    LLVM setup:                "
-            << Strutil::timeintervalformat (m_stat_llvm_setup_time, 2) << "\n";
+            << Strutil::timeintervalformat (m_stat_llvm_setup_time, 2);
+        if (m_stat_llvm_setup_saved > 0.0)
+            out << "  (saved "
+                << Strutil::timeintervalformat (m_stat_llvm_setup_saved, 2)
+                << " by cloning pre-parsed bitcode)";
+        out << "\n";
         out << "    LLVM IR gen:               "
             << Strutil::timeintervalformat (m_stat_llvm_irgen_time, 2) << "\n";
         out << "    LLVM optimize:             "
             << Strutil::timeintervalformat (m_stat_llvm_opt_time, 2) << "\n";
         out << "    LLVM JIT:                  "
             << Strutil::timeintervalformat (m_stat_llvm_jit_time, 2) << "\n";
+        if (m_stat_llvm_split_groups)
+            out << "    (" << m_stat_llvm_split_groups
+                << " groups JITed in concurrent chunks, saving "
+                << Strutil::timeintervalformat (m_stat_llvm_split_saved, 2)
+                << " of wall time)\n";
+        if (m_stat_llvm_lazy_layers)
+            out << "    (" << m_stat_llvm_lazy_layers
+                << " entry layers deferred until first call, "
+                << m_stat_llvm_lazy_layers_compiled << " of them JITed in "
+                << Strutil::timeintervalformat (m_stat_llvm_lazy_time, 2)
+                << ")\n";
     }
+    if (m_stat_groups_promoted)
+        out << "  Recompiled " << m_stat_groups_promoted
+            << " hot groups with full optimization ("
+            << Strutil::timeintervalformat (m_stat_llvm_promote_time, 2)
+            << ")\n";
+    if (m_stat_object_variants)
+        out << "  Object variants of groups: " << m_stat_object_variants
+            << " made, " << m_stat_object_variants_reused << " reused\n";
+    if (m_stat_groups_respecialized)
+        out << "  Respecialized " << m_stat_groups_respecialized
+            << " groups after ReParameter ("
+            << Strutil::timeintervalformat (m_stat_respecialize_time, 2)
+            << ")\n";
+    if (m_stat_respecialize_layers_kept)
+        out << "    (kept the code of " << m_stat_respecialize_layers_kept
+            << " unaffected layers)\n";
+    if (m_llvm_cache_dir.size()) {
+        out << "  JIT object cache: " << m_stat_llvm_cache_hits << " hits, "
+            << m_stat_llvm_cache_misses << " misses\n";
+        out << "    read " << Strutil::memformat (m_stat_llvm_cache_bytes_read)
+            << ", wrote " << Strutil::memformat (m_stat_llvm_cache_bytes_written)
+            << "\n";
+    }
+    if (m_stat_groups_precompiled)
+        out << "  Precompiled groups loaded: " << m_stat_groups_precompiled
+            << " (not optimized or JITed)\n";
 
     out << "  Texture calls compiled: "
         << (int)m_stat_tex_calls_codegened
@@ -1748,6 +2372,12 @@ ShadingSystemImpl::getstats (int level) const
             << Strutil::timeintervalformat (m_stat_getattribute_fail_time, 2) << ")\n";
     }
     out << "  Number of get_userdata calls: " << m_stat_get_userdata_calls << "\n";
+    if (m_stat_errors_suppressed)
+        out << "  Repeated shader errors/warnings suppressed: "
+            << m_stat_errors_suppressed << "\n";
+    if (m_stat_errors_dropped)
+        out << "  Shader errors/warnings dropped (error queue full): "
+            << m_stat_errors_dropped << "\n";
     if (profile() > 1)
         out << "  Number of noise calls: " << m_stat_noise_calls << "\n";
     if (m_stat_pointcloud_searches || m_stat_pointcloud_writes) {
@@ -1771,16 +2401,25 @@ ShadingSystemImpl::getstats (int level) const
     out << "    Instance memory: " << m_stat_mem_inst.memstat() << '\n';
     out << "        Instance syms:         " << m_stat_mem_inst_syms.memstat() << '\n';
     out << "        Instance param values: " << m_stat_mem_inst_paramvals.memstat() << '\n';
+    if (m_stat_mem_inst_paramvals_saved.peak())
+        out << "          (saved by keeping only shared overrides: " << m_stat_mem_inst_paramvals_saved.memstat() << ")\n";
     out << "        Instance connections:  " << m_stat_mem_inst_connections.memstat() << '\n';
 
     size_t jitmem = LLVM_Util::total_jit_memory_held();
-    out << "    LLVM JIT memory: " << Strutil::memformat(jitmem) << '\n';
+    size_t jitfreed = LLVM_Util::total_jit_memory_freed();
+    out << "    LLVM JIT memory: " << Strutil::memformat(jitmem);
+    if (jitfreed)
+        out << " (" << Strutil::memformat(jitfreed) << " freed)";
+    out << '\n';
 
     if (m_profile) {
         out << "  Execution profile:\n";
         out << "    Total shader execution time: "
             << Strutil::timeintervalformat(OIIO::Timer::seconds(m_stat_total_shading_time_ticks), 2)
             << " (sum of all threads)\n";
+        out << "    Groupdata init time: "
+            << Strutil::timeintervalformat(OIIO::Timer::seconds(m_stat_groupdata_init_ticks), 2)
+            << "\n";
         // Account for times of any groups that haven't yet been destroyed
         {
             spin_lock lock (m_all_shader_groups_mutex);
@@ -1810,6 +2449,13 @@ ShadingSystemImpl::getstats (int level) const
                     << ' ' << (i->first.size() ? i->first.c_str() : "<unnamed group>") << "\n";
             }
         }
+        if (m_profile >= 2 && level >= 2) {
+            auto profiles = exec_profiles ();
+            if (profiles.size())
+                out << "    Layer profile (time in each layer itself):\n";
+            for (auto&& p : profiles)
+                p.second.print (out, level);
+        }
 
     }
 
@@ -1818,6 +2464,64 @@ ShadingSystemImpl::getstats (int level) const
 
 
 
+std::string
+ShadingSystemImpl::opt_profile_json () const
+{
+    spin_lock lock (m_stat_mutex);
+    return m_stat_opt_profile.json();
+}
+
+
+
+std::string
+ShadingSystemImpl::exec_profile_json () const
+{
+    std::ostringstream out;
+    out << "{";
+    bool first = true;
+    for (auto&& p : exec_profiles ()) {
+        out << (first ? "" : ", ") << '"' << p.first << "\": "
+            << p.second.json();
+        first = false;
+    }
+    out << "}";
+    return out.str();
+}
+
+
+
+std::vector<std::pair<int,ExecProfile> >
+ShadingSystemImpl::exec_profiles () const
+{
+    std::vector<std::pair<int,ExecProfile> > profiles;
+    spin_lock lock (m_all_shader_groups_mutex);
+    for (auto&& grp : m_all_shader_groups) {
+        ShaderGroupRef g = grp.lock();
+        if (! g)
+            continue;
+        ExecProfile p;
+        {
+            spin_lock plock (g->m_exec_profile_mutex);
+            if (g->m_exec_profile.layers.empty())
+                continue;
+            p = g->m_exec_profile;
+        }
+        for (int i = 0;  i < g->nlayers();  ++i)
+            p.layernames.push_back (g->layer(i)->layername());
+        p.groupname = g->name();
+        // Groups needn't have unique names, so keep them apart by id.
+        profiles.emplace_back (g->id(), std::move(p));
+    }
+    std::sort (profiles.begin(), profiles.end(),
+               [](const std::pair<int,ExecProfile> &a,
+                  const std::pair<int,ExecProfile> &b) {
+                   return a.first < b.first;
+               });
+    return profiles;
+}
+
+
+
 void
 ShadingSystemImpl::printstats () const
 {
@@ -1854,6 +2558,25 @@ ShadingSystemImpl::Parameter (string_view name, TypeDesc t, const void *val)
 
 
 
+bool
+ShadingSystemImpl::Parameter (ShaderGroup &group, string_view name,
+                              TypeDesc t, const void *val, bool lockgeom)
+{
+    if (group.m_ended) {
+        error ("Parameter() was called for shader group \"%s\" after ShaderGroupEnd()",
+               group.name());
+        return false;
+    }
+    // Same as above, but the pending list belongs to the group.
+    group.m_pending_params.grow();
+    group.m_pending_params.back().init (name, t, 1, val);
+    if (lockgeom == false)
+        group.m_pending_params.back().interp (OIIO::ParamValue::INTERP_VERTEX);
+    return true;
+}
+
+
+
 ShaderGroupRef
 ShadingSystemImpl::ShaderGroupBegin (string_view groupname)
 {
@@ -1862,27 +2585,52 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname)
         return ShaderGroupRef();
     }
     m_in_group = true;
-    m_group_use = ShadUseUnknown;
-    m_curgroup.reset (new ShaderGroup(groupname));
-    m_curgroup->m_exec_repeat = m_exec_repeat;
+    m_curgroup = ShaderGroupCreate (groupname);
     return m_curgroup;
 }
 
 
 
-bool
-ShadingSystemImpl::ShaderGroupEnd (void)
+ShaderGroupRef
+ShadingSystemImpl::ShaderGroupCreate (string_view groupname)
 {
-    if (! m_in_group) {
+    ShaderGroupRef group (new ShaderGroup(groupname));
+    group->m_exec_repeat = m_exec_repeat;
+    return group;
+}
+
+
+
+bool
+ShadingSystemImpl::ShaderGroupEnd (void)
+{
+    if (! m_in_group) {
         error ("ShaderGroupEnd() was called without ShaderGroupBegin()");
         return false;
     }
+    bool ok = ShaderGroupEnd (*m_curgroup);
+    m_in_group = false;
+    m_curgroup->m_group_use = ShadUseUnknown;
+    return ok;
+}
+
+
+
+bool
+ShadingSystemImpl::ShaderGroupEnd (ShaderGroup &group)
+{
+    // Ending it again would register it with the census twice.
+    if (group.m_ended.exchange (true)) {
+        error ("ShaderGroupEnd() was called twice for shader group \"%s\"",
+               group.name());
+        return false;
+    }
 
     // Mark the layers that can be run lazily
-    if (m_group_use != ShadUseUnknown) {
-        int nlayers = m_curgroup->nlayers ();
+    if (group.m_group_use != ShadUseUnknown) {
+        int nlayers = group.nlayers ();
         for (int layer = 0;  layer < nlayers;  ++layer) {
-            ShaderInstance *inst = (*m_curgroup)[layer];
+            ShaderInstance *inst = group[layer];
             if (! inst)
                 continue;
             inst->last_layer (layer == nlayers-1);
@@ -1891,35 +2639,36 @@ ShadingSystemImpl::ShaderGroupEnd (void)
         // Merge instances now if they really want it bad, otherwise wait
         // until we optimize the group.
         if (m_opt_merge_instances >= 2)
-            merge_instances (*m_curgroup);
+            merge_instances (group);
     }
 
     // Merge the raytype_queries of all the individual layers
-    m_curgroup->m_raytype_queries = 0;
-    for (int layer = 0, n = m_curgroup->nlayers();  layer < n;  ++layer) {
-        ASSERT ((*m_curgroup)[layer]);
-        if (ShaderInstance *inst = (*m_curgroup)[layer])
-            m_curgroup->m_raytype_queries |= inst->master()->raytype_queries();
+    group.m_raytype_queries = 0;
+    for (int layer = 0, n = group.nlayers();  layer < n;  ++layer) {
+        ASSERT (group[layer]);
+        if (ShaderInstance *inst = group[layer])
+            group.m_raytype_queries |= inst->master()->raytype_queries();
     }
-    // std::cout << "Group " << m_curgroup->name() << " ray query bits "
-    //         << m_curgroup->m_raytype_queries << "\n";
+    // std::cout << "Group " << group.name() << " ray query bits "
+    //         << group.m_raytype_queries << "\n";
+    ParamValueList().swap (group.m_pending_params);
 
     {
         // Record the group in the SS's census of all extant groups
         spin_lock lock (m_all_shader_groups_mutex);
-        m_all_shader_groups.push_back (m_curgroup);
+        m_all_shader_groups.push_back (group.shared_from_this());
         ++m_groups_to_compile_count;
     }
+    // With both greedyjit and async_jit, start compiling right away.
+    if (m_greedyjit && m_async_jit)
+        async_optimize_group (group);
 
-    m_in_group = false;
-    m_group_use = ShadUseUnknown;
-
-    ustring groupname = m_curgroup->name();
+    ustring groupname = group.name();
     if (groupname.size() && groupname == m_archive_groupname) {
         std::string filename = m_archive_filename.string();
         if (! filename.size())
             filename = OIIO::Filesystem::filename (groupname.string()) + ".tar.gz";
-        archive_shadergroup (m_curgroup.get(), filename);
+        archive_shadergroup (&group, filename);
     }
     return true;
 }
@@ -1931,11 +2680,36 @@ ShadingSystemImpl::Shader (string_view shaderusage,
                            string_view shadername,
                            string_view layername)
 {
-    // Make sure we have a current attrib state
-    bool singleton = (! m_curgroup);
+    // Make sure we have a current attrib state.  A group that was already
+    // ended can't be added to, so a Shader() after it starts a new one.
+    bool singleton = (! m_curgroup || (! m_in_group && m_curgroup->m_ended));
     if (singleton)
         ShaderGroupBegin ("");
 
+    m_curgroup->m_pending_params.swap (m_pending_params);
+    m_pending_params.clear ();
+    bool ok = Shader (*m_curgroup, shaderusage, shadername, layername);
+    if (singleton) {
+        // A singleton doesn't fix the group's use, so the next Shader()
+        // replaces it rather than appending to it.
+        m_curgroup->m_group_use = ShadUseUnknown;
+    }
+    return ok;
+}
+
+
+
+bool
+ShadingSystemImpl::Shader (ShaderGroup &group, string_view shaderusage,
+                           string_view shadername, string_view layername)
+{
+    // The layers of an ended group may already be optimized or running.
+    if (group.m_ended) {
+        error ("Shader() was called for shader group \"%s\" after ShaderGroupEnd()",
+               group.name());
+        return false;
+    }
+
     ShaderMaster::ref master = loadshader (shadername);
     if (! master) {
         error ("Could not find shader \"%s\"", shadername);
@@ -1949,25 +2723,21 @@ ShadingSystemImpl::Shader (string_view shaderusage,
     }
 
     ShaderInstanceRef instance (new ShaderInstance (master, layername));
-    instance->parameters (m_pending_params);
-    m_pending_params.clear ();
+    instance->parameters (group.m_pending_params);
+    group.m_pending_params.clear ();
 
-    if (singleton || m_group_use == ShadUseUnknown) {
-        // A singleton, or the first in a group
-        m_curgroup->clear ();
+    if (group.m_group_use == ShadUseUnknown) {
+        // The first shader in the group
+        group.clear ();
         m_stat_groups += 1;
-    }
-    if (! singleton) {
-        if (m_group_use == ShadUseUnknown) {  // First shader in group
-            m_group_use = use;
-        } else if (use != m_group_use) {
-            error ("Shader usage \"%s\" does not match current group (%s)",
-                   shaderusage, shaderusename (m_group_use));
-            return false;
-        }
+        group.m_group_use = use;
+    } else if (use != group.m_group_use) {
+        error ("Shader usage \"%s\" does not match current group (%s)",
+               shaderusage, shaderusename (group.m_group_use));
+        return false;
     }
 
-    m_curgroup->append (instance);
+    group.append (instance);
     m_stat_groupinstances += 1;
 
     // FIXME -- check for duplicate layer name within the group?
@@ -1981,12 +2751,28 @@ bool
 ShadingSystemImpl::ConnectShaders (string_view srclayer, string_view srcparam,
                                    string_view dstlayer, string_view dstparam)
 {
-    // Basic sanity checks -- make sure it's a legal time to call
-    // ConnectShaders, and that the layer and parameter names are not empty.
     if (! m_in_group) {
         error ("ConnectShaders can only be called within ShaderGroupBegin/End");
         return false;
     }
+    return ConnectShaders (*m_curgroup, srclayer, srcparam, dstlayer, dstparam);
+}
+
+
+
+bool
+ShadingSystemImpl::ConnectShaders (ShaderGroup &group,
+                                   string_view srclayer, string_view srcparam,
+                                   string_view dstlayer, string_view dstparam)
+{
+    if (group.m_ended) {
+        error ("ConnectShaders() was called for shader group \"%s\" after ShaderGroupEnd()",
+               group.name());
+        return false;
+    }
+
+    // Basic sanity checks -- make sure the layer and parameter names are
+    // not empty.
     if (! srclayer.size() || ! srcparam.size()) {
         error ("ConnectShaders: badly formed source layer/parameter");
         return false;
@@ -2000,8 +2786,8 @@ ShadingSystemImpl::ConnectShaders (string_view srclayer, string_view srcparam,
     // pointers to the instances.  Error and return if they are not found,
     // or if it's not connecting an earlier src to a later dst.
     ShaderInstance *srcinst, *dstinst;
-    int srcinstindex = find_named_layer_in_group (ustring(srclayer), srcinst);
-    int dstinstindex = find_named_layer_in_group (ustring(dstlayer), dstinst);
+    int srcinstindex = find_named_layer_in_group (group, ustring(srclayer), srcinst);
+    int dstinstindex = find_named_layer_in_group (group, ustring(dstlayer), dstinst);
     if (! srcinst) {
         error ("ConnectShaders: source layer \"%s\" not found", srclayer);
         return false;
@@ -2040,7 +2826,7 @@ ShadingSystemImpl::ConnectShaders (string_view srclayer, string_view srcparam,
         for (size_t i = 0;  i < (size_t)srcstruct->numfields();  ++i) {
             std::string s = Strutil::format("%s.%s", srcparam, srcstruct->field(i).name);
             std::string d = Strutil::format("%s.%s", dstparam, dststruct->field(i).name);
-            ConnectShaders (srclayer, s, dstlayer, d);
+            ConnectShaders (group, srclayer, s, dstlayer, d);
         }
         return true;
     }
@@ -2345,15 +3131,21 @@ ShadingSystemImpl::ReParameter (ShaderGroup &group, string_view layername_,
     // Find the named layer
     ustring layername (layername_);
     ShaderInstance *layer = NULL;
+    int layerindex = -1;
     for (int i = 0, e = group.nlayers();  i < e;  ++i) {
         if (group[i]->layername() == layername) {
             layer = group[i];
+            layerindex = i;
             break;
         }
     }
     if (! layer)
         return false;   // could not find the named layer
 
+    if (group.optimized() && group.respecializable())
+        return reparameter_respecializable (group, layerindex,
+                                            ustring(paramname), type, val);
+
     // Find the named parameter within the layer
     int paramindex = layer->findparam (ustring(paramname));
     if (paramindex < 0)
@@ -2370,13 +3162,498 @@ ShadingSystemImpl::ReParameter (ShaderGroup &group, string_view layername_,
     if (group.optimized() && sym->lockgeom())
         return false;
 
-    // Do the deed
+    // Do the deed, on the instance's own copy of its values (which
+    // unshare_params makes the symbol point at) rather than a shared one.
+    layer->unshare_params ();
     memcpy (sym->data(), val, type.size());
     return true;
 }
 
 
 
+bool
+ShadingSystemImpl::reparameter_respecializable (ShaderGroup &group,
+                                                int layerindex,
+                                                ustring paramname,
+                                                TypeDesc type,
+                                                const void *val)
+{
+    // The unoptimized copy of the layer still knows which params were
+    // declared lockgeom=0, even if the optimizer has since folded them.
+    ShaderInstance *orig = group.m_unoptimized_layers[layerindex].get();
+    int paramindex = orig->findparam (paramname);
+    if (paramindex < 0)
+        return false;   // could not find the named parameter
+    const Symbol *msym = orig->mastersymbol (paramindex);
+    if (! equivalent (msym->typespec(), type) ||
+        msym->typespec().is_unsized_array() ||
+        orig->instoverride(paramindex)->lockgeom())
+        return false;
+
+    lock_guard lock (group.m_mutex);
+    memcpy (orig->param_storage(paramindex), val, type.size());
+    // Every param ever changed stays on the list, since each
+    // respecialization starts over from the unoptimized layers and must
+    // lock them all again; the flag says whether there's anything new.
+    group.m_respecialize_pending = true;
+    if (std::find (group.m_respecialize_layers.begin(),
+                   group.m_respecialize_layers.end(), layerindex)
+          == group.m_respecialize_layers.end())
+        group.m_respecialize_layers.push_back (layerindex);
+    std::pair<int,int> param (layerindex, paramindex);
+    if (std::find (group.m_respecialized_params.begin(),
+                   group.m_respecialized_params.end(), param)
+          == group.m_respecialized_params.end())
+        group.m_respecialized_params.push_back (param);
+
+    // Until the group is respecialized, the optimized layer's own copy
+    // of the param (if it still has an overridable one) is what's used.
+    ShaderInstance *layer = group[layerindex];
+    Symbol *sym = layer->symbol (layer->findparam (paramname));
+    if (sym && ! sym->lockgeom() && equivalent (sym->typespec(), type))
+        memcpy (sym->data(), val, type.size());
+    return true;
+}
+
+
+
+bool
+ShadingSystemImpl::respecialize_group (ShaderGroup &group)
+{
+    if (! group.optimized() || ! group.respecializable())
+        return false;
+    OIIO::Timer timer;
+
+    // Build a fresh group from the unoptimized layers, with every param
+    // changed by ReParameter locked to its new value.  The caller holds
+    // the group's lock.
+    auto respecialized_clone = [&]() {
+        ShaderGroupRef temp = clone_group_unoptimized (group);
+        for (auto &p : group.m_respecialized_params) {
+            SymOverrideInfo *so = temp->m_layers[p.first]->instoverride (p.second);
+            so->valuesource (Symbol::InstanceVal);
+            so->lockgeom (true);
+        }
+        // Sharing the unoptimized layers keeps the temporary group from
+        // making a copy of its own.
+        temp->m_unoptimized_layers = group.m_unoptimized_layers;
+        return temp;
+    };
+
+    ShaderGroupRef temp;
+    std::vector<int> changed;
+    {
+        lock_guard lock (group.m_mutex);
+        if (! group.m_respecialize_pending)
+            return true;    // nothing has changed
+        // Values are taken as of now; a ReParameter that comes along
+        // while we're optimizing marks the group pending again.
+        group.m_respecialize_pending = false;
+        changed.swap (group.m_respecialize_layers);
+        temp = respecialized_clone ();
+    }
+
+    // Usually only the layers that changed, and those downstream of
+    // them, need to be optimized and JITed again.  Failing that, the
+    // whole group is, which still reuses whatever instance optimizations
+    // the changes didn't touch (see "opt_specialization_cache").
+    if (! respecialize_downstream (group, *temp, changed)) {
+        if (temp->reuses_layers()) {
+            lock_guard lock (group.m_mutex);
+            temp = respecialized_clone ();
+        }
+        ++m_groups_to_compile_count;
+        optimize_group (*temp);
+    }
+
+    // Trade the results for the group's old ones, which go away with
+    // the temporary group.  Any code or instance data the new code
+    // refers to moves along with it, by swapping rather than copying.
+    // That includes the groupdata layout, which may only change because
+    // the group isn't executing on any thread right now.
+    {
+        lock_guard lock (group.m_mutex);
+        std::swap (group.m_does_nothing, temp->m_does_nothing);
+        std::swap (group.m_raytype_queries, temp->m_raytype_queries);
+        std::swap (group.m_llvm_groupdata_size, temp->m_llvm_groupdata_size);
+        std::swap (group.m_llvm_compiled_version, temp->m_llvm_compiled_version);
+        std::swap (group.m_llvm_compiled_init, temp->m_llvm_compiled_init);
+        group.m_llvm_groupdata_reset.swap (temp->m_llvm_groupdata_reset);
+        group.m_llvm_compiled_layers.swap (temp->m_llvm_compiled_layers);
+        group.m_llvm_jit_memory.swap (temp->m_llvm_jit_memory);
+        group.m_llvm_layer_table.swap (temp->m_llvm_layer_table);
+        group.m_llvm_lazy_layers.swap (temp->m_llvm_lazy_layers);
+        group.m_llvm_layer_remap.swap (temp->m_llvm_layer_remap);
+        group.m_llvm_retired_jit_memory.swap (temp->m_llvm_retired_jit_memory);
+        group.m_layers.swap (temp->m_layers);
+        group.m_textures_needed.swap (temp->m_textures_needed);
+        group.m_closures_needed.swap (temp->m_closures_needed);
+        group.m_globals_needed.swap (temp->m_globals_needed);
+        group.m_userdata_names.swap (temp->m_userdata_names);
+        group.m_userdata_types.swap (temp->m_userdata_types);
+        group.m_userdata_offsets.swap (temp->m_userdata_offsets);
+        group.m_userdata_derivs.swap (temp->m_userdata_derivs);
+        group.m_attributes_needed.swap (temp->m_attributes_needed);
+        group.m_attribute_scopes.swap (temp->m_attribute_scopes);
+        group.m_unknown_textures_needed = temp->m_unknown_textures_needed;
+        group.m_unknown_closures_needed = temp->m_unknown_closures_needed;
+        group.m_unknown_attributes_needed = temp->m_unknown_attributes_needed;
+        // The old code may have been awaiting promotion to the full
+        // optimization tier; the new code starts over at its own tier.
+        bool promotable = temp->m_llvm_promotable;
+        temp->m_llvm_promotable = false;
+        group.m_llvm_promotable = promotable;
+        group.m_llvm_promotion_queued = false;
+        group.m_executions = 0;
+    }
+
+    m_stat_groups_respecialized += 1;
+    spin_lock stat_lock (m_stat_mutex);
+    m_stat_respecialize_time += timer();
+    return true;
+}
+
+
+
+bool
+ShadingSystemImpl::respecialize_downstream (ShaderGroup &group,
+                                            ShaderGroup &temp,
+                                            const std::vector<int> &changed)
+{
+    int nlayers = group.nlayers();
+    std::vector<bool> keep (nlayers, true);
+    int nkept = nlayers;
+    {
+        lock_guard lock (group.m_mutex);
+        // Only code that was JITed a layer at a time, and that calls
+        // other layers through the layer table, can be kept piecemeal
+        // (see BackendLLVM::run_split).  Code awaiting promotion to the
+        // full optimization tier is better redone in full anyway.
+        if (group.does_nothing() || group.m_llvm_promotable ||
+            group.m_llvm_layer_table.size() != size_t(nlayers) ||
+            group.m_llvm_layer_remap.size() != size_t(nlayers))
+            return false;
+
+        // Redo the layers that changed and all those downstream of them,
+        // whether connected as the group was built or as optimized.
+        for (int layer : changed)
+            keep[layer] = false;
+        for (int layer = 0;  layer < nlayers;  ++layer) {
+            for (auto&& c : group.m_unoptimized_layers[layer]->connections())
+                keep[layer] = keep[layer] && keep[c.srclayer];
+            for (auto&& c : group[layer]->connections())
+                keep[layer] = keep[layer] && keep[c.srclayer];
+            nkept -= ! keep[layer];
+        }
+        if (! nkept)
+            return false;
+
+        // The layers kept are shared with the group as they are, so the
+        // connections to them must name their params as numbered after
+        // optimization.
+        temp.m_reused_layers = keep;
+        for (int layer = 0;  layer < nlayers;  ++layer) {
+            if (keep[layer]) {
+                temp.m_layers[layer] = group.m_layers[layer];
+                continue;
+            }
+            for (auto&& c : temp.m_layers[layer]->connections()) {
+                if (! keep[c.srclayer])
+                    continue;
+                const ShaderInstance *up = group[c.srclayer];
+                ustring name = group.m_unoptimized_layers[c.srclayer]->mastersymbol(c.src.param)->name();
+                int param = up->findparam (name);
+                const Symbol *sym = up->symbol (param);
+                if (! sym || sym->name() != name)
+                    return false;
+                c.src.param = param;
+            }
+        }
+    }
+
+    ShadingContext *ctx = get_context ();
+    RuntimeOptimizer rop (*this, temp, ctx);
+    rop.run ();
+
+    // The userdata the layers kept look up stays where it is, so the
+    // layers redone may only need userdata that was already there.
+    bool ok = rop.reused_layers_ok ();
+    for (auto&& n : rop.m_userdata_needed) {
+        size_t i = 0, e = group.m_userdata_names.size();
+        while (i < e && ! (group.m_userdata_names[i] == n.name &&
+                           equivalent (group.m_userdata_types[i], n.type)))
+            ++i;
+        if (i == e || (n.derivs && ! group.m_userdata_derivs[i]))
+            ok = false;
+    }
+    if (! ok) {
+        release_context (ctx);
+        return false;
+    }
+
+    // What the group needs is gathered from ops, and the layers kept
+    // don't have theirs any more, so keep what the group needed before
+    // (some of which may have been only for the layers redone) and add
+    // whatever else the layers redone need now.
+    temp.m_userdata_names = group.m_userdata_names;
+    temp.m_userdata_types = group.m_userdata_types;
+    temp.m_userdata_offsets = group.m_userdata_offsets;
+    temp.m_userdata_derivs = group.m_userdata_derivs;
+    auto add_needed = [](std::vector<ustring> &needed, ustring name) {
+        if (std::find (needed.begin(), needed.end(), name) == needed.end())
+            needed.push_back (name);
+    };
+    temp.m_textures_needed = group.m_textures_needed;
+    for (auto&& f : rop.m_textures_needed)
+        add_needed (temp.m_textures_needed, f);
+    temp.m_closures_needed = group.m_closures_needed;
+    for (auto&& f : rop.m_closures_needed)
+        add_needed (temp.m_closures_needed, f);
+    temp.m_globals_needed = group.m_globals_needed;
+    for (auto&& f : rop.m_globals_needed)
+        add_needed (temp.m_globals_needed, f);
+    temp.m_attributes_needed = group.m_attributes_needed;
+    temp.m_attribute_scopes = group.m_attribute_scopes;
+    for (auto&& f : rop.m_attributes_needed) {
+        size_t i = 0, e = temp.m_attributes_needed.size();
+        while (i < e && ! (temp.m_attributes_needed[i] == f.name &&
+                           temp.m_attribute_scopes[i] == f.scope))
+            ++i;
+        if (i == e) {
+            temp.m_attributes_needed.push_back (f.name);
+            temp.m_attribute_scopes.push_back (f.scope);
+        }
+    }
+    temp.m_unknown_textures_needed = group.m_unknown_textures_needed
+                                     || rop.m_unknown_textures_needed;
+    temp.m_unknown_closures_needed = group.m_unknown_closures_needed
+                                     || rop.m_unknown_closures_needed;
+    temp.m_unknown_attributes_needed = group.m_unknown_attributes_needed
+                                       || rop.m_unknown_attributes_needed;
+
+    // The new code goes into the group's layer table, next to the kept
+    // layers' code, so lend the group's code to the temporary group for
+    // JITing (respecialize_group trades it back).  The kept layers'
+    // code must find its params, and the run flags of the layers it
+    // calls, right where they were.
+    std::vector<int> old_remap (group.m_llvm_layer_remap);
+    std::vector<int> old_offsets;
+    for (int layer = 0;  layer < nlayers;  ++layer)
+        if (keep[layer] && ! group[layer]->unused())
+            FOREACH_PARAM (const Symbol &sym, group[layer])
+                old_offsets.push_back (sym.dataoffset());
+    auto trade_code = [&]() {
+        lock_guard lock (group.m_mutex);
+        group.m_llvm_layer_table.swap (temp.m_llvm_layer_table);
+        group.m_llvm_lazy_layers.swap (temp.m_llvm_lazy_layers);
+        group.m_llvm_jit_memory.swap (temp.m_llvm_jit_memory);
+        group.m_llvm_retired_jit_memory.swap (temp.m_llvm_retired_jit_memory);
+    };
+    trade_code ();
+
+    BackendLLVM lljitter (*this, temp, ctx);
+    lljitter.fast_tier (false);
+    lljitter.run ();
+
+    ok = (temp.m_llvm_layer_remap.size() == size_t(nlayers));
+    size_t i = 0;
+    for (int layer = 0;  ok && layer < nlayers;  ++layer) {
+        if (! keep[layer])
+            continue;
+        ok = (temp.m_llvm_layer_remap[layer] == old_remap[layer]);
+        if (! group[layer]->unused())
+            FOREACH_PARAM (const Symbol &sym, group[layer])
+                ok = ok && (sym.dataoffset() == old_offsets[i++]);
+    }
+    if (! ok) {
+        // The group gets back its code, which is untouched, but for the
+        // redone layers' table entries and the kept layers' data
+        // offsets; the respecialization of the whole group that follows
+        // replaces all of those.
+        trade_code ();
+        release_context (ctx);
+        return false;
+    }
+
+    group_post_jit_cleanup (temp);
+    release_context (ctx);
+
+    m_stat_respecialize_layers_kept += nkept;
+    spin_lock stat_lock (m_stat_mutex);
+    m_stat_specialization_time += rop.m_stat_specialization_time;
+    m_stat_total_llvm_time += lljitter.m_stat_total_llvm_time;
+    m_stat_llvm_setup_time += lljitter.m_stat_llvm_setup_time;
+    m_stat_llvm_irgen_time += lljitter.m_stat_llvm_irgen_time;
+    m_stat_llvm_opt_time += lljitter.m_stat_llvm_opt_time;
+    m_stat_llvm_jit_time += lljitter.m_stat_llvm_jit_time;
+    m_stat_llvm_setup_saved += lljitter.m_stat_llvm_setup_saved;
+    return true;
+}
+
+
+
+ShaderGroupRef
+ShadingSystemImpl::clone_group_unoptimized (const ShaderGroup &group)
+{
+    const std::vector<ShaderInstanceRef> &layers (group.optimized()
+                                                  ? group.m_unoptimized_layers
+                                                  : group.m_layers);
+    ShaderGroupRef clone (new ShaderGroup (group.name()));
+    clone->m_layers.reserve (layers.size());
+    for (auto&& layer : layers)
+        clone->m_layers.push_back (layer->clone_unoptimized());
+    clone->m_num_entry_layers = group.m_num_entry_layers;
+    clone->m_exec_repeat = group.m_exec_repeat;
+    clone->m_raytype_queries = group.m_raytype_queries;
+    clone->m_raytypes_on = group.m_raytypes_on;
+    clone->m_raytypes_off = group.m_raytypes_off;
+    clone->m_renderer_outputs = group.m_renderer_outputs;
+    clone->m_object_variant_key = group.m_object_variant_key;
+    clone->m_object_attributes = group.m_object_attributes;
+    return clone;
+}
+
+
+
+ShaderGroupRef
+ShadingSystemImpl::object_variant (ShaderGroup &group,
+                                   const ParamValueList &attributes)
+{
+    // The key is made of the attributes sorted by name, so it doesn't
+    // matter what order they're given in.
+    std::vector<const ParamValue *> sorted;
+    for (auto&& p : attributes)
+        sorted.push_back (&p);
+    std::sort (sorted.begin(), sorted.end(),
+               [](const ParamValue *a, const ParamValue *b) {
+                   return a->name() < b->name();
+               });
+    std::string key ("attributes");
+    for (const ParamValue *p : sorted) {
+        const char *name = p->name().c_str();
+        TypeDesc type = p->type();
+        int nvalues = p->nvalues();
+        key.append ((const char *)&name, sizeof(name));
+        key.append ((const char *)&type, sizeof(type));
+        key.append ((const char *)&nvalues, sizeof(nvalues));
+        key.append ((const char *)p->data(), type.size() * nvalues);
+    }
+    return find_object_variant (group, key, attributes);
+}
+
+
+
+ShaderGroupRef
+ShadingSystemImpl::object_variant (ShaderGroup &group, void *objdata)
+{
+    // The objdata pointer says nothing about the object it's for once
+    // that's gone (and another may come along at the same address), so
+    // ask the renderer now for everything the group's code asks for by
+    // name, and make the variant for the values it gives.  Objects that
+    // answer the same share a variant.
+    std::vector<ObjectAttributeQuery> queries;
+    {
+        lock_guard lock (group.m_mutex);
+        const std::vector<ShaderInstanceRef> &layers (group.optimized()
+                                                      ? group.m_unoptimized_layers
+                                                      : group.m_layers);
+        for (auto&& layer : layers)
+            for (auto&& q : layer->master()->object_attribute_queries())
+                if (std::find (queries.begin(), queries.end(), q) == queries.end())
+                    queries.push_back (q);
+    }
+
+    // A whole attribute, or the run of its elements up to the highest
+    // one asked for, becomes one of the variant's attributes.  An
+    // attribute asked for both ways, or as different types, isn't folded.
+    std::map<ustring,std::pair<TypeDesc,int> > wanted;
+    std::set<ustring> mixed;
+    for (auto&& q : queries) {
+        auto found = wanted.find (q.name);
+        if (found == wanted.end())
+            wanted[q.name] = std::make_pair (q.type, q.index);
+        else if (found->second.first != q.type ||
+                 (found->second.second < 0) != (q.index < 0))
+            mixed.insert (q.name);
+        else
+            found->second.second = std::max (found->second.second, q.index);
+    }
+    ParamValueList attributes;
+    const size_t maxbufsize = 1024;
+    char buf[maxbufsize];
+    for (auto&& w : wanted) {
+        ustring name = w.first;
+        TypeDesc type = w.second.first;
+        int maxindex = w.second.second;
+        int nvalues = std::max (maxindex+1, 1);
+        if (mixed.count (name) || type.size() * nvalues > maxbufsize)
+            continue;
+        bool found = true;
+        if (maxindex < 0)
+            found = renderer()->get_object_attribute (objdata, type, name, -1, buf);
+        for (int i = 0;  i <= maxindex && found;  ++i)
+            found = renderer()->get_object_attribute (objdata, type, name, i,
+                                                      buf + i * type.size());
+        if (found)
+            attributes.push_back (ParamValue (name, type, nvalues, buf));
+    }
+    return object_variant (group, attributes);
+}
+
+
+
+ShaderGroupRef
+ShadingSystemImpl::find_object_variant (ShaderGroup &group,
+                                        const std::string &key,
+                                        const ParamValueList &attributes)
+{
+    ShaderGroupRef variant;
+    {
+        lock_guard lock (group.m_mutex);
+        std::weak_ptr<ShaderGroup> &entry (group.m_object_variants[key]);
+        variant = entry.lock();
+        if (variant) {
+            m_stat_object_variants_reused += 1;
+            return variant;
+        }
+        // Forget the variants nobody uses any more.
+        for (auto i = group.m_object_variants.begin();
+             i != group.m_object_variants.end();  ) {
+            if (i->second.expired() && &i->second != &entry)
+                i = group.m_object_variants.erase (i);
+            else
+                ++i;
+        }
+        if (group.optimized() && ! group.respecializable()) {
+            group.m_object_variants.erase (key);
+            error ("Can't make an object variant of shader group \"%s\", which was already optimized without \"allow_respecialize\"",
+                   group.name());
+            return ShaderGroupRef();
+        }
+        variant = clone_group_unoptimized (group);
+        // A variant of a variant folds the attributes of both, with the
+        // new ones taking precedence.
+        variant->m_object_variant_key += key;
+        ParamValueList allattribs (attributes);
+        for (auto&& p : group.m_object_attributes)
+            allattribs.push_back (p);
+        variant->m_object_attributes = allattribs;
+        entry = variant;
+    }
+    // The variant is complete as it is, and needs no ShaderGroupEnd.
+    variant->m_ended = true;
+    {
+        // Record the group in the SS's census of all extant groups
+        spin_lock lock (m_all_shader_groups_mutex);
+        m_all_shader_groups.push_back (variant);
+        ++m_groups_to_compile_count;
+    }
+    m_stat_object_variants += 1;
+    return variant;
+}
+
+
+
 PerThreadInfo *
 ShadingSystemImpl::create_thread_info()
 {
@@ -2421,14 +3698,14 @@ ShadingSystemImpl::release_context (ShadingContext *ctx)
 
 bool
 ShadingSystemImpl::execute (ShadingContext *ctx, ShaderGroup &group,
-                            ShaderGlobals &ssg, bool run)
+                            ShaderGlobals &ssg, bool run, bool *not_ready)
 {
     bool free_context = false;
     if (! ctx) {
         ctx = get_context();
         free_context = true;
     }
-    bool result = ctx->execute (group, ssg, run);
+    bool result = ctx->execute (group, ssg, run, not_ready);
     if (free_context)
         release_context (ctx);
     return result;
@@ -2452,13 +3729,13 @@ ShadingSystemImpl::get_symbol (ShadingContext &ctx, ustring layername,
 
 
 int
-ShadingSystemImpl::find_named_layer_in_group (ustring layername,
+ShadingSystemImpl::find_named_layer_in_group (ShaderGroup &group,
+                                              ustring layername,
                                               ShaderInstance * &inst)
 {
     inst = NULL;
-    if (m_group_use >= ShadUseUnknown)
+    if (group.m_group_use >= ShadUseUnknown)
         return -1;
-    ShaderGroup &group (*m_curgroup);
     for (int i = 0;  i < group.nlayers();  ++i) {
         if (group[i]->layername() == layername) {
             inst = group[i];
@@ -2598,6 +3875,10 @@ ShadingSystemImpl::group_post_jit_cleanup (ShaderGroup &group)
     size_t connectionmem = 0;
     for (int layer = 0;  layer < group.nlayers();  ++layer) {
         ShaderInstance *inst = group[layer];
+        // Layers JITed on first call still need theirs (they're freed
+        // after that, by BackendLLVM::compile_lazy_layer).
+        if (group.llvm_lazy_layer (layer))
+            continue;
         // We no longer needs ops and args -- create empty vectors and
         // swap with the ones in the instance.
         OpcodeVec emptyops;
@@ -2650,7 +3931,7 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group)
         // and also as optimized so nobody locks on it again, and record
         // how long we waited for the lock.
         group.does_nothing (true);
-        group.m_optimized = true;
+        group.optimized (true);
         spin_lock stat_lock (m_stat_mutex);
         double t = timer();
         m_stat_optimization_time += t;
@@ -2660,43 +3941,64 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group)
 
     double locking_time = timer();
 
+    // Keep a copy of the layers as they were before optimization, from
+    // which the group may be respecialized after ReParameter.
+    if (m_allow_respecialize && ! group.respecializable()) {
+        group.m_unoptimized_layers.reserve (group.nlayers());
+        for (int layer = 0;  layer < group.nlayers();  ++layer)
+            group.m_unoptimized_layers.push_back (group[layer]->clone_unoptimized());
+    }
+
     ShadingContext *ctx = get_context ();
     RuntimeOptimizer rop (*this, group, ctx);
-    rop.run ();
+    BackendLLVM lljitter (*this, group, ctx);
 
-    // Copy some info recorted by the RuntimeOptimizer into the group
-    group.m_unknown_textures_needed = rop.m_unknown_textures_needed;
-    for (auto&& f : rop.m_textures_needed)
-        group.m_textures_needed.push_back (f);
-    group.m_unknown_closures_needed = rop.m_unknown_closures_needed;
-    for (auto&& f : rop.m_closures_needed)
-        group.m_closures_needed.push_back (f);
-    for (auto&& f : rop.m_globals_needed)
-        group.m_globals_needed.push_back (f);
-    size_t num_userdata = rop.m_userdata_needed.size();
-    group.m_userdata_names.reserve (num_userdata);
-    group.m_userdata_types.reserve (num_userdata);
-    group.m_userdata_offsets.resize (num_userdata, 0);
-    group.m_userdata_derivs.reserve (num_userdata);
-    for (auto&& n : rop.m_userdata_needed) {
-        group.m_userdata_names.push_back (n.name);
-        group.m_userdata_types.push_back (n.type);
-        group.m_userdata_derivs.push_back (n.derivs);
-    }
-    group.m_unknown_attributes_needed = rop.m_unknown_attributes_needed;
-    for (auto&& f : rop.m_attributes_needed) {
-        group.m_attributes_needed.push_back (f.name);
-        group.m_attribute_scopes.push_back (f.scope);
-    }
+    // Precompiled code carries what the optimizer worked out about the
+    // group, so if it matches the group, neither the optimizer nor the
+    // JIT needs to run at all.
+    if (! lljitter.load_precompiled ()) {
+        rop.run ();
+
+        // Copy some info recorted by the RuntimeOptimizer into the group
+        group.m_unknown_textures_needed = rop.m_unknown_textures_needed;
+        for (auto&& f : rop.m_textures_needed)
+            group.m_textures_needed.push_back (f);
+        group.m_unknown_closures_needed = rop.m_unknown_closures_needed;
+        for (auto&& f : rop.m_closures_needed)
+            group.m_closures_needed.push_back (f);
+        for (auto&& f : rop.m_globals_needed)
+            group.m_globals_needed.push_back (f);
+        size_t num_userdata = rop.m_userdata_needed.size();
+        group.m_userdata_names.reserve (num_userdata);
+        group.m_userdata_types.reserve (num_userdata);
+        group.m_userdata_offsets.resize (num_userdata, 0);
+        group.m_userdata_derivs.reserve (num_userdata);
+        for (auto&& n : rop.m_userdata_needed) {
+            group.m_userdata_names.push_back (n.name);
+            group.m_userdata_types.push_back (n.type);
+            group.m_userdata_derivs.push_back (n.derivs);
+        }
+        group.m_unknown_attributes_needed = rop.m_unknown_attributes_needed;
+        for (auto&& f : rop.m_attributes_needed) {
+            group.m_attributes_needed.push_back (f.name);
+            group.m_attribute_scopes.push_back (f.scope);
+        }
 
-    BackendLLVM lljitter (*this, group, ctx);
-    lljitter.run ();
+        lljitter.run ();
+    }
 
-    group_post_jit_cleanup (group);
+    // Code compiled at the fast tier may be recompiled later, for which
+    // we'll need to hold on to the ops a while longer.
+    if (lljitter.fast_tier() && ! group.does_nothing())
+        group.m_llvm_promotable = true;
+    else
+        group_post_jit_cleanup (group);
 
     release_context (ctx);
 
-    group.m_optimized = true;
+    // Everything about the group must be visible to other threads before
+    // they see it marked as optimized (see group_ready()).
+    group.optimized (true);
     spin_lock stat_lock (m_stat_mutex);
     m_stat_optimization_time += timer();
     m_stat_opt_locking_time += locking_time + rop.m_stat_opt_locking_time;
@@ -2706,6 +4008,7 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group)
     m_stat_llvm_irgen_time += lljitter.m_stat_llvm_irgen_time;
     m_stat_llvm_opt_time += lljitter.m_stat_llvm_opt_time;
     m_stat_llvm_jit_time += lljitter.m_stat_llvm_jit_time;
+    m_stat_llvm_setup_saved += lljitter.m_stat_llvm_setup_saved;
     m_stat_max_llvm_local_mem = std::max (m_stat_max_llvm_local_mem,
                                           lljitter.m_llvm_local_mem);
     m_stat_groups_compiled += 1;
@@ -2715,55 +4018,333 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group)
 
 
 
-static void optimize_all_groups_wrapper (ShadingSystemImpl *ss, int mythread, int totalthreads)
+void
+ShadingSystemImpl::parallel_for (int ntasks,
+                                 const std::function<void(int)> &task)
 {
-    ss->optimize_all_groups (1, mythread, totalthreads);
+    if (ntasks <= 1) {
+        task (0);
+    } else if (m_parallel_for) {
+        m_parallel_for (ntasks, task);
+    } else {
+        std::call_once (m_compile_pool_once,
+                        [this](){ m_compile_pool.reset (new CompilePool); });
+        m_compile_pool->run (ntasks, task);
+    }
 }
 
 
 
 void
-ShadingSystemImpl::optimize_all_groups (int nthreads, int mythread, int totalthreads)
+ShadingSystemImpl::optimize_all_groups (int nthreads)
 {
-    // Spawn a bunch of threads to do this in parallel -- just call this
-    // routine again (with threads=1) for each thread.
+    // Gather the groups that still need to be compiled, and sort them so
+    // that the most expensive ones go first.  Otherwise, a huge group that
+    // happens to be near the end of the list can keep one thread busy
+    // long after all the others have run out of work.  We estimate the
+    // cost as the total number of ops times the number of layers.
+    std::vector<std::pair<long long,ShaderGroupRef> > work;
+    {
+        spin_lock lock (m_all_shader_groups_mutex);
+        for (auto&& grp : m_all_shader_groups) {
+            ShaderGroupRef g = grp.lock();
+            if (g && ! g->optimized())
+                work.push_back (std::make_pair (0LL, g));
+        }
+    }
+    if (work.empty())
+        return;
+    for (auto&& w : work) {
+        const ShaderGroup &g (*w.second);
+        long long ops = 0;
+        for (int layer = 0, n = g.nlayers();  layer < n;  ++layer)
+            ops += g[layer]->maincodeend();
+        w.first = ops * std::max (1, g.nlayers());
+    }
+    std::stable_sort (work.begin(), work.end(),
+                      [](const std::pair<long long,ShaderGroupRef> &a,
+                         const std::pair<long long,ShaderGroupRef> &b) {
+                          return a.first > b.first;
+                      });
+
     if (nthreads < 1)  // threads <= 0 means use all hardware available
-        nthreads = std::min ((int)std::thread::hardware_concurrency(),
-                             (int)m_groups_to_compile_count);
-    if (nthreads > 1) {
-        if (m_threads_currently_compiling)
-            return;   // never mind, somebody else spawned the JIT threads
-        OIIO::thread_group threads;
-        m_threads_currently_compiling += nthreads;
-        for (int t = 0;  t < nthreads;  ++t)
-            threads.add_thread (new std::thread (optimize_all_groups_wrapper, this, t, nthreads));
-        threads.join_all ();
+        nthreads = (int)std::thread::hardware_concurrency();
+    nthreads = std::max (1, std::min (nthreads, (int)work.size()));
+    if ((m_threads_currently_compiling += nthreads) != nthreads) {
+        // never mind, somebody else is already compiling everything
         m_threads_currently_compiling -= nthreads;
         return;
     }
 
-    // And here's the single thread case
-    size_t ngroups = 0;
+    // Each task just keeps grabbing the next most expensive group until
+    // there are none left.
+    atomic_int next (0);
+    std::vector<double> busy (nthreads, 0.0);
+    OIIO::Timer wall;
+    std::function<void(int)> task = [&](int t) {
+        OIIO::Timer timer;
+        for (int i = next++;  i < (int)work.size();  i = next++)
+            optimize_group (*work[i].second);
+        if (t >= 0 && t < nthreads)
+            busy[t] += timer();
+    };
+    parallel_for (nthreads, task);
+    double elapsed = wall();
+    m_threads_currently_compiling -= nthreads;
+
+    spin_lock stat_lock (m_stat_mutex);
+    if ((int)m_stat_compile_thread_busy_time.size() < nthreads) {
+        m_stat_compile_thread_busy_time.resize (nthreads, 0.0);
+        m_stat_compile_thread_idle_time.resize (nthreads, 0.0);
+    }
+    for (int t = 0;  t < nthreads;  ++t) {
+        m_stat_compile_thread_busy_time[t] += busy[t];
+        m_stat_compile_thread_idle_time[t] += std::max (0.0, elapsed - busy[t]);
+    }
+}
+
+
+
+void
+ShadingSystemImpl::recompile_group (ShaderGroup &group)
+{
+    OIIO::Timer timer;
+    lock_guard lock (group.m_mutex);
+    if (! group.m_llvm_promotable)
+        return;
+
+    // Threads may be running the fast tier code at this very moment, so
+    // it has to stay around for the life of the group.  Each entry point
+    // is swapped for its new version with a single pointer store; a
+    // thread that picks up a mix of old and new entry points is fine,
+    // since both tiers were generated from the same optimized group, and
+    // the new code is built against the groupdata layout the group
+    // already has (see BackendLLVM::llvm_type_groupdata).
+    group.m_llvm_retired_jit_memory.insert (group.m_llvm_retired_jit_memory.end(),
+                                            group.llvm_jit_memory().begin(),
+                                            group.llvm_jit_memory().end());
+    ShadingContext *ctx = get_context ();
+    BackendLLVM lljitter (*this, group, ctx);
+    lljitter.fast_tier (false);
+    lljitter.run ();
+    group.m_llvm_promotable = false;
+    group_post_jit_cleanup (group);
+    release_context (ctx);
+
+    spin_lock stat_lock (m_stat_mutex);
+    m_stat_llvm_promote_time += timer();
+    m_stat_total_llvm_time += lljitter.m_stat_total_llvm_time;
+    m_stat_llvm_setup_time += lljitter.m_stat_llvm_setup_time;
+    m_stat_llvm_irgen_time += lljitter.m_stat_llvm_irgen_time;
+    m_stat_llvm_opt_time += lljitter.m_stat_llvm_opt_time;
+    m_stat_llvm_jit_time += lljitter.m_stat_llvm_jit_time;
+    m_stat_llvm_setup_saved += lljitter.m_stat_llvm_setup_saved;
+    m_stat_max_llvm_local_mem = std::max (m_stat_max_llvm_local_mem,
+                                          lljitter.m_llvm_local_mem);
+    m_stat_groups_promoted += 1;
+}
+
+
+
+void
+ShadingSystemImpl::queue_async_jit (ShaderGroup &group, bool promote)
+{
+    std::lock_guard<std::mutex> lock (m_async_jit_mutex);
+    if (m_async_jit_stop)
+        return;
+    // Start the JIT threads the first time we need them.  Recompiling
+    // hot groups needs them even if "async_jit" is off, but just one.
+    if (m_async_jit_threads.empty()) {
+        int nthreads = m_async_jit;
+        if (nthreads < 0)
+            nthreads = std::max (1, (int)std::thread::hardware_concurrency());
+        nthreads = std::max (nthreads, 1);
+        for (int t = 0;  t < nthreads;  ++t)
+            m_async_jit_threads.push_back (std::thread (&ShadingSystemImpl::async_jit_worker, this));
+    }
+    AsyncJITRequest req;
+    req.group = group.shared_from_this();
+    req.promote = promote;
+    m_async_jit_queue.push_back (req);
+    if (! promote)
+        m_stat_async_jit_queued += 1;
+    m_stat_async_jit_queue_peak = std::max (m_stat_async_jit_queue_peak,
+                                            (int)m_async_jit_queue.size());
+    m_async_jit_cv.notify_one ();
+}
+
+
+
+void
+ShadingSystemImpl::async_optimize_group (ShaderGroup &group)
+{
+    if (group.optimized() || group.m_async_jit_queued.exchange (true))
+        return;   // already done, or somebody else queued it
+    queue_async_jit (group, false);
+}
+
+
+
+void
+ShadingSystemImpl::promote_group (ShaderGroup &group)
+{
+    if (group.m_llvm_promotion_queued.exchange (true))
+        return;   // somebody else queued it
+    queue_async_jit (group, true);
+}
+
+
+
+void
+ShadingSystemImpl::async_optimize_all_groups ()
+{
+    std::vector<ShaderGroupRef> groups;
     {
         spin_lock lock (m_all_shader_groups_mutex);
-        ngroups = m_all_shader_groups.size();
-    }
-    for (size_t i = 0;  i < ngroups;  ++i) {
-        // Assign to threads based on mod of totalthreads
-        if ((i % totalthreads) == (unsigned)mythread) {
-            ShaderGroupRef group;
-            {
-                spin_lock lock (m_all_shader_groups_mutex);
-                group = m_all_shader_groups[i].lock();
-            }
-            if (group)
-                optimize_group (*group);
+        for (auto&& grp : m_all_shader_groups)
+            if (ShaderGroupRef g = grp.lock())
+                groups.push_back (g);
+    }
+    for (auto&& g : groups)
+        async_optimize_group (*g);
+}
+
+
+
+bool
+ShadingSystemImpl::group_ready (const ShaderGroup &group) const
+{
+    // optimized() is an acquire load, so seeing it set means seeing
+    // everything the JIT thread wrote before it set it.
+    return group.optimized();
+}
+
+
+
+bool
+ShadingSystemImpl::wait_for_group (ShaderGroup &group)
+{
+    if (group.optimized())
+        return true;
+    if (! m_async_jit) {
+        optimize_group (group);
+        return true;
+    }
+    async_optimize_group (group);
+    std::unique_lock<std::mutex> lock (m_async_jit_mutex);
+    m_async_jit_done_cv.wait (lock, [&](){
+        return group.optimized() || m_async_jit_stop;
+    });
+    return group.optimized();
+}
+
+
+
+bool
+ShadingSystemImpl::wait_for_promotion (ShaderGroup &group)
+{
+    if (! group.m_llvm_promotable)
+        return true;
+    if (! group.m_llvm_promotion_queued)
+        return false;   // not hot enough yet; it may never be
+    std::unique_lock<std::mutex> lock (m_async_jit_mutex);
+    m_async_jit_done_cv.wait (lock, [&](){
+        return ! group.m_llvm_promotable || m_async_jit_stop;
+    });
+    return ! group.m_llvm_promotable;
+}
+
+
+
+SpecializedInstanceRef
+ShadingSystemImpl::find_specialization (const std::string &key)
+{
+    m_stat_specialization_lookups += 1;
+    spin_lock lock (m_specializations_mutex);
+    auto found = m_specializations.find (key);
+    if (found == m_specializations.end())
+        return SpecializedInstanceRef();
+    m_stat_specialization_hits += 1;
+    return found->second;
+}
+
+
+
+void
+ShadingSystemImpl::add_specialization (const std::string &key,
+                                       const SpecializedInstanceRef &spec)
+{
+    spin_lock lock (m_specializations_mutex);
+    // Rather than keep track of which entries are stale, just start over
+    // when the cache is full.
+    if (m_specializations.size() >= size_t(m_opt_specialization_cache))
+        m_specializations.clear ();
+    m_specializations[key] = spec;
+}
+
+
+
+void
+ShadingSystemImpl::clear_specializations ()
+{
+    spin_lock lock (m_specializations_mutex);
+    m_specializations.clear ();
+}
+
+
+
+void
+ShadingSystemImpl::async_jit_worker ()
+{
+    while (1) {
+        ShaderGroupRef group;
+        bool promote = false;
+        {
+            std::unique_lock<std::mutex> lock (m_async_jit_mutex);
+            m_async_jit_cv.wait (lock, [this](){
+                return m_async_jit_stop || ! m_async_jit_queue.empty();
+            });
+            if (m_async_jit_stop)
+                return;
+            AsyncJITRequest &req (m_async_jit_queue.front());
+            m_stat_async_jit_wait_time += req.timer();
+            group = req.group.lock();
+            promote = req.promote;
+            m_async_jit_queue.pop_front ();
         }
+        // The group may have been destroyed while it was in the queue.
+        if (group && promote)
+            recompile_group (*group);
+        else if (group)
+            optimize_group (*group);
+        // Wake anybody waiting for this group (see wait_for_group).
+        {
+            std::lock_guard<std::mutex> lock (m_async_jit_mutex);
+        }
+        m_async_jit_done_cv.notify_all ();
     }
 }
 
 
 
+void
+ShadingSystemImpl::stop_async_jit ()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock (m_async_jit_mutex);
+        m_async_jit_stop = true;
+        m_async_jit_queue.clear ();
+        threads.swap (m_async_jit_threads);
+    }
+    m_async_jit_cv.notify_all ();
+    m_async_jit_done_cv.notify_all ();
+    for (auto&& t : threads)
+        t.join ();
+}
+
+
+
 int
 ShadingSystemImpl::merge_instances (ShaderGroup &group, bool post_opt)
 {
@@ -2786,19 +4367,20 @@ ShadingSystemImpl::merge_instances (ShaderGroup &group, bool post_opt)
     // general shading and lookdev approach of the studio.  But it was
     // very helpful for us in many cases.
     //
-    // The basic loop below looks very inefficient, O(n^2) in number of
-    // instances in the group. But it's really not -- a few seconds (sum
-    // of all threads) for even our very complex scenes. This is because
-    // most potential pairs have a very fast rejection case if they are
-    // not using the same master.  Since there's no appreciable cost to
-    // the brute force approach, it seems silly to have a complex scheme
-    // to try to reduce the number of pairings.
+    // Comparing every pair of layers is O(n^2) in the number of layers,
+    // which adds up for groups with thousands of them.  Instead, we bin
+    // the layers by ShaderInstance::merge_signature(), and only compare
+    // a layer to the earlier ones with the same signature.  Layers are
+    // visited in order, so by the time we get to one, its connections
+    // from any upstream layers that were merged away have already been
+    // redirected to the layers that replaced them.
 
     if (! m_opt_merge_instances || optimize() < 1)
         return 0;
 
     OIIO::Timer timer;          // Time we spend looking for and doing merges
     int merges = 0;             // number of merges we do
+    int compares = 0;           // number of full comparisons we make
     size_t connectionmem = 0;   // Connection memory we free
     int nlayers = group.nlayers();
 
@@ -2809,63 +4391,71 @@ ShadingSystemImpl::merge_instances (ShaderGroup &group, bool post_opt)
             group[layer]->evaluate_writes_globals_and_userdata_params ();
 
     // Loop over all layers...
-    for (int a = 0;  a < nlayers-1;  ++a) {
-        if (group[a]->unused())    // Don't merge a layer that's not used
+    std::unordered_multimap<size_t,int> signatures;
+    signatures.reserve (nlayers);
+    for (int b = 0;  b < nlayers;  ++b) {
+        if (group[b]->unused())    // Don't merge a layer that's not used
             continue;
-        // Check all later layers...
-        for (int b = a+1;  b < nlayers;  ++b) {
-            if (group[b]->unused())    // Don't merge a layer that's not used
-                continue;
-            if (b == nlayers-1)   // Don't merge the last layer -- causes
-                continue;         // many tears because it's the group entry
+        size_t signature = group[b]->merge_signature ();
+
+        // Look for an earlier used layer, a, that b is identical to.
+        // All the heavy lifting is done by ShaderInstance::mergeable().
+        // Don't merge the last layer -- causes many tears because it's
+        // the group entry.
+        int a = -1;
+        if (b != nlayers-1) {
+            auto range = signatures.equal_range (signature);
+            for (auto s = range.first;  s != range.second && a < 0;  ++s) {
+                ++compares;
+                if (group[s->second]->mergeable (*group[b], group))
+                    a = s->second;
+            }
+        }
+        if (a < 0) {
+            signatures.emplace (signature, b);
+            continue;
+        }
 
-            // Now we have two used layers, a and b, to examine.
-            // See if they are mergeable (identical).  All the heavy
-            // lifting is done by ShaderInstance::mergeable().
-            if (! group[a]->mergeable (*group[b], group))
+        // The two nodes a and b are mergeable, so merge them.
+        ShaderInstance *A = group[a];
+        ShaderInstance *B = group[b];
+        ++merges;
+
+        // We'll keep A, get rid of B.  For all layers later than B,
+        // check its incoming connections and replace all references
+        // to B with references to A.
+        for (int j = b+1;  j < nlayers;  ++j) {
+            ShaderInstance *inst = group[j];
+            if (inst->unused())  // don't bother if it's unused
                 continue;
-
-            // The two nodes a and b are mergeable, so merge them.
-            ShaderInstance *A = group[a];
-            ShaderInstance *B = group[b];
-            ++merges;
-
-            // We'll keep A, get rid of B.  For all layers later than B,
-            // check its incoming connections and replace all references
-            // to B with references to A.
-            for (int j = b+1;  j < nlayers;  ++j) {
-                ShaderInstance *inst = group[j];
-                if (inst->unused())  // don't bother if it's unused
-                    continue;
-                for (int c = 0, ce = inst->nconnections();  c < ce;  ++c) {
-                    Connection &con = inst->connection(c);
-                    if (con.srclayer == b) {
-                        con.srclayer = a;
-                        A->outgoing_connections (true);
-                        if (A->symbols().size() && B->symbols().size()) {
-                            ASSERT (A->symbol(con.src.param)->name() ==
-                                    B->symbol(con.src.param)->name());
-                        }
+            for (int c = 0, ce = inst->nconnections();  c < ce;  ++c) {
+                Connection &con = inst->connection(c);
+                if (con.srclayer == b) {
+                    con.srclayer = a;
+                    A->outgoing_connections (true);
+                    if (A->symbols().size() && B->symbols().size()) {
+                        ASSERT (A->symbol(con.src.param)->name() ==
+                                B->symbol(con.src.param)->name());
                     }
                 }
             }
+        }
 
-            // Mark parameters of B as no longer connected
-            for (int p = B->firstparam();  p < B->lastparam();  ++p) {
-                if (B->symbols().size())
-                    B->symbol(p)->connected_down(false);
-                if (B->m_instoverrides.size())
-                    B->instoverride(p)->connected_down(false);
-            }
-            // B won't be used, so mark it as having no outgoing
-            // connections and clear its incoming connections (which are
-            // no longer used).
-            ASSERT (B->merged_unused() == false);
-            B->outgoing_connections (false);
-            connectionmem += B->clear_connections ();
-            B->m_merged_unused = true;
-            ASSERT (B->unused());
+        // Mark parameters of B as no longer connected
+        for (int p = B->firstparam();  p < B->lastparam();  ++p) {
+            if (B->symbols().size())
+                B->symbol(p)->connected_down(false);
+            if (B->m_instoverrides.size())
+                B->instoverride(p)->connected_down(false);
         }
+        // B won't be used, so mark it as having no outgoing
+        // connections and clear its incoming connections (which are
+        // no longer used).
+        ASSERT (B->merged_unused() == false);
+        B->outgoing_connections (false);
+        connectionmem += B->clear_connections ();
+        B->m_merged_unused = true;
+        ASSERT (B->unused());
     }
 
     {
@@ -2874,11 +4464,15 @@ ShadingSystemImpl::merge_instances (ShaderGroup &group, bool post_opt)
         m_stat_mem_inst_connections -= connectionmem;
         m_stat_mem_inst -= connectionmem;
         m_stat_memory -= connectionmem;
-        if (post_opt)
+        double t = timer();
+        if (post_opt) {
             m_stat_merged_inst_opt += merges;
-        else
+            m_stat_inst_merge_opt_time += t;
+        } else {
             m_stat_merged_inst += merges;
-        m_stat_inst_merge_time += timer();
+        }
+        m_stat_inst_merge_time += t;
+        m_stat_inst_merge_compares += compares;
     }
 
     return merges;
@@ -2981,6 +4575,57 @@ ShadingSystemImpl::archive_shadergroup (ShaderGroup *group, string_view filename
 
 
 
+bool
+ShadingSystemImpl::compile_group_object (ShaderGroup *group, string_view filename)
+{
+    if (! group || filename.empty()) {
+        error ("compile_group_object: no group or no filename");
+        return false;
+    }
+    if (group->optimized()) {
+        error ("compile_group_object: shader group \"%s\" was already optimized",
+               group->name());
+        return false;
+    }
+    std::string err;
+    if (OIIO::Filesystem::exists (filename))
+        OIIO::Filesystem::remove (filename, err);
+    group->m_llvm_object_save_file = ustring (filename);
+    optimize_group (*group);
+    group->m_llvm_object_save_file = ustring();
+    if (group->does_nothing()) {
+        // No code at all, so there's nothing to save.
+        info ("compile_group_object: shader group \"%s\" does nothing",
+              group->name());
+        return true;
+    }
+    if (! OIIO::Filesystem::exists (filename)) {
+        error ("compile_group_object: could not save \"%s\"", filename);
+        return false;
+    }
+    return true;
+}
+
+
+
+bool
+ShadingSystemImpl::load_group_object (ShaderGroup *group, string_view filename)
+{
+    if (! group || filename.empty()) {
+        error ("load_group_object: no group or no filename");
+        return false;
+    }
+    if (group->optimized()) {
+        error ("load_group_object: shader group \"%s\" was already optimized",
+               group->name());
+        return false;
+    }
+    group->m_llvm_object_load_file = ustring (filename);
+    return true;
+}
+
+
+
 void
 ClosureRegistry::register_closure (string_view name, int id,
                                    const ClosureParam *params,
@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2009-2017 Sony Pictures Imageworks Inc., et al.
+All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+* Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+* Neither the name of Sony Pictures Imageworks nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include <OSL/oslconfig.h>
+
+
+OSL_NAMESPACE_ENTER
+
+namespace pvt {   // OSL::pvt
+
+
+/// Graph of which symbols of a shader instance depend on which others,
+/// used by the runtime optimizer to figure out which symbols need
+/// derivatives.  Nodes are small integers (symbol indices).  Edges are
+/// collected with add(), then finalize() packs them into compressed
+/// sparse row form, after which they can be traversed cheaply -- much
+/// less allocation and pointer chasing than a map of sets, which matters
+/// for layers with tens of thousands of symbols.
+class SymDependencyGraph {
+public:
+    SymDependencyGraph () { }
+
+    void clear () {
+        m_edges.clear ();
+        m_begin.clear ();
+        m_deps.clear ();
+    }
+
+    /// Note that node a depends on node b.  Duplicates are harmless.
+    void add (int a, int b) { m_edges.push_back (std::make_pair (a, b)); }
+
+    /// Pack the edges added so far for a graph of nnodes nodes (all
+    /// edges must be within [0,nnodes)).  Must be called before the
+    /// queries below, and any edges added afterwards are ignored until
+    /// finalize is called again.
+    void finalize (int nnodes) {
+        m_begin.assign (nnodes+1, 0);
+        for (auto&& e : m_edges)
+            ++m_begin[e.first+1];
+        for (int n = 0; n < nnodes; ++n)
+            m_begin[n+1] += m_begin[n];
+        m_deps.resize (m_edges.size());
+        std::vector<int> next (m_begin.begin(), m_begin.end()-1);
+        for (auto&& e : m_edges)
+            m_deps[next[e.first]++] = e.second;
+        std::vector<std::pair<int,int> >().swap (m_edges);
+    }
+
+    int nnodes () const { return m_begin.size() ? int(m_begin.size())-1 : 0; }
+
+    /// The nodes that node n depends on are [deps_begin(n), deps_end(n)).
+    const int *deps_begin (int n) const { return m_deps.data() + m_begin[n]; }
+    const int *deps_end (int n) const { return m_deps.data() + m_begin[n+1]; }
+
+    /// Call visit(m) once for every node m that start depends on, directly
+    /// or indirectly.  (Start itself is only visited if it's on a cycle.)
+    template<class VISIT>
+    void visit_dependencies (int start, VISIT visit) const {
+        std::vector<char> seen (nnodes(), 0);
+        std::vector<int> worklist (1, start);
+        while (! worklist.empty()) {
+            int n = worklist.back();
+            worklist.pop_back ();
+            for (const int *d = deps_begin(n), *e = deps_end(n); d != e; ++d) {
+                if (! seen[*d]) {
+                    seen[*d] = 1;
+                    visit (*d);
+                    worklist.push_back (*d);
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<std::pair<int,int> > m_edges;  ///< Edges not yet packed
+    std::vector<int> m_begin;   ///< Where each node's deps start in m_deps
+    std::vector<int> m_deps;    ///< All nodes' deps, end to end
+};
+
+
+}; // namespace pvt
+OSL_NAMESPACE_EXIT
@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2009-2017 Sony Pictures Imageworks Inc., et al.
+All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+* Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+* Neither the name of Sony Pictures Imageworks nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Micro-benchmark of the runtime optimizer's symbol dependency tracking:
+// builds the dependency graph of a synthetic very large layer and
+// propagates derivatives through it, both the way the optimizer used to
+// (a std::map of std::sets, marked recursively) and with
+// SymDependencyGraph, checks that they agree, and reports the speedup.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <OpenImageIO/timer.h>
+
+#include "symdependency.h"
+
+using namespace OSL;
+using namespace OSL::pvt;
+
+
+// The synthetic layer: each op writes one symbol and reads a few that
+// were mostly written shortly before it, like the temps of real code.
+struct SynthOp {
+    int written;
+    int read[3];
+    bool takesderivs;
+};
+
+
+
+static std::vector<SynthOp>
+make_layer (int nsyms, int nops)
+{
+    std::vector<SynthOp> ops (nops);
+    unsigned int seed = 1;
+    auto rnd = [&]() { seed = seed * 1103515245u + 12345u; return (seed >> 8); };
+    for (int i = 0; i < nops; ++i) {
+        SynthOp &op (ops[i]);
+        op.written = int (rnd() % nsyms);
+        for (int r = 0; r < 3; ++r) {
+            // Mostly nearby symbols, occasionally anything
+            int window = (rnd() % 16) ? 64 : nsyms;
+            op.read[r] = std::max (0, op.written - 1 - int(rnd() % window));
+        }
+        op.takesderivs = (rnd() % 50) == 0;
+    }
+    return ops;
+}
+
+
+
+typedef std::map<int, std::set<int> > MapDependency;
+
+static void
+mark_map (MapDependency &deps, std::set<int> &visited,
+          std::vector<char> &derivs, int d)
+{
+    for (auto&& r : deps[d]) {
+        if (visited.find(r) == visited.end()) {
+            visited.insert (r);
+            derivs[r] = 1;
+            mark_map (deps, visited, derivs, r);
+        }
+    }
+}
+
+
+
+static std::vector<char>
+derivs_with_map (const std::vector<SynthOp> &ops, int nsyms)
+{
+    const int DerivSym = -1;
+    MapDependency deps;
+    for (auto&& op : ops) {
+        for (int r = 0; r < 3; ++r)
+            deps[op.written].insert (op.read[r]);
+        if (op.takesderivs)
+            deps[DerivSym].insert (op.read[0]);
+    }
+    std::vector<char> derivs (nsyms, 0);
+    std::set<int> visited;
+    mark_map (deps, visited, derivs, DerivSym);
+    return derivs;
+}
+
+
+
+static std::vector<char>
+derivs_with_graph (const std::vector<SynthOp> &ops, int nsyms)
+{
+    const int DerivSym = nsyms;
+    SymDependencyGraph deps;
+    for (auto&& op : ops) {
+        for (int r = 0; r < 3; ++r)
+            deps.add (op.written, op.read[r]);
+        if (op.takesderivs)
+            deps.add (DerivSym, op.read[0]);
+    }
+    deps.finalize (nsyms+1);
+    std::vector<char> derivs (nsyms, 0);
+    deps.visit_dependencies (DerivSym, [&](int r) { derivs[r] = 1; });
+    return derivs;
+}
+
+
+
+int
+main (int argc, char *argv[])
+{
+    int nsyms = argc > 1 ? atoi(argv[1]) : 20000;
+    int nops = 4 * nsyms;
+    int iterations = 5;
+    std::vector<SynthOp> ops = make_layer (nsyms, nops);
+
+    std::vector<char> map_derivs, graph_derivs;
+    OIIO::Timer timer;
+    for (int i = 0; i < iterations; ++i)
+        map_derivs = derivs_with_map (ops, nsyms);
+    double map_time = timer.lap() / iterations;
+    for (int i = 0; i < iterations; ++i)
+        graph_derivs = derivs_with_graph (ops, nsyms);
+    double graph_time = timer.lap() / iterations;
+
+    int nderivs = 0;
+    for (char d : graph_derivs)
+        nderivs += d;
+    printf ("Layer of %d syms, %d ops (%d syms need derivs):\n",
+            nsyms, nops, nderivs);
+    printf ("  map of sets:          %8.2f ms\n", map_time * 1000.0);
+    printf ("  SymDependencyGraph:   %8.2f ms\n", graph_time * 1000.0);
+    printf ("  speedup:              %8.1fx\n", map_time / std::max (graph_time, 1.0e-9));
+
+    if (map_derivs != graph_derivs) {
+        printf ("FAILED: the two methods disagree about which symbols need derivs\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -669,6 +669,7 @@ int main (int argc, const char *argv[]) {
     for (int i = 0; i < num_threads; i++)
         workers.add_thread(new std::thread (scanline_worker, std::ref(scanline_counter), std::ref(pixels)));
     workers.join_all();
+    shadingsys->flush_errors ();
     double runtime = timer.lap();
 
     // Write image to disk
@@ -31,6 +31,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fstream>
 #include <string>
 #include <vector>
+#include <thread>
 #include <cmath>
 
 #include <OpenImageIO/imageio.h>
@@ -85,9 +86,18 @@ static std::string groupname;
 static std::string groupspec;
 static std::string layername;
 static std::vector<std::string> connections;
+static std::vector<std::string> preloads;
+static int buildthreads = 0;
+struct LayerDecl {
+    std::string shadername, layername;
+    ParamValueList params;
+};
+static std::vector<LayerDecl> layerdecls;  // for --buildthreads
 static ParamValueList params;
 static ParamValueList reparams;
 static std::string reparam_layer;
+static ParamValueList objattribs;
+static bool respecialize = false;
 static ErrorHandler errhandler;
 static int iters = 1;
 static std::string raytype = "camera";
@@ -100,6 +110,10 @@ static OSL::Matrix44 Mshad;  // "shader" space to "common" space matrix
 static OSL::Matrix44 Mobj;   // "object" space to "common" space matrix
 static ShaderGroupRef shadergroup;
 static std::string archivegroup;
+static std::string compileobject;
+static std::string loadobject;
+static bool clonegroup = false;
+static int groupcopies = 0;
 static int exprcount = 0;
 static bool shadingsys_options_set = false;
 static float uscale = 1, vscale = 1;
@@ -202,6 +216,32 @@ shader_from_buffers (std::string shadername)
 
 
 
+// Load the masters of the shaders named with --preload from their .oso
+// files, all at once, each in a thread of its own.
+static void
+preload_shaders ()
+{
+    std::vector<std::thread> threads;
+    for (auto&& name : preloads) {
+        threads.emplace_back ([name](){
+            std::string osofilename = name + ".oso";
+            std::string osobuffer;
+            if (! read_text_file (osofilename, osobuffer)) {
+                std::cerr << "Could not open \"" << osofilename << "\"\n";
+                return;
+            }
+            // If another thread got to the same shader first, this
+            // returns false, which is fine.
+            shadingsys->LoadMemoryCompiledShader (name, osobuffer);
+        });
+    }
+    for (auto&& t : threads)
+        t.join ();
+    preloads.clear ();
+}
+
+
+
 static int
 add_shader (int argc, const char *argv[])
 {
@@ -210,13 +250,22 @@ add_shader (int argc, const char *argv[])
 
     set_shadingsys_options ();
 
+    if (preloads.size())
+        preload_shaders ();
+
     if (inbuffer)  // Request to exercise the buffer-based API calls
         shader_from_buffers (shadername);
 
     for (int i = 0;  i < argc;  i++) {
-        inject_params ();
         shadernames.push_back (shadername);
-        shadingsys->Shader ("surface", shadername, layername);
+        if (buildthreads) {
+            // The group is built later, by several threads at once.
+            LayerDecl decl = { shadername.str(), layername, params };
+            layerdecls.push_back (decl);
+        } else {
+            inject_params ();
+            shadingsys->Shader ("surface", shadername, layername);
+        }
         layername.clear ();
         params.clear ();
     }
@@ -282,11 +331,15 @@ static void
 action_param (int argc, const char *argv[])
 {
     std::string command = argv[0];
-    bool use_reparam = false;
+    bool use_reparam = false, use_objattrib = false;
     if (OIIO::Strutil::istarts_with(command, "--reparam") ||
         OIIO::Strutil::istarts_with(command, "-reparam"))
         use_reparam = true;
-    ParamValueList &params (use_reparam ? reparams : (::params));
+    if (OIIO::Strutil::istarts_with(command, "--objattrib") ||
+        OIIO::Strutil::istarts_with(command, "-objattrib"))
+        use_objattrib = true;
+    ParamValueList &params (use_reparam ? reparams
+                            : use_objattrib ? objattribs : (::params));
 
     string_view paramname (argv[1]);
     string_view stringval (argv[2]);
@@ -443,6 +496,28 @@ action_groupspec (int argc, const char *argv[])
 
 
 
+// Build the group from the layers and connections given on the command
+// line (with --buildthreads), through the calls that name the group
+// being built, which several threads may make at once.
+static ShaderGroupRef
+build_group ()
+{
+    ShaderGroupRef group = shadingsys->ShaderGroupCreate (groupname);
+    for (auto&& decl : layerdecls) {
+        for (auto&& pv : decl.params)
+            shadingsys->Parameter (*group, pv.name(), pv.type(), pv.data(),
+                                   pv.interp() == ParamValue::INTERP_CONSTANT);
+        shadingsys->Shader (*group, "surface", decl.shadername, decl.layername);
+    }
+    for (size_t i = 0;  i+3 < connections.size();  i += 4)
+        shadingsys->ConnectShaders (*group, connections[i], connections[i+1],
+                                    connections[i+2], connections[i+3]);
+    shadingsys->ShaderGroupEnd (*group);
+    return group;
+}
+
+
+
 static void
 set_profile (int argc, const char *argv[])
 {
@@ -489,10 +564,22 @@ getargs (int argc, const char *argv[])
                     "Connect fromlayer fromoutput tolayer toinput",
                 "--reparam %@ %s %s %s", &action_reparam, NULL, NULL, NULL,
                         "Change a parameter (args: layername paramname value) (options: type=%s)",
+                "--respecialize", &respecialize,
+                        "Respecialize the group after each reparam (requires the allow_respecialize option)",
+                "--objattrib %@ %s %s", &action_param, NULL, NULL,
+                        "Shade a variant of the group for an object with this attribute (args: name value) (options: type=%s)",
                 "--group %@ %s", &action_groupspec, &groupspec,
                         "Specify a full group command",
                 "--archivegroup %s", &archivegroup,
                         "Archive the group to a given filename",
+                "--compileobject %s", &compileobject,
+                        "Compile the group ahead of time, saving its code to a given filename",
+                "--loadobject %s", &loadobject,
+                        "Use the group's code precompiled by --compileobject, rather than JIT",
+                "--clonegroup", &clonegroup,
+                        "Shade a copy of the group, rebuilt from its serialization, after compiling the original",
+                "--groupcopies %d", &groupcopies,
+                        "Compile this many more copies of the group along with it, on all threads, and run each once",
                 "--raytype %s", &raytype, "Set the raytype",
                 "--raytype_opt", &raytype_opt, "Specify ray type mask for optimization",
                 "--iters %d", &iters, "Number of iterations",
@@ -507,6 +594,8 @@ getargs (int argc, const char *argv[])
                 "--groupoutputs", &use_group_outputs, "Specify group outputs, not global outputs",
                 "--oslquery", &do_oslquery, "Test OSLQuery at runtime",
                 "--inbuffer", &inbuffer, "Compile osl source from and to buffer",
+                "--buildthreads %d", &buildthreads, "Build the group in this many threads at once, and shade the first (must precede the shaders)",
+                "--preload %L", &preloads, "Load this shader's .oso before the group's shaders, concurrently with any other --preload shaders",
                 "--shadeimage", &use_shade_image, "Use shade_image utility",
                 "--noshadeimage %!", &use_shade_image, "Don't use shade_image utility",
                 "--expr %@ %s", &specify_expr, NULL, "Specify an OSL expression to evaluate",
@@ -641,6 +730,39 @@ static void
 setup_output_images (ShadingSystem *shadingsys,
                      ShaderGroupRef &shadergroup)
 {
+    if (extraoptions.size())
+        shadingsys->attribute ("options", extraoptions);
+    if (texoptions.size())
+        shadingsys->texturesys()->attribute ("options", texoptions);
+
+    if (clonegroup) {
+        // Compile the group, then replace it with a structurally identical
+        // copy, rebuilt from its serialized form, which is compiled
+        // separately when it's first run.  The rest of the setup applies
+        // to the copy; the original is released.
+        std::string pickle;
+        shadingsys->getattribute (shadergroup.get(), "pickle", pickle);
+        ShadingContext *ctx = shadingsys->get_context ();
+        ShaderGlobals sg;
+        setup_shaderglobals (sg, shadingsys, 0, 0);
+        shadingsys->execute (ctx, *shadergroup, sg, false);
+        shadingsys->release_context (ctx);
+        shadergroup = shadingsys->ShaderGroupBegin (groupname, "surface", pickle);
+        shadingsys->ShaderGroupEnd ();
+    }
+
+    if (objattribs.size()) {
+        // Replace the group with its variant for an object with the
+        // given attributes.
+        ShaderGroupRef variant = shadingsys->object_variant (shadergroup.get(),
+                                                             objattribs);
+        if (! variant) {
+            std::cerr << "ERROR: Could not make an object variant of the group\n";
+            exit (EXIT_FAILURE);
+        }
+        shadergroup = variant;
+    }
+
     // Tell the shading system which outputs we want
     if (outputvars.size()) {
         std::vector<const char *> aovnames (outputvars.size());
@@ -677,11 +799,6 @@ setup_output_images (ShadingSystem *shadingsys,
                                &layers[0]);
     }
 
-    if (extraoptions.size())
-        shadingsys->attribute ("options", extraoptions);
-    if (texoptions.size())
-        shadingsys->texturesys()->attribute ("options", texoptions);
-
     ShadingContext *ctx = shadingsys->get_context ();
     // Because we can only call find_symbol or get_symbol on something that
     // has been set up to shade (or executed), we call execute() but tell it
@@ -689,9 +806,43 @@ setup_output_images (ShadingSystem *shadingsys,
     ShaderGlobals sg;
     setup_shaderglobals (sg, shadingsys, 0, 0);
 
+    if (loadobject.size())
+        shadingsys->load_group_object (shadergroup.get(), loadobject);
+    if (compileobject.size()) {
+        if (raytype_opt)
+            shadingsys->set_raytypes (shadergroup.get(), raytype_bit, ~raytype_bit);
+        if (shadingsys->compile_group_object (shadergroup.get(), compileobject))
+            std::cout << "Saved compiled group to " << compileobject << "\n";
+    }
+
+    if (groupcopies > 0) {
+        // Make more copies of the group, and compile them all (with the
+        // group itself) at once, spread over the threads.  Run each copy
+        // once, then let it go.
+        std::string pickle;
+        shadingsys->getattribute (shadergroup.get(), "pickle", pickle);
+        std::vector<ShaderGroupRef> copies;
+        for (int i = 0;  i < groupcopies;  ++i) {
+            copies.push_back (shadingsys->ShaderGroupBegin (groupname, "surface", pickle));
+            shadingsys->ShaderGroupEnd ();
+        }
+        shadingsys->optimize_all_groups (num_threads);
+        for (auto&& copy : copies)
+            shadingsys->execute (ctx, *copy, sg);
+    }
+
     if (raytype_opt)
         shadingsys->optimize_group (shadergroup.get(), raytype_bit, ~raytype_bit);
-    shadingsys->execute (ctx, *shadergroup, sg, false);
+    bool not_ready = false;
+    shadingsys->execute (ctx, *shadergroup, sg, false, &not_ready);
+
+    // With the "async_jit" option, that may merely have queued the group
+    // to be compiled in the background.  Wait for it, since we can't find
+    // its symbols (or shade with it) until it's ready.
+    if (not_ready) {
+        shadingsys->wait_for_group (shadergroup.get());
+        shadingsys->execute (ctx, *shadergroup, sg, false);
+    }
 
     if (entryoutputs.size()) {
         std::cout << "Entry outputs:";
@@ -776,8 +927,11 @@ setup_output_images (ShadingSystem *shadingsys,
 static void
 save_outputs (ShadingSystem *shadingsys, ShadingContext *ctx, int x, int y)
 {
-    if (print_outputs)
+    if (print_outputs) {
+        // Let the shader's own output come before ours.
+        shadingsys->flush_errors ();
         printf ("Pixel (%d, %d):\n", x, y);
+    }
     // For each output requested on the command line...
     for (size_t i = 0;  i < outputfiles.size();  ++i) {
         // Skip if we couldn't open the image or didn't match a known output
@@ -1078,16 +1232,40 @@ test_shade (int argc, const char *argv[])
                       << connections[i] << "." << connections[i+1]
                       << " to " << connections[i+2] << "." << connections[i+3]
                       << "\n";
-            shadingsys->ConnectShaders (connections[i].c_str(),
-                                        connections[i+1].c_str(),
-                                        connections[i+2].c_str(),
-                                        connections[i+3].c_str());
+            if (! buildthreads)   // build_group() connects those
+                shadingsys->ConnectShaders (connections[i].c_str(),
+                                            connections[i+1].c_str(),
+                                            connections[i+2].c_str(),
+                                            connections[i+3].c_str());
         }
     }
 
     // End the group
     shadingsys->ShaderGroupEnd ();
 
+    if (buildthreads > 0) {
+        // Build the group over again, once in each of several threads at
+        // the same time, and use the first of them.  They must all come
+        // out the same.
+        std::vector<ShaderGroupRef> groups (buildthreads);
+        std::vector<std::thread> threads;
+        for (int t = 0;  t < buildthreads;  ++t)
+            threads.emplace_back ([&groups,t](){ groups[t] = build_group (); });
+        for (auto&& t : threads)
+            t.join ();
+        std::string first;
+        shadingsys->getattribute (groups[0].get(), "pickle", first);
+        int same = 0;
+        for (auto&& g : groups) {
+            std::string pickle;
+            shadingsys->getattribute (g.get(), "pickle", pickle);
+            same += (pickle == first);
+        }
+        std::cout << "Built " << buildthreads << " groups at once, "
+                  << same << " of them identical to the first\n";
+        shadergroup = groups[0];
+    }
+
     if (verbose || do_oslquery) {
         std::string pickle;
         shadingsys->getattribute (shadergroup.get(), "pickle", pickle);
@@ -1140,6 +1318,9 @@ test_shade (int argc, const char *argv[])
     if (num_threads < 1)
         num_threads = OIIO::Sysutil::hardware_concurrency();
 
+    int tier_executions = 0;
+    shadingsys->getattribute ("llvm_tier_executions", tier_executions);
+
     double setuptime = timer.lap ();
 
     // Allow a settable number of iterations to "render" the whole image,
@@ -1148,6 +1329,13 @@ test_shade (int argc, const char *argv[])
     for (int iter = 0;  iter < iters;  ++iter) {
         OIIO::ROI roi (0, xres, 0, yres);
 
+        // With "llvm_tier_executions", the group is recompiled with full
+        // optimization in the background once it has run often enough.
+        // Wait for that, so that the last iteration (whose results we
+        // save) runs the recompiled code.
+        if (tier_executions && iters > 1 && iter == iters-1)
+            shadingsys->wait_for_promotion (shadergroup.get());
+
         if (use_shade_image)
             OSL::shade_image (*shadingsys, *shadergroup, NULL,
                               *outputimgs[0], outputvarnames,
@@ -1172,9 +1360,12 @@ test_shade (int argc, const char *argv[])
                                          pv.name().c_str(), pv.type(),
                                          pv.data());
             }
+            if (respecialize)
+                shadingsys->respecialize_group (*shadergroup);
         }
     }
     double runtime = timer.lap();
+    shadingsys->flush_errors ();
 
     if (outputfiles.size() == 0)
         std::cout << "\n";
@@ -0,0 +1,22 @@
+#!/usr/bin/env python
+
+# Compile a group ahead of time to an object file, then run an identical
+# group (in another process) with that code rather than JITing it.
+groupsetup = "--layer lay --param label first --param scale 5.0 labeled"
+command += "rm -f labeled.oslobj ;\n"
+command += testshade("--groupname aot --compileobject labeled.oslobj " + groupsetup)
+command += testshade("--groupname aot --loadobject labeled.oslobj " + groupsetup)
+# ... and doesn't even need to be optimized.
+command += testshade("--groupname aot --loadobject labeled.oslobj --runstats " +
+                     groupsetup + " | grep 'Precompiled groups'")
+
+# A group that differs from the precompiled one can't use its code, and
+# falls back to the JIT.
+command += testshade("--groupname aot --loadobject labeled.oslobj " +
+                     "--layer other --param label first --param scale 5.0 labeled " +
+                     "2>&1 | grep WARNING")
+
+# Code compiled for one target ISA isn't used with another.
+command += testshade("--groupname aot --loadobject labeled.oslobj " +
+                     "--options llvm_target_isa=host " + groupsetup +
+                     " 2>&1 | grep WARNING")
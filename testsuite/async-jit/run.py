@@ -0,0 +1,12 @@
+#!/usr/bin/env python
+
+# With async_jit, execute() doesn't wait for the group to be compiled,
+# but returns right away and leaves it to a background thread.  testshade
+# sees that (execute's not_ready flag) and blocks in wait_for_group()
+# before shading, so the results must be the same as with the usual JIT
+# on first use.
+command += testshade("--options async_jit=1 --runstats deferred | grep 'Async JIT:'")
+command += testshade("--options async_jit=1 deferred")
+
+# With greedyjit as well, all the groups are queued at once.
+command += testshade("--options greedyjit=1,async_jit=1 deferred")
@@ -0,0 +1,12 @@
+#!/usr/bin/env python
+
+# With --buildthreads, testshade builds the same group in several threads
+# at once with the calls that name the group being built, rather than
+# the current one.  Each group must come out the same as the others (and
+# as one built the usual way), and shade the same.
+groupsetup = ("-layer tc -param scale 2.0 texcoord " +
+              "-layer r -param lo 10.0 ramp " +
+              "-connect tc s r s")
+
+command += testshade(groupsetup)
+command += testshade("--buildthreads 8 " + groupsetup)
@@ -0,0 +1,7 @@
+#!/usr/bin/env python
+
+# Dx/Dy in the downstream layer need derivatives of everything they
+# depend on, through the connection, a loop filling an array, and plain
+# assignments, which the optimizer must track to mark them all.
+command += testshade("-layer up --param scale 2.0 up -layer down down " +
+                     "-connect up out down in")
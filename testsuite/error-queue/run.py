@@ -0,0 +1,21 @@
+#!/usr/bin/env python
+
+# Messages from each shade are passed on as a unit, in order -- also
+# when they're delivered by the error thread.
+command += testshade("-t 1 -g 2 2 test")
+command += testshade("-t 1 -g 2 2 --options error_thread=1 test")
+
+# With suppress_repeat_errors=1, a context reports one warning per second
+# from the same place in the shader, even though the text differs; the
+# stats count the rest.
+command += testshade("-t 1 -g 2 2 --param warn 1 " +
+                     "--options suppress_repeat_errors=1 --runstats test " +
+                     "| grep 'suppressed'")
+
+# With several threads, shades finish in no particular order, but each
+# one's messages still arrive together: count the shades whose "first"
+# line is directly followed by their own "second" line.
+command += testshade("-t 4 -g 16 16 --options error_thread=1 test " +
+                     "| awk '/first/ { want = $0; sub(/first/, \"second\", want);" +
+                     " getline next_line; if (next_line == want) paired++ }" +
+                     " END { print paired \" of 256 shades reported together\" }'")
@@ -0,0 +1,7 @@
+#!/usr/bin/env python
+
+# The renderer knows nothing of "myscale" or "myname", but a variant of
+# the group for an object with those attributes folds getattribute() of
+# them to the object's values.
+command += testshade("test")
+command += testshade("--objattrib myscale 2.5 --objattrib myname cube test")
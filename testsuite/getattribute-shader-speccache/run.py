@@ -0,0 +1,16 @@
+#!/usr/bin/env python
+
+# Layers alpha and beta are identical instances of the same shader, apart
+# from their names, which getattribute("shader:layername") folds into
+# the code.  With the specialization cache on, beta must not reuse the
+# optimization of alpha (and vice versa).
+command += testshade("--options opt_specialization_cache=1,opt_merge_instances=0 " +
+                     "-layer alpha src -layer beta src -layer gamma sum " +
+                     "-connect alpha out gamma a -connect beta out gamma b")
+
+# The stats must show that neither was reused: each of the three layers
+# is looked up once per optimization pass, and never found.
+command += testshade("--options opt_specialization_cache=1,opt_merge_instances=0 --runstats " +
+                     "-layer alpha src -layer beta src -layer gamma sum " +
+                     "-connect alpha out gamma a -connect beta out gamma b " +
+                     "| grep 'instance optimizations'")
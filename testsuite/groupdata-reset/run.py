@@ -0,0 +1,11 @@
+#!/usr/bin/env python
+
+# Before each point, the group's layer-run flags, userdata-initialized
+# flags and closure params are reset.  Each point must run the emitter
+# layer afresh, read its own s and t userdata, and only see the emission
+# closure where the emitter made one.  With clearmemory, the heap is
+# zeroed anyway and the reset is skipped, with the same results.
+groupsetup = "-g 2 2 -layer e emitter -layer v viewer -connect e C v C "
+
+command += testshade(groupsetup)
+command += testshade(groupsetup + "--options clearmemory=1")
@@ -0,0 +1,12 @@
+#!/usr/bin/env python
+
+# The first run JITs the group and saves its object code in the cache;
+# the second finds the code there and runs it without compiling.
+command += "rm -rf jitcache ;\n"
+command += testshade("--options llvm_cache_dir=jitcache --runstats cached | grep 'JIT object cache'")
+command += testshade("--options llvm_cache_dir=jitcache --runstats cached | grep 'JIT object cache'")
+
+# The cache is keyed on the structure of the group, not its name, so a
+# renamed but otherwise identical group finds the same code.
+command += testshade("--options llvm_cache_dir=jitcache --runstats --groupname renamed cached | grep 'JIT object cache'")
+command += testshade("--options llvm_cache_dir=jitcache cached")
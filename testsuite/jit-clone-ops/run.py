@@ -0,0 +1,7 @@
+#!/usr/bin/env python
+
+# Each JIT starts from a copy of the thread's parsed shadeops module.
+# With --clonegroup, the group is JITed a second time, from a fresh copy,
+# and the ops it calls into must work just the same.
+command += testshade("ops")
+command += testshade("--clonegroup ops")
@@ -0,0 +1,6 @@
+#!/usr/bin/env python
+
+# With --clonegroup, the original group is released once its copy has
+# been made, and the memory of its JITed code must be freed with it.
+command += testshade("--clonegroup scaled")
+command += testshade("--clonegroup --runstats scaled | grep -c 'JIT memory: .* freed)'")
@@ -0,0 +1,13 @@
+#!/usr/bin/env python
+
+# With llvm_tier_executions, a group is first JITed with little
+# optimization, and recompiled with full optimization in the background
+# once it has run that many times.  testshade waits for that (with
+# wait_for_promotion) before the last iteration, whose outputs must be the
+# same as those of a group that was fully optimized from the start.
+command += testshade("-g 2 2 -o Cout out.exr --print tiered")
+command += testshade("-g 2 2 -o Cout out.exr --print --iters 3 " +
+                     "--options llvm_tier_executions=2 tiered")
+command += testshade("-g 2 2 -o Cout out.exr --iters 3 " +
+                     "--options llvm_tier_executions=2 --runstats tiered " +
+                     "| grep -o 'Recompiled [0-9]* hot groups'")
@@ -0,0 +1,15 @@
+#!/usr/bin/env python
+
+# With llvm_lazy_entry_layers, each entry layer of a group with several
+# of them is JITed only when it's first called.  Running them all must
+# give the usual results, and asking only for B.out must JIT only B.
+
+groupsetup = ("-layer A -param name A -param in 1.0 node " +
+              "-layer B -param name B -param in 2.0 node " +
+              "-layer C -param name C -param in 3.0 node " +
+              "-entry A -entry B -entry C " +
+              "--options llvm_lazy_entry_layers=1 ")
+
+command += testshade(groupsetup)
+command += testshade(groupsetup + "--entryoutput B.out --runstats " +
+                     "| grep -o '[0-9]* entry layers deferred until first call, [0-9]* of them'")
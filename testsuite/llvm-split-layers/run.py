@@ -0,0 +1,16 @@
+#!/usr/bin/env python
+
+# With llvm_split_layers, a group with more layers than that is JITed in
+# chunks of layers, concurrently, which call each other indirectly.
+# Split at every layer, the group must give the same results as when
+# it's JITed whole.
+groupsetup = ("-layer a -param name a -param in 1.0 chain " +
+              "-layer b -param name b -param step 2.0 chain " +
+              "-layer c -param name c -param step 3.0 chain " +
+              "-layer d -param name d -param step 4.0 chain " +
+              "-connect a out b in -connect b out c in -connect c out d in ")
+
+command += testshade(groupsetup)
+command += testshade(groupsetup + "--options llvm_split_layers=1")
+command += testshade(groupsetup + "--options llvm_split_layers=1 --runstats " +
+                     "| grep -o '[0-9]* groups JITed in concurrent chunks'")
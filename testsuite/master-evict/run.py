@@ -0,0 +1,10 @@
+#!/usr/bin/env python
+
+# With evict_master_code, a shader's code is freed once every instance of
+# it has copied it.  With --clonegroup, the copy of the group is made
+# after the original has been compiled, so its instance must reload the
+# code from the .oso, and get the same results.
+command += testshade("reloaded")
+command += testshade("--clonegroup --options evict_master_code=1 reloaded")
+command += testshade("--clonegroup --options evict_master_code=1 --runstats reloaded " +
+                     "| grep -o 'Master code evicted: [0-9]*\\|reloaded: [0-9]*'")
@@ -0,0 +1,18 @@
+#!/usr/bin/env python
+
+# Three identical layers, and one that differs only in a param value,
+# feed the last layer.  The identical ones must merge into one, which
+# runs once, and the layer that differs must not.  Only layers with the
+# same merge signature are compared in full, so it takes just two
+# comparisons to find both merges.
+groupsetup = ("-layer a1 -param scale 1.0 src " +
+              "-layer a2 -param scale 1.0 src " +
+              "-layer a3 -param scale 1.0 src " +
+              "-layer a4 -param scale 2.0 src " +
+              "-layer b sum " +
+              "-connect a1 out b in1 -connect a2 out b in2 " +
+              "-connect a3 out b in3 -connect a4 out b in4 ")
+
+command += testshade(groupsetup)
+command += testshade(groupsetup + "--runstats " +
+                     "| grep -o 'Merged [0-9]* instances ([0-9]* initial\\|[0-9]* full comparisons'")
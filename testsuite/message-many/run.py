@@ -0,0 +1,6 @@
+#!/usr/bin/env python
+
+# Enough messages to make the blackboard's table grow several times, set
+# and then retrieved by name, for two shades in a row (so the second
+# finds the table as the first left it, but cleared).
+command += testshade("-t 1 -g 2 1 test")
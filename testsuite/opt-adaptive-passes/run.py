@@ -0,0 +1,16 @@
+#!/usr/bin/env python
+
+# opt_adaptive_passes stops optimizing each layer after fewer passes that
+# change nothing, which must not change what the group computes.
+command += testshade("-g 2 2 adaptive")
+command += testshade("-g 2 2 --options opt_adaptive_passes=1 adaptive")
+
+# With opt_profile, the stats count the optimizer's passes over the
+# layers.  Save the count for each setting, and compare them.
+command += testshade("--options opt_profile=1 --runstats adaptive " +
+                     "| awk '/layer passes/ {print $3 > \"full.txt\"}'")
+command += testshade("--options opt_profile=1,opt_adaptive_passes=1 --runstats adaptive " +
+                     "| awk '/layer passes/ {print $3 > \"adaptive.txt\"}'")
+command += ("awk '{ n[FILENAME] = $1 } " +
+            "END { print (n[\"adaptive.txt\"] < n[\"full.txt\"] ? \"fewer\" : \"no fewer\"), \"passes with opt_adaptive_passes\" }' " +
+            "full.txt adaptive.txt >> out.txt 2>&1 ;\n")
@@ -0,0 +1,9 @@
+#!/usr/bin/env python
+
+# optimize_all_groups spreads the groups over the threads, each of which
+# keeps taking the largest group left.  Compile eight identical groups on
+# four threads; each thread's time is reported, and each group must give
+# the same result.
+command += testshade("-t 4 --groupcopies 7 --runstats work " +
+                     "| grep -o 'Compiled [0-9]* groups\\|thread [0-9]*:'")
+command += testshade("-t 4 --groupcopies 7 work")
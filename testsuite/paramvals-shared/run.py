@@ -0,0 +1,18 @@
+#!/usr/bin/env python
+
+# Layers A and B override the same param with the same value, so they
+# share one copy of that override (kept from merging, which would hide
+# that), and go on sharing it once optimized.  ReParameter of A must
+# change only A, whether it rewrites the optimized instance (which takes
+# its own copy first) or, with allow_respecialize, the unoptimized one
+# that the group is respecialized from.
+groupsetup = ("-layer A --param:lockgeom=0 scale 2.0 twin " +
+              "-layer B --param:lockgeom=0 scale 2.0 twin " +
+              "-layer C pair -connect A out C a -connect B out C b " +
+              "--iters 2 --reparam A scale 4.0 ")
+
+command += testshade(groupsetup + "--options opt_merge_instances=0")
+command += testshade(groupsetup + "--options opt_merge_instances=0,allow_respecialize=1 " +
+                     "--respecialize")
+command += testshade(groupsetup + "--options opt_merge_instances=0 --runstats " +
+                     "| grep -o 'saved by keeping only shared overrides'")
@@ -0,0 +1,13 @@
+#!/usr/bin/env python
+
+# Load the shaders from memory in several threads at once, with two of
+# them asked for twice, before building a group from them.  Each must be
+# loaded just once, and the group must run as if they had been loaded
+# from their files one after another.
+groupsetup = ("--preload alpha --preload beta --preload gamma --preload delta " +
+              "--preload alpha --preload delta " +
+              "-layer a alpha -layer b beta -layer c gamma -layer d delta " +
+              "-connect a out b in -connect b out c in -connect c out d in ")
+
+command += testshade(groupsetup)
+command += testshade(groupsetup + "--runstats | grep 'Loaded:'")
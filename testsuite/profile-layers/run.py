@@ -0,0 +1,9 @@
+#!/usr/bin/env python
+
+# With profile=2, the stats break down execution by layer and renderer
+# callback.  The times vary from run to run, so just check what was run
+# how many times.
+command += testshade("-g 2 2 --options profile=2 --runstats " +
+                     "-layer up up -layer down down -connect up out down in " +
+                     "| awk '/^        [^ ].* (runs|calls)$/ {print $1, $(NF-1), $NF}' " +
+                     "| LC_ALL=C sort")
@@ -0,0 +1,25 @@
+#!/usr/bin/env python
+
+# With allow_respecialize, a lockgeom=0 param changed by ReParameter is
+# folded into the code as a constant by respecialize_group(), which
+# testshade calls after each reparam.  The shader must see the new value,
+# and take the branch that goes with it, whether or not it has been
+# respecialized yet.
+groupsetup = ("--options allow_respecialize=1 " +
+              "--layer lay --param:lockgeom=0 threshold 0.5 branch " +
+              "--iters 3 --reparam lay threshold 4.0 --respecialize ")
+
+command += testshade(groupsetup)
+command += testshade(groupsetup + "--runstats " +
+                     "| grep -o 'Respecialized [0-9]* groups after ReParameter'")
+
+# Respecializing only redoes the layers downstream of the change; the
+# upstream layer keeps its code, and goes on computing the same input.
+layersetup = ("--options allow_respecialize=1 " +
+              "--layer up branch " +
+              "--layer lay --param:lockgeom=0 factor 1.0 scale " +
+              "--connect up out lay in " +
+              "--iters 3 --reparam lay factor 2.0 --respecialize ")
+command += testshade(layersetup)
+command += testshade(layersetup + "--runstats " +
+                     "| grep -o 'kept the code of [0-9]* unaffected layers'")